@@ -23,6 +23,7 @@
 #ifndef D17B_H
 #define D17B_H
 
+#include <stddef.h>
 #include <stdint.h>
 #include <stdbool.h>
 
@@ -35,6 +36,7 @@
 /* Memory layout */
 #define CHANNELS        47          /* Channels 00-46 (octal) */
 #define SECTORS         128         /* Sectors per channel */
+#define MAP_CHANNELS    256         /* Address map covers every uint8_t channel */
 #define MAIN_MEMORY     (CHANNELS * SECTORS)  /* 6016 words theoretical */
 #define ACTUAL_MEMORY   2944        /* Actual addressable words */
 
@@ -143,8 +145,145 @@ typedef enum {
     SHIFT_COA   = 0x10, /* 00 40 - Character Output A */
 } d17b_shift_t;
 
-/* CPU state structure */
+/*
+ * Execution cores. d17b_run drives one of these; d17b_step is always
+ * the plain handler-call path and serves as the reference.
+ *
+ * The threaded core needs GCC/Clang labels-as-values. Build with
+ * -DD17B_NO_THREADED (make THREADED=0) to leave it out. The JIT core is
+ * x86-64 only, built with -DD17B_JIT (make JIT=1) and switched on per
+ * CPU with d17b_jit_enable.
+ */
+#if defined(__GNUC__) && !defined(D17B_NO_THREADED)
+#define D17B_HAVE_THREADED 1
+#else
+#define D17B_HAVE_THREADED 0
+#endif
+
+typedef enum {
+    D17B_CORE_STEP      = 0,    /* Loop over d17b_step */
+    D17B_CORE_THREADED  = 1,    /* Computed-goto dispatch */
+    D17B_CORE_JIT       = 2,    /* Native basic blocks */
+} d17b_core_t;
+
+/*
+ * Why d17b_run_until stopped. Halt and budget always end a run; the
+ * others only when the matching D17B_STOP_* bit is passed. The threaded
+ * core looks for I/O and errors after the operations that can cause
+ * them, the JIT at block boundaries. Breakpoints are exact, so while any
+ * are set and requested the run goes through d17b_step.
+ */
+typedef enum {
+    D17B_EXIT_BUDGET      = 0,      /* max_cycles words retired */
+    D17B_EXIT_HALT        = 1,      /* HPR, or already halted */
+    D17B_EXIT_BREAKPOINT  = 2,      /* I is at a breakpoint */
+    D17B_EXIT_IO          = 3,      /* A discrete/voltage/binary output */
+    D17B_EXIT_ERROR       = 4,      /* cpu->error is set */
+} d17b_exit_t;
+
+#define D17B_STOP_BREAKPOINT    0x01
+#define D17B_STOP_IO            0x02
+#define D17B_STOP_ERROR         0x04
+
+typedef struct d17b_cpu d17b_cpu_t;
+typedef struct d17b_decoded d17b_decoded_t;
+
+/*
+ * Timed events. d17b_schedule files an event for the word time 'when'
+ * (a cycle_count value); d17b_run_until only breaks its run at the next
+ * one due, applies it and carries on, so pending events cost nothing per
+ * instruction. Events fire at the first instruction boundary at or after
+ * 'when'. A non-zero period re-arms the event that many word times on,
+ * which is how periodic I/O sampling callbacks are set up.
+ */
+typedef enum {
+    D17B_EV_DETECTOR    = 0,        /* detector = (value != 0) */
+    D17B_EV_DISCRETE_A  = 1,        /* discrete_in_a = value */
+    D17B_EV_DISCRETE_B  = 2,        /* discrete_in_b = value */
+    D17B_EV_V_LOOP      = 3,        /* V[index] += value (incremental input) */
+    D17B_EV_R_LOOP      = 4,        /* R[index] = value (resolver input) */
+    D17B_EV_CALL        = 5,        /* fn(cpu, user) */
+    D17B_EV_PROCEED     = 6,        /* Clear halted: resume after HPR */
+} d17b_event_kind_t;
+
+typedef void (*d17b_event_fn_t)(d17b_cpu_t *cpu, void *user);
+
+typedef struct {
+    uint64_t when;                  /* Word time (cycle_count) to fire at */
+    uint32_t period;                /* Re-arm interval, 0 = once */
+    uint32_t value;
+    uint8_t kind;                   /* d17b_event_kind_t */
+    uint8_t index;                  /* Loop word for V/R events */
+    d17b_event_fn_t fn;             /* D17B_EV_CALL only */
+    void *user;
+} d17b_event_t;
+
+/*
+ * Decoded instruction cache
+ *
+ * Every executed disc word is decoded once into one of these and kept in
+ * a per-channel/per-sector table. The operand address is pre-resolved to
+ * a word offset inside d17b_cpu_t (so rapid-access loop aliasing has
+ * already been applied) and the Sp successor is kept as a ready-made I
+ * register image. d17b_write and d17b_flag_store drop the entry for any
+ * slot they hit; code that pokes cpu->memory directly must call
+ * d17b_flush_decode afterwards, which also marks every sector dirty so
+ * the next delta snapshot carries the poked words.
+ */
+typedef void (*d17b_handler_t)(d17b_cpu_t *cpu, const d17b_decoded_t *d);
+
+/*
+ * Address map
+ *
+ * Each channel number maps to a word offset inside d17b_cpu_t and a
+ * sector mask, so every access is base + (sector & mask) with no channel
+ * switch. Disc channels mask with 0x7F. The rapid-access loops mask with
+ * their length - 1, which gives their aliasing. All other channels read
+ * the zero word and write the sink word. Offsets rather than pointers
+ * keep d17b_cpu_t safe to copy. Sectors are the 7-bit instruction field.
+ */
 typedef struct {
+    uint16_t read;                  /* Word offset for reads */
+    uint16_t write;                 /* Word offset for writes */
+    uint8_t mask;                   /* Sector mask */
+    bool disc;                      /* Backed by memory[][] (decoded, JIT) */
+} d17b_map_t;
+
+struct d17b_decoded {
+    d17b_handler_t handler;         /* Execution routine, NULL = not decoded */
+    uint16_t operand;               /* Operand word offset (via cpu->map) */
+    uint16_t target;                /* Operand address as an I image (C,S) */
+    uint16_t next;                  /* Sp successor as an I image */
+    uint8_t op;                     /* Decoded operation (internal) */
+    uint8_t aux;                    /* Shift count / phase value */
+};
+
+/* Counter slots per cpu with make PROFILE=1, one per decoded operation */
+#define D17B_PROFILE_OPS    48
+
+/* Drum accesses counted per channel and sector with make PROFILE=1 */
+typedef enum {
+    D17B_HEAT_FETCH     = 0,        /* Instruction fetched from C,S */
+    D17B_HEAT_READ      = 1,        /* Operand read */
+    D17B_HEAT_WRITE     = 2,        /* STO or flag store */
+    D17B_HEAT_ALL       = 3,        /* All three together */
+} d17b_heat_kind_t;
+
+#define D17B_HEAT_KINDS     3
+
+/* Rotational waits charged to one instruction address, make PROFILE=1 */
+typedef struct {
+    uint64_t executed;
+    uint64_t operand_wait;          /* Word times waiting for C,S */
+    uint64_t next_wait;             /* Word times waiting for the next word */
+} d17b_latency_t;
+
+/*
+ * CPU state structure. The decode cache makes it about 124 KB, and
+ * make PROFILE=1 over 400 KB: give it static or heap storage, not the
+ * stack.
+ */
+struct d17b_cpu {
     /* Main registers - all 24-bit */
     uint32_t A;         /* Accumulator */
     uint32_t L;         /* Lower Accumulator */
@@ -162,6 +301,10 @@ typedef struct {
     uint32_t V[V_LOOP_SIZE];        /* V-loop (4 words, incremental input) */
     uint32_t R[R_LOOP_SIZE];        /* R-loop (4 words, resolver input) */
 
+    /* Backing words for channels with nothing behind them */
+    uint32_t zero;                  /* Read, never written */
+    uint32_t sink;                  /* Written, never read */
+
     /* Main disc memory - organized as channels x sectors */
     uint32_t memory[CHANNELS][SECTORS];
 
@@ -169,10 +312,32 @@ typedef struct {
     uint32_t current_sector;        /* Current sector (0-127) */
     uint64_t cycle_count;           /* Total word times elapsed */
 
+    /*
+     * Rotational timing. Off, every instruction takes one word time. On,
+     * an instruction waits for its own sector to come under the head and
+     * then for its operand's (a rapid-access loop comes round every loop
+     * length, U and L at once), one word time each to read them. Budgets
+     * and cycle_count are then in word times of WORD_TIME_US. Runs use
+     * the step loop while timing is on.
+     */
+    bool timing;
+    uint64_t latency_cycles;        /* Word times spent waiting on the disc */
+
+    /*
+     * Idle fast-forward. On, d17b_run_until waits out an HPR until the
+     * next event (which may resume it), and skips whole iterations of a
+     * loop that comes back round with nothing changed, up to the next
+     * event. Both move cycle_count, current_sector and the countdown
+     * exactly as running would; the skipped time is in idle_cycles.
+     */
+    bool fast_forward;
+    uint64_t idle_cycles;           /* Word times skipped while idle */
+
     /* Status flags */
     bool halted;                    /* Computer is halted */
     bool error;                     /* Error condition */
     bool d37c_mode;                 /* D37C mode: enables DIV, ORA, rotates, TZE */
+    uint8_t core;                   /* d17b_core_t used by d17b_run */
 
     /* I/O state */
     uint32_t discrete_in_a;         /* Discrete input A (24 bits) */
@@ -181,12 +346,59 @@ typedef struct {
     int16_t voltage_out[4];         /* Voltage outputs A-C (±10V as ±32767) */
     uint8_t binary_out[4];          /* Binary outputs A-C */
 
-    /* Detector and countdown */
+    /*
+     * Detector and countdown. The countdown is not ticked per word: it
+     * is brought up to date from countdown_base at EFC/HFC, at event
+     * boundaries and when d17b_step or d17b_run returns.
+     */
     bool detector;                  /* Detector input state */
     uint32_t fine_countdown;        /* Fine countdown timer */
     bool countdown_enabled;         /* Countdown running */
+    uint64_t countdown_base;        /* cycle_count fine_countdown is valid at */
+
+    /* Pending timed events, NULL until the first d17b_schedule */
+    struct d17b_sched *sched;
+
+    /* Run control (d17b_run_until) */
+    bool io_event;                  /* An output was written */
+    uint8_t run_stop;               /* D17B_STOP_* bits of the current run */
+    uint32_t breakpoint_count;
+    uint64_t breakpoints[CHANNELS][SECTORS / 64];
+
+    /* Sectors written since the snapshot this cpu was saved or loaded as */
+    uint64_t dirty[CHANNELS][SECTORS / 64];
+    uint64_t snapshot_id;           /* Its hash, 0 = none */
 
-} d17b_cpu_t;
+    /* Input log being written or fed back, NULL = none */
+    struct d17b_record *record;
+    struct d17b_replay *replay;
+    struct d17b_trace *trace;
+
+#ifdef D17B_PROFILE
+    /* Retirements and word times per decoded operation */
+    uint64_t op_retired[D17B_PROFILE_OPS];
+    uint64_t op_word_times[D17B_PROFILE_OPS];
+
+    /* Accesses by the address in the instruction, before loop aliasing */
+    uint64_t heat[D17B_HEAT_KINDS][CHANNELS][SECTORS];
+
+    /* Timed runs only. The last instruction, and where it sent I */
+    d17b_latency_t latency[CHANNELS][SECTORS];
+    uint32_t latency_from;
+    uint32_t latency_next;          /* UINT32_MAX: no instruction yet */
+#endif
+
+    /* Channel -> storage, see d17b_map_t */
+    d17b_map_t map[MAP_CHANNELS];
+
+    /* Decoded instruction cache, one entry per disc word */
+    d17b_decoded_t decoded[CHANNELS][SECTORS];
+    bool decoded_d37c;              /* Model the entries were decoded for */
+
+    /* Translated code, NULL unless d17b_jit_enable succeeded */
+    struct d17b_jit *jit;
+
+};
 
 /* Function prototypes */
 
@@ -195,12 +407,257 @@ void d17b_init(d17b_cpu_t *cpu);
 void d17b_reset(d17b_cpu_t *cpu);
 
 /* Memory access */
+void d17b_map_init(d17b_cpu_t *cpu);
 uint32_t d17b_read(d17b_cpu_t *cpu, uint8_t channel, uint8_t sector);
 void d17b_write(d17b_cpu_t *cpu, uint8_t channel, uint8_t sector, uint32_t value);
 
+/* Decoded instruction cache */
+void d17b_decode(d17b_cpu_t *cpu, uint32_t instruction, uint8_t channel,
+                 d17b_decoded_t *d);
+void d17b_flush_decode(d17b_cpu_t *cpu);
+
 /* Execution */
 int d17b_step(d17b_cpu_t *cpu);
 int d17b_run(d17b_cpu_t *cpu, uint64_t max_cycles);
+d17b_exit_t d17b_run_until(d17b_cpu_t *cpu, uint64_t max_cycles,
+                           unsigned stop, uint64_t *retired);
+
+/* Breakpoints on disc words, honoured by d17b_run_until */
+void d17b_set_breakpoint(d17b_cpu_t *cpu, uint8_t channel, uint8_t sector,
+                         bool enable);
+void d17b_clear_breakpoints(d17b_cpu_t *cpu);
+
+/*
+ * Timed events - d17b_sched_clear frees them; call it before d17b_init.
+ * d17b_sched_copy frees dst's events and gives it a copy of src's, for
+ * a cpu copied from another (which would otherwise share them).
+ */
+bool d17b_schedule(d17b_cpu_t *cpu, const d17b_event_t *event);
+uint32_t d17b_events_pending(const d17b_cpu_t *cpu);
+void d17b_sched_clear(d17b_cpu_t *cpu);
+bool d17b_sched_copy(d17b_cpu_t *dst, const d17b_cpu_t *src);
+
+/* Basic-block JIT - false if not built in or no executable memory */
+bool d17b_jit_enable(d17b_cpu_t *cpu);
+void d17b_jit_disable(d17b_cpu_t *cpu);
+
+/*
+ * Snapshots: a versioned, checksummed image of the architectural state
+ * (registers, loops, drum, disc position, I/O) in little-endian words on
+ * every host. Pending events and breakpoints are not part of it; loading
+ * drops the cpu's events. The state_* forms work on a caller's buffer of
+ * d17b_state_size() bytes; load maps the file and decodes in place.
+ *
+ * Saving or loading makes that snapshot the cpu's base and clears its
+ * dirty-sector map. A delta holds the state words and only the sectors
+ * written since the base, then becomes the new base; applying one needs
+ * the cpu to hold its parent, untouched. d17b_delta_encode returns the
+ * bytes used (at most d17b_delta_size), or 0 with no base. Load takes
+ * either kind of file.
+ */
+size_t d17b_state_size(void);
+void d17b_state_encode(d17b_cpu_t *cpu, void *buf);
+bool d17b_state_decode(d17b_cpu_t *cpu, const void *buf, size_t len);
+bool d17b_save_state(d17b_cpu_t *cpu, const char *path);
+bool d17b_load_state(d17b_cpu_t *cpu, const char *path);
+void d17b_clear_dirty(d17b_cpu_t *cpu);
+uint32_t d17b_dirty_sectors(const d17b_cpu_t *cpu);
+size_t d17b_delta_size(const d17b_cpu_t *cpu);
+size_t d17b_delta_encode(d17b_cpu_t *cpu, void *buf);
+bool d17b_delta_apply(d17b_cpu_t *cpu, const void *buf, size_t len);
+bool d17b_save_delta(d17b_cpu_t *cpu, const char *path);
+
+/*
+ * Reverse execution. A history checkpoints the cpu as the history_run
+ * and history_step forms move it forward, thinning its checkpoints and
+ * doubling their interval to stay within max_bytes. Stepping back n
+ * instructions, or back to the last breakpoint before the current point,
+ * restores a checkpoint and replays to it; both return false if they
+ * reach the start of the history first. Call d17b_history_mark after
+ * changing the cpu by hand, which forgets everything after that point.
+ * Checkpoints keep the pending events and an input replay's place, so
+ * going back restores them with the rest of the machine.
+ */
+typedef struct d17b_history d17b_history_t;
+
+d17b_history_t *d17b_history_create(d17b_cpu_t *cpu, size_t max_bytes);
+void d17b_history_free(d17b_history_t *h);
+uint32_t d17b_history_checkpoints(const d17b_history_t *h);
+uint64_t d17b_history_interval(const d17b_history_t *h);
+void d17b_history_mark(d17b_history_t *h, d17b_cpu_t *cpu);
+int d17b_history_step(d17b_history_t *h, d17b_cpu_t *cpu);
+d17b_exit_t d17b_history_run(d17b_history_t *h, d17b_cpu_t *cpu,
+                             uint64_t max_cycles, unsigned stop,
+                             uint64_t *retired);
+bool d17b_history_step_back(d17b_history_t *h, d17b_cpu_t *cpu, uint32_t n);
+bool d17b_history_continue_back(d17b_history_t *h, d17b_cpu_t *cpu);
+
+/*
+ * Input record and replay. While recording, every input applied to the
+ * cpu - by an event or by d17b_input, which is how the host should set
+ * them between runs - is logged with the cycle_count it took effect at.
+ * Replaying feeds a log back through one pending event, at exactly those
+ * word times, so a run started from the same state repeats bit for bit.
+ * Both buffer entries and touch the file in bulk; stop flushes and
+ * closes, and both must be stopped before d17b_init. At the end of the
+ * log a replay has nothing pending but stays open until d17b_replay_stop,
+ * so a history can go back into it; clearing the cpu's events (loading a
+ * snapshot, d17b_sched_clear) stalls it the same way.
+ */
+void d17b_input(d17b_cpu_t *cpu, d17b_event_kind_t kind, uint8_t index,
+                uint32_t value);
+bool d17b_record_start(d17b_cpu_t *cpu, const char *path);
+bool d17b_record_stop(d17b_cpu_t *cpu);
+bool d17b_replay_start(d17b_cpu_t *cpu, const char *path);
+void d17b_replay_stop(d17b_cpu_t *cpu);
+
+/*
+ * Execution trace. While a trace is on, every instruction the step loop
+ * fetches is written as one record into a single-producer ring, which a
+ * consumer thread drains to 'path'; runs use the step loop for as long
+ * as it is on. When the ring is full D17B_TRACE_BLOCK waits for the
+ * consumer and D17B_TRACE_DROP loses the record, counting it and noting
+ * the gap in the next record written. The ring holds 'records' rounded
+ * up to a power of two (0 for 65536). A D17B_TRACE_RAW file is a
+ * 16-byte header ("D17B" "TRAC", version, record size) and
+ * d17b_trace_rec_t records, in host byte order; D17B_TRACE_PACKED has
+ * the consumer delta-encode them into chunks that decode on their own,
+ * with an index by cycle at the end (see tracefile.c). Stop drains and
+ * closes the file and reports the total dropped. Stop before d17b_init.
+ */
+typedef enum {
+    D17B_TRACE_BLOCK    = 0,        /* Full ring: wait for the consumer */
+    D17B_TRACE_DROP     = 1,        /* Full ring: count and drop */
+} d17b_trace_full_t;
+
+typedef enum {
+    D17B_TRACE_RAW      = 0,        /* Records as they are in memory */
+    D17B_TRACE_PACKED   = 1,        /* Delta-encoded chunks and an index */
+} d17b_trace_format_t;
+
+#define D17B_TRACE_DETECTOR     0x01
+#define D17B_TRACE_ERROR        0x02
+#define D17B_TRACE_D37C         0x04
+#define D17B_TRACE_TIMING       0x08
+
+/* The machine as an instruction is fetched */
+typedef struct {
+    uint64_t cycle;                 /* cycle_count before it */
+    uint32_t I;                     /* Its address, as an I image */
+    uint32_t instr;                 /* The word fetched */
+    uint32_t A;
+    uint32_t L;
+    uint32_t flags;                 /* D17B_TRACE_* */
+    uint32_t dropped;               /* Records lost just before (saturates) */
+} d17b_trace_rec_t;
+
+bool d17b_trace_start(d17b_cpu_t *cpu, const char *path, uint32_t records,
+                      d17b_trace_full_t full, d17b_trace_format_t format);
+bool d17b_trace_stop(d17b_cpu_t *cpu, uint64_t *dropped);
+
+/*
+ * Reading a trace back, raw or packed; none of this needs a cpu. Seek
+ * makes the next record read the first at or after 'cycle', false if
+ * there is none; a packed trace decodes only the chunk that holds it.
+ * A packed trace cut short, with no index, is read up to its last whole
+ * chunk. The index lists the chunks of a packed trace (NULL for raw).
+ */
+typedef struct d17b_trace_reader d17b_trace_reader_t;
+
+typedef struct {
+    uint64_t offset;                /* Of its header in the file */
+    uint64_t first;                 /* Cycle of its first record */
+    uint64_t last;                  /* Cycle of its last record */
+    uint32_t records;
+} d17b_trace_chunk_t;
+
+d17b_trace_reader_t *d17b_trace_open(const char *path);
+void d17b_trace_close(d17b_trace_reader_t *r);
+bool d17b_trace_next(d17b_trace_reader_t *r, d17b_trace_rec_t *rec);
+bool d17b_trace_seek(d17b_trace_reader_t *r, uint64_t cycle);
+const d17b_trace_chunk_t *d17b_trace_index(const d17b_trace_reader_t *r,
+                                           uint32_t *chunks);
+
+/*
+ * Lockstep ensembles: 'count' copies of 'image' held as vector lanes and
+ * run together while their I registers agree. Load and store move one
+ * lane to or from a cpu that has been through d17b_init; read and write
+ * reach single words for perturbing a lane. d17b_ensemble_run runs every
+ * lane for up to max_cycles words or until it halts, untimed and without
+ * events, and returns the total words retired. A packed ensemble keeps
+ * its disc words at 24 bits (3 bytes) each, a quarter less memory for
+ * some unpacking on every access.
+ */
+typedef struct d17b_ensemble d17b_ensemble_t;
+
+d17b_ensemble_t *d17b_ensemble_create(const d17b_cpu_t *image, uint32_t count);
+d17b_ensemble_t *d17b_ensemble_create_packed(const d17b_cpu_t *image,
+                                             uint32_t count);
+void d17b_ensemble_free(d17b_ensemble_t *ens);
+uint32_t d17b_ensemble_count(const d17b_ensemble_t *ens);
+void d17b_ensemble_load(d17b_ensemble_t *ens, uint32_t lane,
+                        const d17b_cpu_t *cpu);
+void d17b_ensemble_store(const d17b_ensemble_t *ens, uint32_t lane,
+                         d17b_cpu_t *cpu);
+uint32_t d17b_ensemble_read(const d17b_ensemble_t *ens, uint32_t lane,
+                            uint8_t channel, uint8_t sector);
+void d17b_ensemble_write(d17b_ensemble_t *ens, uint32_t lane,
+                         uint8_t channel, uint8_t sector, uint32_t value);
+uint64_t d17b_ensemble_run(d17b_ensemble_t *ens, uint64_t max_cycles);
+
+/*
+ * Shared drum images. An image is an immutable copy of a cpu's drum; an
+ * instance is the rest of a machine plus private copies of just the
+ * channels it has written, reading every other channel from its image.
+ * Create captures a cpu's state (and takes its events); attach loads an
+ * instance into a working cpu to run, copying only the channels that
+ * differ from what the cpu holds, and detach saves it back. Instances
+ * are read and written directly without a cpu; write copies the
+ * channel on first use. An image must outlive its instances.
+ */
+typedef struct d17b_image d17b_image_t;
+typedef struct d17b_instance d17b_instance_t;
+
+d17b_image_t *d17b_image_create(const d17b_cpu_t *cpu);
+void d17b_image_free(d17b_image_t *image);
+d17b_instance_t *d17b_instance_create(const d17b_image_t *image,
+                                      d17b_cpu_t *cpu);
+void d17b_instance_free(d17b_instance_t *inst);
+uint32_t d17b_instance_pages(const d17b_instance_t *inst);
+uint32_t d17b_instance_read(const d17b_instance_t *inst, uint8_t channel,
+                            uint8_t sector);
+bool d17b_instance_write(d17b_instance_t *inst, uint8_t channel,
+                         uint8_t sector, uint32_t value);
+void d17b_instance_attach(d17b_cpu_t *cpu, d17b_instance_t *inst);
+bool d17b_instance_detach(d17b_cpu_t *cpu, d17b_instance_t *inst);
+
+/*
+ * Batch runs of independent instances on a work-stealing thread pool.
+ * With a cpus vector each entry is run in place from its initial state
+ * to its final one; with cpus NULL, setup generates instance 'index' on
+ * a freshly initialised cpu that is recycled after finish. setup and
+ * finish run on worker threads; 'worker' (below the returned count)
+ * lets finish reduce into per-worker slots without locking. Each
+ * instance runs up to max_cycles words in slices through d17b_run_until
+ * with the given stop bits.
+ */
+typedef struct {
+    uint32_t threads;               /* 0: one per online processor */
+    uint64_t max_cycles;            /* Budget per instance */
+    uint64_t slice;                 /* Words per time slice, 0: default */
+    unsigned stop;                  /* D17B_STOP_* bits */
+    void (*setup)(d17b_cpu_t *cpu, uint32_t index, void *user);
+    void (*finish)(d17b_cpu_t *cpu, uint32_t index, d17b_exit_t why,
+                   uint32_t worker, void *user);
+    void *user;
+} d17b_batch_t;
+
+/* Returns the number of workers used, or -1 on bad arguments or no memory */
+int d17b_batch_run(d17b_cpu_t *cpus, uint32_t count, const d17b_batch_t *batch);
+
+/* The same over shared-image instances, attached to one cpu per worker */
+int d17b_batch_run_instances(d17b_instance_t *const *instances, uint32_t count,
+                             const d17b_batch_t *batch);
 
 /* Instruction execution */
 void d17b_exec_arithmetic(d17b_cpu_t *cpu, uint32_t instruction);
@@ -223,4 +680,57 @@ void d17b_divide(d17b_cpu_t *cpu, uint32_t divisor);  /* D37C only */
 void d17b_dump_state(d17b_cpu_t *cpu);
 void d17b_disassemble(uint32_t instruction, char *buffer, size_t bufsize);
 
+/*
+ * Operation profile (make PROFILE=1). Every retirement is counted
+ * against its decoded operation - each primary opcode, each shift and
+ * special sub-operation, flagged arithmetic as REFERENCE - with the word
+ * times it was charged, waits included when timing is on. d17b_op_counts
+ * fills 'counts' with the operations that ran, most word times first,
+ * and returns how many; without PROFILE=1 it returns 0.
+ */
+typedef struct {
+    const char *name;
+    uint64_t retired;
+    uint64_t word_times;
+} d17b_op_count_t;
+
+uint32_t d17b_op_counts(const d17b_cpu_t *cpu, d17b_op_count_t *counts,
+                        uint32_t max);
+void d17b_op_counts_clear(d17b_cpu_t *cpu);
+void d17b_dump_op_counts(const d17b_cpu_t *cpu);
+
+/*
+ * Sector heat map (make PROFILE=1): fetches, operand reads and writes
+ * per channel and sector, as addressed. d17b_heat_matrix copies one
+ * kind, or their sum, into 'out' and returns false if not built.
+ * d17b_heat_save writes it as text, a row of SECTORS counts for each of
+ * the CHANNELS channels; d17b_dump_heat draws it on the terminal.
+ */
+bool d17b_heat_matrix(const d17b_cpu_t *cpu, d17b_heat_kind_t kind,
+                      uint64_t out[CHANNELS][SECTORS]);
+bool d17b_heat_save(const d17b_cpu_t *cpu, d17b_heat_kind_t kind,
+                    const char *path);
+void d17b_heat_clear(d17b_cpu_t *cpu);
+void d17b_dump_heat(const d17b_cpu_t *cpu, d17b_heat_kind_t kind);
+
+/*
+ * Rotational latency profile (make PROFILE=1, timing on). Each executed
+ * address is charged the word times its operand took to come under the
+ * head and the word times the instruction it chose next took after
+ * that; with minimum-latency coding both are zero. d17b_latency_worst
+ * ranks addresses by their total wait, worst first, and returns how
+ * many it filled; d17b_dump_latency prints the first 'n' with the
+ * sectors that would have cost no wait.
+ */
+typedef struct {
+    uint8_t channel;
+    uint8_t sector;
+    d17b_latency_t wait;
+} d17b_latency_rank_t;
+
+uint32_t d17b_latency_worst(const d17b_cpu_t *cpu, d17b_latency_rank_t *out,
+                            uint32_t max);
+void d17b_latency_clear(d17b_cpu_t *cpu);
+void d17b_dump_latency(const d17b_cpu_t *cpu, uint32_t n);
+
 #endif /* D17B_H */
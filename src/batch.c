@@ -0,0 +1,369 @@
+/*
+ * D17B Minuteman I Guidance Computer Emulator
+ * Work-stealing batch runner
+ *
+ * d17b_batch_run spreads independent instances over a pool of worker
+ * threads. Each worker owns a deque of tasks: it takes new instances in
+ * small chunks, runs the task at the bottom of its deque for one time
+ * slice and, if the instance has budget left and has not stopped, puts
+ * it back at the bottom. A worker with nothing left to take steals the
+ * oldest task from the top of another worker's deque, so a few long
+ * scenarios never leave the other threads with nothing to do.
+ *
+ * Shared-image instances are attached to a working cpu that belongs to
+ * the worker for each slice and detached after it, so they can move
+ * between workers like any other task.
+ *
+ * Copyright 2025 Zane Hambly - Apache 2.0 License
+ */
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "d17b.h"
+#include "d17b_internal.h"
+
+#define BATCH_SLICE         65536       /* Default words per time slice */
+#define BATCH_MAX_CLAIM     64          /* Most new instances taken at once */
+
+typedef struct {
+    d17b_cpu_t *cpu;                    /* NULL until a generated one starts */
+    uint32_t index;
+    uint64_t left;                      /* Budget remaining */
+    bool started;
+} batch_task_t;
+
+typedef struct batch_pool batch_pool_t;
+
+typedef struct {
+    batch_pool_t *pool;
+    uint32_t id;
+    pthread_t thread;
+
+    /* Deque: the owner works at the bottom, thieves take from the top */
+    pthread_mutex_t lock;
+    batch_task_t *task;
+    uint32_t top;
+    uint32_t size;
+    uint32_t capacity;
+
+    /* Working cpu for shared-image instances */
+    d17b_cpu_t *cpu;
+
+    /* Spare CPUs for generated instances */
+    d17b_cpu_t **spare;
+    uint32_t spares;
+    uint32_t spare_capacity;
+
+    uint64_t rng;
+} batch_worker_t;
+
+struct batch_pool {
+    const d17b_batch_t *batch;
+    d17b_cpu_t *cpus;                   /* NULL: instances come from setup */
+    d17b_instance_t *const *inst;       /* Or attached to a working cpu */
+    uint32_t count;
+    uint32_t claim;                     /* Instances taken per chunk */
+    uint64_t slice;
+
+    uint32_t next;                      /* Next unclaimed index (atomic) */
+    uint32_t unfinished;                /* Instances not yet done (atomic) */
+    bool failed;                        /* Out of memory in a worker */
+
+    batch_worker_t *worker;
+    uint32_t workers;
+};
+
+/* ============================================================================
+ * DEQUES
+ * ============================================================================ */
+
+/* Caller holds w->lock */
+static bool deque_push(batch_worker_t *w, batch_task_t t) {
+    if (w->size == w->capacity) {
+        uint32_t grow = w->capacity ? w->capacity * 2 : 64;
+        batch_task_t *task = malloc(grow * sizeof(*task));
+        if (!task) {
+            return false;
+        }
+        for (uint32_t i = 0; i < w->size; i++) {
+            task[i] = w->task[(w->top + i) % w->capacity];
+        }
+        free(w->task);
+        w->task = task;
+        w->top = 0;
+        w->capacity = grow;
+    }
+    w->task[(w->top + w->size) % w->capacity] = t;
+    w->size++;
+    return true;
+}
+
+static bool pop_bottom(batch_worker_t *w, batch_task_t *t) {
+    bool got = false;
+    pthread_mutex_lock(&w->lock);
+    if (w->size) {
+        w->size--;
+        *t = w->task[(w->top + w->size) % w->capacity];
+        got = true;
+    }
+    pthread_mutex_unlock(&w->lock);
+    return got;
+}
+
+static bool steal_top(batch_worker_t *w, batch_task_t *t) {
+    bool got = false;
+    if (pthread_mutex_trylock(&w->lock) != 0) {
+        return false;                   /* Busy; try someone else */
+    }
+    if (w->size) {
+        *t = w->task[w->top];
+        w->top = (w->top + 1) % w->capacity;
+        w->size--;
+        got = true;
+    }
+    pthread_mutex_unlock(&w->lock);
+    return got;
+}
+
+static bool push_bottom(batch_worker_t *w, batch_task_t t) {
+    pthread_mutex_lock(&w->lock);
+    bool ok = deque_push(w, t);
+    pthread_mutex_unlock(&w->lock);
+    return ok;
+}
+
+/* ============================================================================
+ * WORKERS
+ * ============================================================================ */
+
+/* Take a chunk of new instances onto our own deque */
+static bool claim(batch_worker_t *w) {
+    batch_pool_t *p = w->pool;
+    uint32_t first = __atomic_fetch_add(&p->next, p->claim, __ATOMIC_RELAXED);
+    if (first >= p->count) {
+        return false;
+    }
+
+    uint32_t last = first + p->claim < p->count ? first + p->claim : p->count;
+    pthread_mutex_lock(&w->lock);
+    for (uint32_t i = last; i-- > first; ) {  /* Lowest index at the bottom */
+        batch_task_t t = { p->cpus ? &p->cpus[i] : NULL, i,
+                           p->batch->max_cycles, false };
+        if (!deque_push(w, t)) {
+            __atomic_store_n(&p->failed, true, __ATOMIC_RELAXED);
+            __atomic_fetch_sub(&p->unfinished, 1, __ATOMIC_RELAXED);
+        }
+    }
+    pthread_mutex_unlock(&w->lock);
+    return true;
+}
+
+static bool steal(batch_worker_t *w, batch_task_t *t) {
+    batch_pool_t *p = w->pool;
+
+    w->rng ^= w->rng << 13;
+    w->rng ^= w->rng >> 7;
+    w->rng ^= w->rng << 17;
+
+    uint32_t start = (uint32_t)(w->rng % p->workers);
+    for (uint32_t i = 0; i < p->workers; i++) {
+        batch_worker_t *victim = &p->worker[(start + i) % p->workers];
+        if (victim != w && steal_top(victim, t)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static d17b_cpu_t *cpu_get(batch_worker_t *w) {
+    if (w->spares) {
+        return w->spare[--w->spares];
+    }
+    return malloc(sizeof(d17b_cpu_t));
+}
+
+static void cpu_put(batch_worker_t *w, d17b_cpu_t *cpu) {
+    if (w->spares == w->spare_capacity) {
+        uint32_t grow = w->spare_capacity ? w->spare_capacity * 2 : 4;
+        d17b_cpu_t **spare = realloc(w->spare, grow * sizeof(*spare));
+        if (!spare) {
+            free(cpu);
+            return;
+        }
+        w->spare = spare;
+        w->spare_capacity = grow;
+    }
+    w->spare[w->spares++] = cpu;
+}
+
+/* Run one slice of a task; false once the instance is finished */
+static bool run_slice(batch_worker_t *w, batch_task_t *t) {
+    batch_pool_t *p = w->pool;
+    const d17b_batch_t *b = p->batch;
+    d17b_cpu_t *cpu = t->cpu;
+
+    if (p->inst) {
+        if (!w->cpu) {
+            w->cpu = cpu_get(w);
+            if (!w->cpu) {
+                __atomic_store_n(&p->failed, true, __ATOMIC_RELAXED);
+                return false;
+            }
+            d17b_init(w->cpu);
+        }
+        cpu = w->cpu;
+        d17b_instance_attach(cpu, p->inst[t->index]);
+    } else if (!cpu) {
+        cpu = t->cpu = cpu_get(w);
+        if (!cpu) {
+            __atomic_store_n(&p->failed, true, __ATOMIC_RELAXED);
+            return false;
+        }
+        d17b_init(cpu);
+    }
+
+    if (!t->started) {
+        if (b->setup) {
+            b->setup(cpu, t->index, b->user);
+        }
+        t->started = true;
+    }
+
+    uint64_t n = t->left < p->slice ? t->left : p->slice;
+    uint64_t retired;
+    d17b_exit_t why = d17b_run_until(cpu, n, b->stop, &retired);
+    t->left -= retired < t->left ? retired : t->left;
+
+    bool more = why == D17B_EXIT_BUDGET && t->left > 0;
+    if (!more && b->finish) {
+        b->finish(cpu, t->index, why, w->id, b->user);
+    }
+
+    if (p->inst) {
+        if (!d17b_instance_detach(cpu, p->inst[t->index])) {
+            __atomic_store_n(&p->failed, true, __ATOMIC_RELAXED);
+        }
+    } else if (!more && !p->cpus) {
+        d17b_jit_disable(cpu);
+        d17b_sched_clear(cpu);
+        cpu_put(w, cpu);
+    }
+    return more;
+}
+
+static void *worker_main(void *arg) {
+    batch_worker_t *w = arg;
+    batch_pool_t *p = w->pool;
+    batch_task_t t;
+
+    while (__atomic_load_n(&p->unfinished, __ATOMIC_ACQUIRE) > 0) {
+        if (!pop_bottom(w, &t) && !(claim(w) && pop_bottom(w, &t)) &&
+            !steal(w, &t)) {
+            sched_yield();              /* Others are finishing the last ones */
+            continue;
+        }
+
+        while (run_slice(w, &t)) {
+            /* Back on the deque between slices, where thieves can see it */
+            if (!push_bottom(w, t)) {
+                __atomic_store_n(&p->failed, true, __ATOMIC_RELAXED);
+                break;
+            }
+            if (!pop_bottom(w, &t)) {
+                goto next;              /* Stolen already */
+            }
+        }
+        __atomic_fetch_sub(&p->unfinished, 1, __ATOMIC_RELEASE);
+    next:
+        ;
+    }
+    return NULL;
+}
+
+/* ============================================================================
+ * INTERFACE
+ * ============================================================================ */
+
+static int batch_run(d17b_cpu_t *cpus, d17b_instance_t *const *inst,
+                     uint32_t count, const d17b_batch_t *batch) {
+    batch_pool_t pool;
+    uint32_t threads = batch->threads;
+
+    if (threads == 0) {
+        long online = sysconf(_SC_NPROCESSORS_ONLN);
+        threads = online > 0 ? (uint32_t)online : 1;
+    }
+    if (count == 0) {
+        return (int)threads;
+    }
+
+    memset(&pool, 0, sizeof(pool));
+    pool.batch = batch;
+    pool.cpus = cpus;
+    pool.inst = inst;
+    pool.count = count;
+    pool.unfinished = count;
+    pool.slice = batch->slice ? batch->slice : BATCH_SLICE;
+    pool.claim = count / (threads * 8);
+    pool.claim = pool.claim < 1 ? 1 :
+                 pool.claim > BATCH_MAX_CLAIM ? BATCH_MAX_CLAIM : pool.claim;
+    pool.workers = threads;
+    pool.worker = calloc(threads, sizeof(*pool.worker));
+    if (!pool.worker) {
+        return -1;
+    }
+
+    for (uint32_t i = 0; i < threads; i++) {
+        batch_worker_t *w = &pool.worker[i];
+        w->pool = &pool;
+        w->id = i;
+        w->rng = 0x9E3779B97F4A7C15ULL * (i + 1);
+        pthread_mutex_init(&w->lock, NULL);
+    }
+
+    /* Worker 0 is this thread */
+    uint32_t started = 1;
+    for (uint32_t i = 1; i < threads; i++, started++) {
+        if (pthread_create(&pool.worker[i].thread, NULL, worker_main,
+                           &pool.worker[i]) != 0) {
+            break;
+        }
+    }
+    pool.workers = started;
+    worker_main(&pool.worker[0]);
+
+    for (uint32_t i = 1; i < started; i++) {
+        pthread_join(pool.worker[i].thread, NULL);
+    }
+    for (uint32_t i = 0; i < threads; i++) {
+        batch_worker_t *w = &pool.worker[i];
+        if (w->cpu) {
+            d17b_jit_disable(w->cpu);
+            free(w->cpu);
+        }
+        for (uint32_t j = 0; j < w->spares; j++) {
+            free(w->spare[j]);
+        }
+        free(w->spare);
+        free(w->task);
+        pthread_mutex_destroy(&w->lock);
+    }
+    free(pool.worker);
+
+    return pool.failed ? -1 : (int)started;
+}
+
+int d17b_batch_run(d17b_cpu_t *cpus, uint32_t count, const d17b_batch_t *batch) {
+    if (!cpus && !batch->setup) {
+        return -1;
+    }
+    return batch_run(cpus, NULL, count, batch);
+}
+
+int d17b_batch_run_instances(d17b_instance_t *const *instances, uint32_t count,
+                             const d17b_batch_t *batch) {
+    return batch_run(NULL, instances, count, batch);
+}
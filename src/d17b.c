@@ -6,8 +6,13 @@
  */
 
 #include <stdio.h>
+#include <stddef.h>
+#include <stdlib.h>
 #include <string.h>
 #include "d17b.h"
+#include "d17b_internal.h"
+
+static void flush_decoded(d17b_cpu_t *cpu);
 
 /* ============================================================================
  * INITIALIZATION
@@ -15,7 +20,9 @@
 
 void d17b_init(d17b_cpu_t *cpu) {
     memset(cpu, 0, sizeof(d17b_cpu_t));
+    d17b_map_init(cpu);
     d17b_reset(cpu);
+    cpu->core = D17B_HAVE_THREADED ? D17B_CORE_THREADED : D17B_CORE_STEP;
 }
 
 void d17b_reset(d17b_cpu_t *cpu) {
@@ -38,6 +45,8 @@ void d17b_reset(d17b_cpu_t *cpu) {
     /* Reset disc position */
     cpu->current_sector = 0;
     cpu->cycle_count = 0;
+    cpu->latency_cycles = 0;
+    cpu->idle_cycles = 0;
 
     /* Clear status */
     cpu->halted = false;
@@ -54,82 +63,76 @@ void d17b_reset(d17b_cpu_t *cpu) {
     cpu->detector = false;
     cpu->fine_countdown = 0;
     cpu->countdown_enabled = false;
+    cpu->countdown_base = 0;
+    cpu->io_event = false;
+    d17b_sched_clear(cpu);
+
+    /* Program is about to be (re)loaded - forget decoded words */
+    flush_decoded(cpu);
+#ifdef D17B_PROFILE
+    cpu->latency_next = UINT32_MAX;
+#endif
 }
 
 /* ============================================================================
  * MEMORY ACCESS
  * ============================================================================ */
 
-uint32_t d17b_read(d17b_cpu_t *cpu, uint8_t channel, uint8_t sector) {
-    /* Handle rapid-access loops - these are always accessible */
-    switch (channel) {
-        case CHAN_U_LOOP:  /* 60 octal - U loop (1 word) */
-            return cpu->U;
-
-        case CHAN_L_REG:   /* 64 octal - L register */
-            return cpu->L;
-
-        case CHAN_F_LOOP:  /* 52 octal - F loop (4 words) */
-            return cpu->F[sector & 0x03];
-
-        case CHAN_E_LOOP:  /* 56 octal - E loop (8 words) */
-            return cpu->E[sector & 0x07];
+/* Point one channel at 'length' words starting at word offset 'base' */
+static void map_channel(d17b_cpu_t *cpu, uint8_t channel, uint16_t base,
+                        uint8_t length) {
+    d17b_map_t *m = &cpu->map[channel];
+    m->read = base;
+    m->write = base;
+    m->mask = (uint8_t)(length - 1);
+    m->disc = false;
+}
 
-        case CHAN_H_LOOP:  /* 54 octal - H loop (16 words) */
-            return cpu->H[sector & 0x0F];
+void d17b_map_init(d17b_cpu_t *cpu) {
+    /* Unmapped: reads as zero, writes are discarded */
+    for (int ch = 0; ch < MAP_CHANNELS; ch++) {
+        cpu->map[ch].read = WORD_OFFSET(zero);
+        cpu->map[ch].write = WORD_OFFSET(sink);
+        cpu->map[ch].mask = 0;
+        cpu->map[ch].disc = false;
+    }
 
-        case CHAN_V_LOOP:  /* 70 octal - V loop (4 words) */
-            return cpu->V[sector & 0x03];
+    /* Main disc memory */
+    for (int ch = 0; ch < CHANNELS; ch++) {
+        map_channel(cpu, (uint8_t)ch,
+                    (uint16_t)(WORD_OFFSET(memory) + ch * SECTORS), SECTORS);
+        cpu->map[ch].disc = true;
+    }
 
-        case CHAN_R_LOOP:  /* 72 octal - R loop (4 words) */
-            return cpu->R[sector & 0x03];
+    /* Rapid-access loops; F, H and E take precedence over channels 52-56 */
+    map_channel(cpu, CHAN_U_LOOP, WORD_OFFSET(U), U_LOOP_SIZE);
+    map_channel(cpu, CHAN_L_REG,  WORD_OFFSET(L), L_LOOP_SIZE);
+    map_channel(cpu, CHAN_F_LOOP, WORD_OFFSET(F), F_LOOP_SIZE);
+    map_channel(cpu, CHAN_E_LOOP, WORD_OFFSET(E), E_LOOP_SIZE);
+    map_channel(cpu, CHAN_H_LOOP, WORD_OFFSET(H), H_LOOP_SIZE);
+    map_channel(cpu, CHAN_V_LOOP, WORD_OFFSET(V), V_LOOP_SIZE);
+    map_channel(cpu, CHAN_R_LOOP, WORD_OFFSET(R), R_LOOP_SIZE);
+}
 
-        default:
-            /* Main disc memory - only accessible when sector aligns */
-            if (channel < CHANNELS && sector < SECTORS) {
-                return cpu->memory[channel][sector];
-            }
-            return 0;
-    }
+uint32_t d17b_read(d17b_cpu_t *cpu, uint8_t channel, uint8_t sector) {
+    const d17b_map_t *m = &cpu->map[channel];
+    return CPU_WORD(cpu, m->read + (sector & m->mask));
 }
 
 void d17b_write(d17b_cpu_t *cpu, uint8_t channel, uint8_t sector, uint32_t value) {
-    value &= WORD_MASK;  /* Ensure 24-bit */
-
-    switch (channel) {
-        case CHAN_U_LOOP:
-            cpu->U = value;
-            break;
-
-        case CHAN_L_REG:
-            cpu->L = value;
-            break;
-
-        case CHAN_F_LOOP:
-            cpu->F[sector & 0x03] = value;
-            break;
-
-        case CHAN_E_LOOP:
-            cpu->E[sector & 0x07] = value;
-            break;
-
-        case CHAN_H_LOOP:
-            cpu->H[sector & 0x0F] = value;
-            break;
-
-        case CHAN_V_LOOP:
-            cpu->V[sector & 0x03] = value;
-            break;
-
-        case CHAN_R_LOOP:
-            cpu->R[sector & 0x03] = value;
-            break;
-
-        default:
-            if (channel < CHANNELS && sector < SECTORS) {
-                cpu->memory[channel][sector] = value;
-            }
-            break;
+    const d17b_map_t *m = &cpu->map[channel];
+    sector &= m->mask;
+    CPU_WORD(cpu, m->write + sector) = value & WORD_MASK;  /* Ensure 24-bit */
+
+    if (m->disc) {
+        cpu->dirty[channel][sector >> 6] |= 1ULL << (sector & 63);
+        cpu->decoded[channel][sector].handler = NULL;
+        cpu->decoded[channel][sector].op = DOP_UNDECODED;
+#ifdef D17B_JIT
+        if (cpu->jit) {
+            d17b_jit_invalidate(cpu, channel, sector);
+        }
+#endif
     }
 }
 
@@ -141,50 +144,16 @@ void d17b_write(d17b_cpu_t *cpu, uint8_t channel, uint8_t sector, uint32_t value
  *   Bit 23: Sign (0 = positive, 1 = negative)
  *   Bits 22-0: Magnitude
  *
- * This is NOT two's complement!
+ * This is NOT two's complement! The conversions and split-word helpers
+ * are in d17b_internal.h, where the ensemble lanes can use them too.
  */
 
-static inline int32_t to_signed(uint32_t val) {
-    if (val & SIGN_BIT) {
-        return -(int32_t)(val & MAGNITUDE_MASK);
-    }
-    return (int32_t)(val & MAGNITUDE_MASK);
-}
-
-static inline uint32_t from_signed(int32_t val) {
-    if (val < 0) {
-        return SIGN_BIT | ((-val) & MAGNITUDE_MASK);
-    }
-    return val & MAGNITUDE_MASK;
-}
-
 uint32_t d17b_add_24bit(uint32_t a, uint32_t b) {
-    int32_t sa = to_signed(a);
-    int32_t sb = to_signed(b);
-    int32_t result = sa + sb;
-
-    /* Clamp to 23-bit magnitude range */
-    if (result > (int32_t)MAGNITUDE_MASK) {
-        result = MAGNITUDE_MASK;
-    } else if (result < -(int32_t)MAGNITUDE_MASK) {
-        result = -(int32_t)MAGNITUDE_MASK;
-    }
-
-    return from_signed(result);
+    return saturate_signed(to_signed(a) + to_signed(b));
 }
 
 uint32_t d17b_sub_24bit(uint32_t a, uint32_t b) {
-    int32_t sa = to_signed(a);
-    int32_t sb = to_signed(b);
-    int32_t result = sa - sb;
-
-    if (result > (int32_t)MAGNITUDE_MASK) {
-        result = MAGNITUDE_MASK;
-    } else if (result < -(int32_t)MAGNITUDE_MASK) {
-        result = -(int32_t)MAGNITUDE_MASK;
-    }
-
-    return from_signed(result);
+    return saturate_signed(to_signed(a) - to_signed(b));
 }
 
 uint32_t d17b_complement(uint32_t val) {
@@ -192,33 +161,34 @@ uint32_t d17b_complement(uint32_t val) {
     return val ^ SIGN_BIT;
 }
 
-void d17b_multiply(d17b_cpu_t *cpu, uint32_t operand, bool split) {
+static inline uint32_t split_limit(uint32_t a, uint32_t operand) {
     /*
-     * Multiply: A * operand -> A:L (48-bit result)
-     * Split multiply uses only 10-bit operands
+     * SCL compares split words and limits the result.
+     * If |A_hi| > |operand_hi| then A_hi = sign(A_hi) * |operand_hi|
+     * Same for low halves.
      */
-    int32_t a = to_signed(cpu->A);
-    int32_t b = to_signed(operand);
-
-    if (split) {
-        /* Split word: use only bits 23-14 and 11-2 */
-        a = (a >> 14) & 0x3FF;
-        if (cpu->A & SIGN_BIT) a = -a;
-        b = (b >> 14) & 0x3FF;
-        if (operand & SIGN_BIT) b = -b;
-    }
-
-    int64_t product = (int64_t)a * (int64_t)b;
+    int16_t a_hi = (a >> 12) & 0xFFF;
+    int16_t a_lo = a & 0xFFF;
+    int16_t o_hi = (operand >> 12) & 0xFFF;
+    int16_t o_lo = operand & 0xFFF;
+
+    /* Sign extend 12-bit to 16-bit */
+    if (a_hi & 0x800) a_hi |= 0xF000;
+    if (a_lo & 0x800) a_lo |= 0xF000;
+    if (o_hi & 0x800) o_hi |= 0xF000;
+    if (o_lo & 0x800) o_lo |= 0xF000;
+
+    /* Limit */
+    if (a_hi > o_hi) a_hi = o_hi;
+    if (a_hi < -o_hi) a_hi = -o_hi;
+    if (a_lo > o_lo) a_lo = o_lo;
+    if (a_lo < -o_lo) a_lo = -o_lo;
+
+    return ((a_hi & 0xFFF) << 12) | (a_lo & 0xFFF);
+}
 
-    /* Result goes to A (high) and L (low) */
-    if (product < 0) {
-        product = -product;
-        cpu->A = SIGN_BIT | ((product >> 23) & MAGNITUDE_MASK);
-        cpu->L = product & MAGNITUDE_MASK;
-    } else {
-        cpu->A = (product >> 23) & MAGNITUDE_MASK;
-        cpu->L = product & MAGNITUDE_MASK;
-    }
+void d17b_multiply(d17b_cpu_t *cpu, uint32_t operand, bool split) {
+    multiply_words(cpu->A, operand, split, &cpu->A, &cpu->L);
 }
 
 void d17b_divide(d17b_cpu_t *cpu, uint32_t divisor) {
@@ -301,6 +271,7 @@ void d17b_flag_store(d17b_cpu_t *cpu, uint8_t flag_code, uint32_t operand_sector
 
         case 0x06:  /* Channel 50 (modifiable memory) */
             d17b_write(cpu, 0x28, (operand_sector - 2) & 0x7F, value);
+            PROFILE_HEAT(cpu, D17B_HEAT_WRITE, 0x28, operand_sector - 2);
             break;
 
         case 0x08:  /* E-loop */
@@ -333,6 +304,8 @@ void d17b_exec_arithmetic(d17b_cpu_t *cpu, uint32_t instr) {
     uint8_t channel = GET_CHANNEL(instr);
     uint8_t sector = GET_SECTOR(instr);
     uint32_t operand = d17b_read(cpu, channel, sector);
+    PROFILE_HEAT(cpu, opcode == OP_STO ? D17B_HEAT_WRITE : D17B_HEAT_READ,
+                 channel, sector);
 
     /* Handle flag store if flag bit set */
     if (GET_FLAG(instr)) {
@@ -354,25 +327,11 @@ void d17b_exec_arithmetic(d17b_cpu_t *cpu, uint32_t instr) {
 
         case OP_SAD:  /* 60 - Split Add (operates on halves) */
             /* Split word format: bits 23-14 and 11-2 are two 10-bit values */
-            {
-                uint32_t a_hi = (cpu->A >> 12) & 0xFFF;
-                uint32_t a_lo = cpu->A & 0xFFF;
-                uint32_t o_hi = (operand >> 12) & 0xFFF;
-                uint32_t o_lo = operand & 0xFFF;
-                cpu->A = ((a_hi + o_hi) << 12) | ((a_lo + o_lo) & 0xFFF);
-                cpu->A &= WORD_MASK;
-            }
+            cpu->A = split_add(cpu->A, operand);
             break;
 
         case OP_SSU:  /* 70 - Split Subtract */
-            {
-                uint32_t a_hi = (cpu->A >> 12) & 0xFFF;
-                uint32_t a_lo = cpu->A & 0xFFF;
-                uint32_t o_hi = (operand >> 12) & 0xFFF;
-                uint32_t o_lo = operand & 0xFFF;
-                cpu->A = ((a_hi - o_hi) << 12) | ((a_lo - o_lo) & 0xFFF);
-                cpu->A &= WORD_MASK;
-            }
+            cpu->A = split_sub(cpu->A, operand);
             break;
 
         case OP_MPY:  /* 24 - Multiply */
@@ -415,13 +374,7 @@ void d17b_exec_shift(d17b_cpu_t *cpu, uint32_t instr) {
     switch (sub_op) {
         case 0x08:  /* SAL - Split Accumulator Left */
             /* Shift each 12-bit half separately */
-            {
-                uint32_t hi = (cpu->A >> 12) & 0xFFF;
-                uint32_t lo = cpu->A & 0xFFF;
-                hi = (hi << shift_count) & 0xFFF;
-                lo = (lo << shift_count) & 0xFFF;
-                cpu->A = (hi << 12) | lo;
-            }
+            cpu->A = shift_sal(cpu->A, shift_count);
             break;
 
         case 0x09:  /* ALS - Accumulator Left Shift */
@@ -429,34 +382,21 @@ void d17b_exec_shift(d17b_cpu_t *cpu, uint32_t instr) {
             break;
 
         case 0x0A:  /* SLL - Split Left, Left shift */
-            {
-                uint32_t hi = (cpu->A >> 12) & 0xFFF;
-                hi = (hi << shift_count) & 0xFFF;
-                cpu->A = (hi << 12) | (cpu->A & 0xFFF);
-            }
+            cpu->A = shift_sll(cpu->A, shift_count);
             break;
 
         case 0x0B:  /* ALC (D37C) / SRL (D17B) */
             if (cpu->d37c_mode) {
                 /* ALC - Accumulator Left Cycle (Rotate) */
-                uint32_t val = cpu->A & WORD_MASK;
-                cpu->A = ((val << shift_count) | (val >> (24 - shift_count))) & WORD_MASK;
+                cpu->A = shift_alc(cpu->A, shift_count);
             } else {
                 /* SRL - Split Right, Left shift */
-                uint32_t lo = cpu->A & 0xFFF;
-                lo = (lo << shift_count) & 0xFFF;
-                cpu->A = (cpu->A & 0xFFF000) | lo;
+                cpu->A = shift_srl(cpu->A, shift_count);
             }
             break;
 
         case 0x0C:  /* SAR - Split Accumulator Right */
-            {
-                uint32_t hi = (cpu->A >> 12) & 0xFFF;
-                uint32_t lo = cpu->A & 0xFFF;
-                hi = hi >> shift_count;
-                lo = lo >> shift_count;
-                cpu->A = (hi << 12) | lo;
-            }
+            cpu->A = shift_sar(cpu->A, shift_count);
             break;
 
         case 0x0D:  /* ARS - Accumulator Right Shift */
@@ -464,23 +404,16 @@ void d17b_exec_shift(d17b_cpu_t *cpu, uint32_t instr) {
             break;
 
         case 0x0E:  /* SLR - Split Left, Right shift */
-            {
-                uint32_t hi = (cpu->A >> 12) & 0xFFF;
-                hi = hi >> shift_count;
-                cpu->A = (hi << 12) | (cpu->A & 0xFFF);
-            }
+            cpu->A = shift_slr(cpu->A, shift_count);
             break;
 
         case 0x0F:  /* ARC (D37C) / SRR (D17B) */
             if (cpu->d37c_mode) {
                 /* ARC - Accumulator Right Cycle (Rotate) */
-                uint32_t val = cpu->A & WORD_MASK;
-                cpu->A = ((val >> shift_count) | (val << (24 - shift_count))) & WORD_MASK;
+                cpu->A = shift_arc(cpu->A, shift_count);
             } else {
                 /* SRR - Split Right, Right shift */
-                uint32_t lo = cpu->A & 0xFFF;
-                lo = lo >> shift_count;
-                cpu->A = (cpu->A & 0xFFF000) | lo;
+                cpu->A = shift_srr(cpu->A, shift_count);
             }
             break;
 
@@ -502,32 +435,8 @@ void d17b_exec_control(d17b_cpu_t *cpu, uint32_t instr) {
 
     switch (opcode) {
         case OP_SCL:  /* 04 - Split Compare and Limit */
-            {
-                uint32_t operand = d17b_read(cpu, channel, sector);
-                /*
-                 * SCL compares split words and limits the result.
-                 * If |A_hi| > |operand_hi| then A_hi = sign(A_hi) * |operand_hi|
-                 * Same for low halves.
-                 */
-                int16_t a_hi = (cpu->A >> 12) & 0xFFF;
-                int16_t a_lo = cpu->A & 0xFFF;
-                int16_t o_hi = (operand >> 12) & 0xFFF;
-                int16_t o_lo = operand & 0xFFF;
-
-                /* Sign extend 12-bit to 16-bit */
-                if (a_hi & 0x800) a_hi |= 0xF000;
-                if (a_lo & 0x800) a_lo |= 0xF000;
-                if (o_hi & 0x800) o_hi |= 0xF000;
-                if (o_lo & 0x800) o_lo |= 0xF000;
-
-                /* Limit */
-                if (a_hi > o_hi) a_hi = o_hi;
-                if (a_hi < -o_hi) a_hi = -o_hi;
-                if (a_lo > o_lo) a_lo = o_lo;
-                if (a_lo < -o_lo) a_lo = -o_lo;
-
-                cpu->A = ((a_hi & 0xFFF) << 12) | (a_lo & 0xFFF);
-            }
+            cpu->A = split_limit(cpu->A, d17b_read(cpu, channel, sector));
+            PROFILE_HEAT(cpu, D17B_HEAT_READ, channel, sector);
             break;
 
         default:
@@ -567,10 +476,12 @@ void d17b_exec_special(d17b_cpu_t *cpu, uint32_t instr) {
             break;
 
         case 0x19:  /* EFC - Enable Fine Countdown */
+            d17b_countdown_sync(cpu);
             cpu->countdown_enabled = true;
             break;
 
         case 0x18:  /* HFC - Halt Fine Countdown */
+            d17b_countdown_sync(cpu);
             cpu->countdown_enabled = false;
             break;
 
@@ -590,30 +501,37 @@ void d17b_exec_special(d17b_cpu_t *cpu, uint32_t instr) {
 
         case 0x0B:  /* DOA - Discrete Output A */
             cpu->discrete_out_a = cpu->A;
+            cpu->io_event = true;
             break;
 
         case 0x0C:  /* VOA - Voltage Output A */
             cpu->voltage_out[0] = (int16_t)to_signed(cpu->A >> 15);
+            cpu->io_event = true;
             break;
 
         case 0x0D:  /* VOB - Voltage Output B */
             cpu->voltage_out[1] = (int16_t)to_signed(cpu->A >> 15);
+            cpu->io_event = true;
             break;
 
         case 0x0E:  /* VOC - Voltage Output C */
             cpu->voltage_out[2] = (int16_t)to_signed(cpu->A >> 15);
+            cpu->io_event = true;
             break;
 
         case 0x04:  /* BOA - Binary Output A */
             cpu->binary_out[0] = (cpu->A >> 22) & 0x03;
+            cpu->io_event = true;
             break;
 
         case 0x05:  /* BOB - Binary Output B */
             cpu->binary_out[1] = (cpu->A >> 22) & 0x03;
+            cpu->io_event = true;
             break;
 
         case 0x01:  /* BOC - Binary Output C */
             cpu->binary_out[2] = (cpu->A >> 22) & 0x03;
+            cpu->io_event = true;
             break;
 
         default:
@@ -622,113 +540,627 @@ void d17b_exec_special(d17b_cpu_t *cpu, uint32_t instr) {
 }
 
 /* ============================================================================
- * MAIN EXECUTION LOOP
- * ============================================================================ */
+ * DECODED INSTRUCTION CACHE
+ * ============================================================================
+ *
+ * d17b_decode turns a raw word into a d17b_decoded_t once; after that
+ * d17b_step only looks the entry up and calls its handler. Sub-opcodes of
+ * SHIFT and SPECIAL are resolved here too, so each handler is a single
+ * operation and operands are resolved through cpu->map. Flag stores are
+ * routed to DOP_REFERENCE, which runs the reference executors above.
+ */
 
-int d17b_step(d17b_cpu_t *cpu) {
-    if (cpu->halted) {
-        return -1;
+#define OPERAND(cpu, d)  CPU_WORD(cpu, (d)->operand)
+
+static void h_nop(d17b_cpu_t *cpu, const d17b_decoded_t *d) {
+    cpu->I = d->next;
+}
+
+static void h_reference(d17b_cpu_t *cpu, const d17b_decoded_t *d) {
+    /* The cache entry is valid, so the word at I is the one decoded */
+    uint32_t instr = d17b_read(cpu, GET_CHANNEL(cpu->I), GET_SECTOR(cpu->I));
+    if (GET_OPCODE(instr) == OP_SCL) {
+        d17b_exec_control(cpu, instr);
+    } else {
+        d17b_exec_arithmetic(cpu, instr);
+    }
+    cpu->I = d->next;
+}
+
+static void h_cla(d17b_cpu_t *cpu, const d17b_decoded_t *d) {
+    cpu->A = OPERAND(cpu, d);
+    cpu->I = d->next;
+}
+
+static void h_add(d17b_cpu_t *cpu, const d17b_decoded_t *d) {
+    cpu->A = d17b_add_24bit(cpu->A, OPERAND(cpu, d));
+    cpu->I = d->next;
+}
+
+static void h_sub(d17b_cpu_t *cpu, const d17b_decoded_t *d) {
+    cpu->A = d17b_sub_24bit(cpu->A, OPERAND(cpu, d));
+    cpu->I = d->next;
+}
+
+static void h_sad(d17b_cpu_t *cpu, const d17b_decoded_t *d) {
+    cpu->A = split_add(cpu->A, OPERAND(cpu, d));
+    cpu->I = d->next;
+}
+
+static void h_ssu(d17b_cpu_t *cpu, const d17b_decoded_t *d) {
+    cpu->A = split_sub(cpu->A, OPERAND(cpu, d));
+    cpu->I = d->next;
+}
+
+static void h_mpy(d17b_cpu_t *cpu, const d17b_decoded_t *d) {
+    d17b_multiply(cpu, OPERAND(cpu, d), false);
+    cpu->I = d->next;
+}
+
+static void h_smp(d17b_cpu_t *cpu, const d17b_decoded_t *d) {
+    d17b_multiply(cpu, OPERAND(cpu, d), true);
+    cpu->I = d->next;
+}
+
+static void h_sto(d17b_cpu_t *cpu, const d17b_decoded_t *d) {
+    d17b_write(cpu, GET_CHANNEL(d->target), GET_SECTOR(d->target), cpu->A);
+    cpu->I = d->next;
+}
+
+static void h_scl(d17b_cpu_t *cpu, const d17b_decoded_t *d) {
+    cpu->A = split_limit(cpu->A, OPERAND(cpu, d));
+    cpu->I = d->next;
+}
+
+static void h_tra(d17b_cpu_t *cpu, const d17b_decoded_t *d) {
+    cpu->I = d->target;
+}
+
+static void h_tmi(d17b_cpu_t *cpu, const d17b_decoded_t *d) {
+    cpu->I = (cpu->A & SIGN_BIT) ? d->target : d->next;
+}
+
+#define SHIFT_HANDLER(name, expr) \
+    static void h_##name(d17b_cpu_t *cpu, const d17b_decoded_t *d) { \
+        uint32_t a = cpu->A; unsigned n = d->aux; \
+        cpu->A = (expr); \
+        cpu->I = d->next; \
     }
 
-    /* Fetch instruction from I-register location */
-    uint8_t channel = (cpu->I >> 9) & 0x3F;
-    uint8_t sector = (cpu->I >> 2) & 0x7F;
-    uint32_t instr = d17b_read(cpu, channel, sector);
+SHIFT_HANDLER(sal, shift_sal(a, n))
+SHIFT_HANDLER(als, (a << n) & WORD_MASK)
+SHIFT_HANDLER(sll, shift_sll(a, n))
+SHIFT_HANDLER(sar, shift_sar(a, n))
+SHIFT_HANDLER(ars, a >> n)
+SHIFT_HANDLER(slr, shift_slr(a, n))
+
+#define SPECIAL_HANDLER(name, body) \
+    static void h_##name(d17b_cpu_t *cpu, const d17b_decoded_t *d) { \
+        body; \
+        cpu->I = d->next; \
+    }
 
+SPECIAL_HANDLER(ana, cpu->A &= cpu->L)
+SPECIAL_HANDLER(mim, cpu->A = SIGN_BIT | (cpu->A & MAGNITUDE_MASK))
+SPECIAL_HANDLER(com, cpu->A = d17b_complement(cpu->A))
+SPECIAL_HANDLER(hpr, cpu->halted = true)
+SPECIAL_HANDLER(rsd, cpu->detector = false)
+SPECIAL_HANDLER(efc, d17b_countdown_sync(cpu); cpu->countdown_enabled = true)
+SPECIAL_HANDLER(hfc, d17b_countdown_sync(cpu); cpu->countdown_enabled = false)
+SPECIAL_HANDLER(lpr, cpu->P = d->aux)
+SPECIAL_HANDLER(dia, cpu->A = cpu->discrete_in_a)
+SPECIAL_HANDLER(dib, cpu->A = cpu->discrete_in_b)
+
+/* Outputs also raise io_event for d17b_run_until */
+#define OUTPUT_HANDLER(name, body) SPECIAL_HANDLER(name, body; cpu->io_event = true)
+
+OUTPUT_HANDLER(doa, cpu->discrete_out_a = cpu->A)
+OUTPUT_HANDLER(voa, cpu->voltage_out[0] = (int16_t)to_signed(cpu->A >> 15))
+OUTPUT_HANDLER(vob, cpu->voltage_out[1] = (int16_t)to_signed(cpu->A >> 15))
+OUTPUT_HANDLER(voc, cpu->voltage_out[2] = (int16_t)to_signed(cpu->A >> 15))
+OUTPUT_HANDLER(boa, cpu->binary_out[0] = (cpu->A >> 22) & 0x03)
+OUTPUT_HANDLER(bob, cpu->binary_out[1] = (cpu->A >> 22) & 0x03)
+OUTPUT_HANDLER(boc, cpu->binary_out[2] = (cpu->A >> 22) & 0x03)
+
+/* Look up (decoding on a miss) the entry for the word at channel/sector */
+static inline const d17b_decoded_t *fetch_decoded(d17b_cpu_t *cpu,
+                                                  uint8_t channel,
+                                                  uint8_t sector,
+                                                  d17b_decoded_t *scratch) {
+    if (IS_DISC_CHANNEL(channel)) {
+        d17b_decoded_t *d = &cpu->decoded[channel][sector];
+        if (!d->handler) {
+            d17b_decode(cpu, cpu->memory[channel][sector], channel, d);
+        }
+        return d;
+    }
+
+    /* Executing out of a rapid-access loop - too volatile to cache */
+    d17b_decode(cpu, d17b_read(cpu, channel, sector), channel, scratch);
+    return scratch;
+}
+
+/*
+ * Per-model handlers, handler tables and run loops. d17b_core.inc is
+ * instantiated once per machine so the D17B/D37C differences fold away
+ * at compile time; the dispatch below picks an instantiation once.
+ */
+#define CORE_D37C   0
+#define CORE(name)  name##_d17b
+#include "d17b_core.inc"
+#undef CORE
+#undef CORE_D37C
+
+#define CORE_D37C   1
+#define CORE(name)  name##_d37c
+#include "d17b_core.inc"
+#undef CORE
+#undef CORE_D37C
+
+static uint8_t decode_shift(uint8_t sector) {
+    switch ((sector >> 3) & 0x1F) {
+        case 0x08: return DOP_SAL;
+        case 0x09: return DOP_ALS;
+        case 0x0A: return DOP_SLL;
+        case 0x0B: return DOP_ALC_SRL;
+        case 0x0C: return DOP_SAR;
+        case 0x0D: return DOP_ARS;
+        case 0x0E: return DOP_SLR;
+        case 0x0F: return DOP_ARC_SRR;
+        default:   return DOP_NOP;  /* COA and unassigned slots */
+    }
+}
+
+static uint8_t decode_special(uint8_t sector) {
+    switch ((sector >> 1) & 0x3F) {
+        case 0x10: return DOP_ORA;
+        case 0x11: return DOP_ANA;
+        case 0x12: return DOP_MIM;
+        case 0x13: return DOP_COM;
+        case 0x09: return DOP_HPR;
+        case 0x08: return DOP_RSD;
+        case 0x19: return DOP_EFC;
+        case 0x18: return DOP_HFC;
+        case 0x1E:
+        case 0x1F: return DOP_LPR;
+        case 0x15: return DOP_DIA;
+        case 0x14: return DOP_DIB;
+        case 0x0B: return DOP_DOA;
+        case 0x0C: return DOP_VOA;
+        case 0x0D: return DOP_VOB;
+        case 0x0E: return DOP_VOC;
+        case 0x04: return DOP_BOA;
+        case 0x05: return DOP_BOB;
+        case 0x01: return DOP_BOC;
+        default:   return DOP_NOP;
+    }
+}
+
+void d17b_decode(d17b_cpu_t *cpu, uint32_t instr, uint8_t channel,
+                 d17b_decoded_t *d) {
     uint8_t opcode = GET_OPCODE(instr);
-    uint8_t next_sp = GET_SP(instr);  /* Next sector pointer (low 4 bits) */
-    bool jumped = false;
+    uint8_t sector = GET_SECTOR(instr);
+    uint8_t op;
+
+    d->target = (uint16_t)(instr & 0x7FFC);  /* C and S sit where I keeps them */
+    d->next = (uint16_t)((channel << 9) | (GET_SP(instr) << 2));
+    const d17b_map_t *m = &cpu->map[GET_CHANNEL(instr)];
+    d->operand = (uint16_t)(m->read + (sector & m->mask));
+    d->aux = 0;
 
-    /* Dispatch based on opcode */
     switch (opcode) {
         case OP_SHIFT:
-            d17b_exec_shift(cpu, instr);
+            op = decode_shift(sector);
+            d->aux = (sector & 0x07) ? (sector & 0x07) : 8;
             break;
 
         case OP_SPECIAL:
-            d17b_exec_special(cpu, instr);
+            op = decode_special(sector);
+            d->aux = sector & 0x07;
             break;
 
-        case OP_TRA:
-            /* TRA sets I directly */
-            {
-                uint8_t target_ch = GET_CHANNEL(instr);
-                uint8_t target_sec = GET_SECTOR(instr);
-                cpu->I = (target_ch << 9) | (target_sec << 2);
-                jumped = true;
+        case OP_TRA:      op = DOP_TRA;     break;
+        case OP_TMI_TZE:  op = DOP_TMI_TZE; break;
+        case OP_TMI:      op = DOP_TMI;     break;
+
+        case OP_SCL:
+            op = DOP_SCL;
+            break;
+
+        default:
+            /* Operand-reading group, see d17b_exec_arithmetic */
+            switch (opcode) {
+                case OP_CLA:     op = DOP_CLA;     break;
+                case OP_ADD:     op = DOP_ADD;     break;
+                case OP_SUB:     op = DOP_SUB;     break;
+                case OP_SAD:     op = DOP_SAD;     break;
+                case OP_SSU:     op = DOP_SSU;     break;
+                case OP_MPY:     op = DOP_MPY;     break;
+                case OP_SMP:     op = DOP_SMP;     break;
+                case OP_DIV_MPM: op = DOP_DIV_MPM; break;
+                case OP_STO:     op = DOP_STO;     break;
+                default:         op = DOP_NOP;     break;
+            }
+            if (GET_FLAG(instr)) {
+                op = DOP_REFERENCE;
             }
             break;
+    }
+
+    d->op = op;
+    d->handler = cpu->d37c_mode ? handlers_d37c[op] : handlers_d17b[op];
+}
+
+static void flush_decoded(d17b_cpu_t *cpu) {
+    memset(cpu->decoded, 0, sizeof(cpu->decoded));
+    cpu->decoded_d37c = cpu->d37c_mode;
+#ifdef D17B_JIT
+    if (cpu->jit) {
+        d17b_jit_flush(cpu);
+    }
+#endif
+}
+
+/* After direct pokes: any word may have changed, so the next delta has them all */
+void d17b_flush_decode(d17b_cpu_t *cpu) {
+    flush_decoded(cpu);
+    memset(cpu->dirty, 0xFF, sizeof(cpu->dirty));
+}
+
+/* ============================================================================
+ * MAIN EXECUTION LOOP
+ * ============================================================================ */
+
+/* Decoded handlers are bound to one model; re-decode if it was switched */
+static inline void sync_model(d17b_cpu_t *cpu) {
+    if (cpu->decoded_d37c != cpu->d37c_mode) {
+        flush_decoded(cpu);
+    }
+}
+
+int d17b_step(d17b_cpu_t *cpu) {
+    int result;
 
-        case OP_TMI_TZE:  /* Opcode 10: TZE (D37C) / TMI (D17B) */
+    sync_model(cpu);
+    if (cpu->timing) {
+        result = cpu->d37c_mode ? step_timed_d37c(cpu) : step_timed_d17b(cpu);
+    } else {
+        result = cpu->d37c_mode ? step_d37c(cpu) : step_d17b(cpu);
+    }
+
+    d17b_sched_advance(cpu);
+    return result;
+}
+
+/* Core for one run; timing, tracing and exact breakpoints need the step loop */
+static d17b_core_t run_core(const d17b_cpu_t *cpu, unsigned stop) {
+    if (cpu->timing || cpu->trace || D17B_PROFILING ||
+        ((stop & D17B_STOP_BREAKPOINT) && cpu->breakpoint_count)) {
+        return D17B_CORE_STEP;
+    }
+    if (cpu->core == D17B_CORE_JIT && !cpu->jit) {
+        return D17B_CORE_STEP;
+    }
+    return (d17b_core_t)cpu->core;
+}
+
+/* One call into a core; it returns early only for a stop reason */
+static void run_chunk(d17b_cpu_t *cpu, unsigned stop, uint64_t chunk) {
+    switch (run_core(cpu, stop)) {
+#ifdef D17B_JIT
+        case D17B_CORE_JIT:
+            d17b_jit_run(cpu, chunk);
+            break;
+#endif
+#if D17B_HAVE_THREADED
+        case D17B_CORE_THREADED:
             if (cpu->d37c_mode) {
-                /* TZE - Transfer on Zero: jump if A == 0 */
-                if ((cpu->A & MAGNITUDE_MASK) == 0) {
-                    uint8_t target_ch = GET_CHANNEL(instr);
-                    uint8_t target_sec = GET_SECTOR(instr);
-                    cpu->I = (target_ch << 9) | (target_sec << 2);
-                    jumped = true;
-                }
+                run_threaded_d37c(cpu, chunk);
             } else {
-                /* TMI - Transfer on Minus: jump if A < 0 */
-                if (cpu->A & SIGN_BIT) {
-                    uint8_t target_ch = GET_CHANNEL(instr);
-                    uint8_t target_sec = GET_SECTOR(instr);
-                    cpu->I = (target_ch << 9) | (target_sec << 2);
-                    jumped = true;
-                }
+                run_threaded_d17b(cpu, chunk);
             }
             break;
-
-        case OP_TMI:  /* Opcode 30: TMI - Transfer on Minus (both modes) */
-            if (cpu->A & SIGN_BIT) {
-                uint8_t target_ch = GET_CHANNEL(instr);
-                uint8_t target_sec = GET_SECTOR(instr);
-                cpu->I = (target_ch << 9) | (target_sec << 2);
-                jumped = true;
+#endif
+        default:
+            if (cpu->timing) {
+                if (cpu->d37c_mode) {
+                    run_timed_d37c(cpu, chunk);
+                } else {
+                    run_timed_d17b(cpu, chunk);
+                }
+            } else if (cpu->d37c_mode) {
+                run_step_d37c(cpu, chunk);
+            } else {
+                run_step_d17b(cpu, chunk);
             }
             break;
+    }
+}
 
-        case OP_SCL:
-            d17b_exec_control(cpu, instr);
-            break;
+/* ============================================================================
+ * IDLE FAST-FORWARD
+ * ============================================================================ */
 
-        default:
-            d17b_exec_arithmetic(cpu, instr);
-            break;
+#define IDLE_PROBE_WORDS    64      /* Longest polling loop looked for */
+#define IDLE_SLICE          4096    /* Words run between probes */
+
+/* Registers A through R, compared as one block */
+#define IDLE_REGS           offsetof(d17b_cpu_t, zero)
+
+/* Operations a polling loop may not contain: outputs, halts, countdown */
+static inline bool idle_safe(uint8_t op) {
+    return op != DOP_REFERENCE && op != DOP_HPR && !DOP_NEEDS_TIME(op) &&
+           !(op >= DOP_DOA && op <= DOP_BOC);
+}
+
+#ifdef D17B_PROFILE
+/*
+ * What the profile held for the addresses an iteration touches, so the
+ * skipped iterations can be credited with what it added. Each word
+ * touches its own latency entry and the one before it.
+ */
+typedef struct {
+    uint64_t op_retired[DOP_COUNT];
+    uint64_t op_words[DOP_COUNT];
+    uint32_t n;
+    uint32_t at[2 * IDLE_PROBE_WORDS];
+    d17b_latency_t was[2 * IDLE_PROBE_WORDS];
+} idle_profile_t;
+
+static void idle_profile_mark(idle_profile_t *p, const d17b_cpu_t *cpu) {
+    memcpy(p->op_retired, cpu->op_retired, sizeof(p->op_retired));
+    memcpy(p->op_words, cpu->op_word_times, sizeof(p->op_words));
+    p->n = 0;
+}
+
+static void idle_profile_note(idle_profile_t *p, const d17b_cpu_t *cpu,
+                              uint32_t at) {
+    if (GET_CHANNEL(at) >= CHANNELS) {
+        return;
     }
+    for (uint32_t i = 0; i < p->n; i++) {
+        if (p->at[i] == at) {
+            return;
+        }
+    }
+    p->at[p->n] = at;
+    p->was[p->n++] = cpu->latency[GET_CHANNEL(at)][GET_SECTOR(at)];
+}
 
-    /* Advance to next instruction if we didn't jump */
-    if (!jumped) {
-        /*
-         * The Sp field (4 bits) specifies the low 4 bits of the next sector.
-         * For simplicity, we just use Sp directly as the next sector.
-         * A full emulator would wait for disc rotation to match.
-         */
-        cpu->I = (channel << 9) | (next_sp << 2);
+static void idle_profile_repeat(const idle_profile_t *p, d17b_cpu_t *cpu,
+                                uint64_t loops) {
+    for (int op = 0; op < DOP_COUNT; op++) {
+        cpu->op_retired[op] += loops * (cpu->op_retired[op] - p->op_retired[op]);
+        cpu->op_word_times[op] += loops * (cpu->op_word_times[op] - p->op_words[op]);
     }
+    for (uint32_t i = 0; i < p->n; i++) {
+        d17b_latency_t *l = &cpu->latency[GET_CHANNEL(p->at[i])]
+                                         [GET_SECTOR(p->at[i])];
+        l->executed += loops * (l->executed - p->was[i].executed);
+        l->operand_wait += loops * (l->operand_wait - p->was[i].operand_wait);
+        l->next_wait += loops * (l->next_wait - p->was[i].next_wait);
+    }
+}
+#endif
 
-    /* Advance disc position */
-    cpu->current_sector = (cpu->current_sector + 1) & 0x7F;
-    cpu->cycle_count++;
+/* Let n word times pass without executing anything */
+static void idle_advance(d17b_cpu_t *cpu, uint64_t n) {
+    cpu->current_sector = (uint32_t)(cpu->current_sector + n) & 0x7F;
+    cpu->cycle_count += n;
+    cpu->idle_cycles += n;
+}
 
-    /* Update fine countdown if enabled */
-    if (cpu->countdown_enabled && cpu->fine_countdown > 0) {
-        cpu->fine_countdown--;
+/*
+ * Probe for a polling loop at I. Step up to IDLE_PROBE_WORDS words; each
+ * time I comes back round, compare the registers, detector and error
+ * flag (and with timing on, the disc position) with the last time round.
+ * Nothing else can change them before the next event, so a match means
+ * every further iteration is identical: skip as many whole ones as fit
+ * in 'limit' word times. A store must write back what was there. The
+ * profile is credited with the skipped iterations; a trace cannot be,
+ * so nothing is skipped while one is on.
+ */
+static void idle_skip(d17b_cpu_t *cpu, uint64_t limit) {
+    if (cpu->trace) {
+        return;
     }
 
-    return 0;
+    unsigned char regs[IDLE_REGS];
+    uint64_t start = cpu->cycle_count;
+    uint64_t mark = start, waited = cpu->latency_cycles;
+    uint32_t head = cpu->I, sector = cpu->current_sector;
+    bool detector = cpu->detector, error = cpu->error;
+    bool repeats = false;
+
+    memcpy(regs, cpu, IDLE_REGS);
+#ifdef D17B_PROFILE
+    idle_profile_t profile;
+    idle_profile_mark(&profile, cpu);
+#endif
+
+    for (int n = 0; n < IDLE_PROBE_WORDS && !repeats; n++) {
+        if (cpu->halted || cpu->cycle_count - start >= limit) {
+            return;
+        }
+
+        d17b_decoded_t scratch;
+        const d17b_decoded_t *d = fetch_decoded(cpu, GET_CHANNEL(cpu->I),
+                                                GET_SECTOR(cpu->I), &scratch);
+        if (!idle_safe(d->op)) {
+            return;
+        }
+#ifdef D17B_PROFILE
+        idle_profile_note(&profile, cpu, cpu->I & I_ADDRESS_MASK);
+        if (cpu->latency_next != UINT32_MAX) {
+            idle_profile_note(&profile, cpu, cpu->latency_from);
+        }
+#endif
+
+        if (d->op == DOP_STO) {
+            uint8_t ch = GET_CHANNEL(d->target), sec = GET_SECTOR(d->target);
+            uint32_t old = d17b_read(cpu, ch, sec);
+            d17b_step(cpu);
+            if (d17b_read(cpu, ch, sec) != old) {
+                return;
+            }
+        } else {
+            d17b_step(cpu);
+        }
+
+        if (cpu->I != head) {
+            continue;
+        }
+        repeats = memcmp(regs, cpu, IDLE_REGS) == 0 &&
+                  cpu->detector == detector && cpu->error == error &&
+                  (!cpu->timing || cpu->current_sector == sector);
+
+        /* Changed on the way round: see if the next time round repeats */
+        if (!repeats) {
+            memcpy(regs, cpu, IDLE_REGS);
+            mark = cpu->cycle_count;
+            waited = cpu->latency_cycles;
+            sector = cpu->current_sector;
+            detector = cpu->detector;
+            error = cpu->error;
+#ifdef D17B_PROFILE
+            idle_profile_mark(&profile, cpu);
+#endif
+        }
+    }
+
+    if (!repeats || cpu->cycle_count - start >= limit) {
+        return;
+    }
+
+    uint64_t period = cpu->cycle_count - mark;
+    uint64_t loops = (limit - (cpu->cycle_count - start)) / period;
+    cpu->latency_cycles += loops * (cpu->latency_cycles - waited);
+#ifdef D17B_PROFILE
+    idle_profile_repeat(&profile, cpu, loops);
+#endif
+    idle_advance(cpu, loops * period);
 }
 
 int d17b_run(d17b_cpu_t *cpu, uint64_t max_cycles) {
+    d17b_run_until(cpu, max_cycles, 0, NULL);
+    return cpu->halted ? -1 : 0;
+}
+
+d17b_exit_t d17b_run_until(d17b_cpu_t *cpu, uint64_t max_cycles,
+                           unsigned stop, uint64_t *retired) {
     uint64_t start = cpu->cycle_count;
+    d17b_exit_t reason;
 
-    while (!cpu->halted && (cpu->cycle_count - start) < max_cycles) {
-        if (d17b_step(cpu) < 0) {
+    sync_model(cpu);
+    cpu->run_stop = (uint8_t)stop;
+    cpu->io_event = false;
+
+    /*
+     * Run in chunks that end where the next event is due, applying events
+     * between chunks. With nothing scheduled and fast_forward off this is
+     * one call into a core.
+     */
+    bool idle = cpu->fast_forward &&
+                !((stop & D17B_STOP_BREAKPOINT) && cpu->breakpoint_count);
+    bool probed = false;
+
+    for (;;) {
+        uint64_t used = cpu->cycle_count - start;
+        uint64_t chunk = max_cycles - used;
+        uint64_t before = cpu->cycle_count;
+
+        d17b_sched_advance(cpu);
+
+        if (cpu->halted) {
+            uint64_t due = d17b_sched_next(cpu);
+            if (idle && due != UINT64_MAX && used < max_cycles) {
+                /* Halt and proceed: wait for the next event */
+                idle_advance(cpu, due - before < chunk ? due - before : chunk);
+                continue;
+            }
+            reason = D17B_EXIT_HALT;
+            break;
+        }
+        if ((stop & D17B_STOP_ERROR) && cpu->error) {
+            reason = D17B_EXIT_ERROR;
+            break;
+        }
+        if (used >= max_cycles) {
+            reason = D17B_EXIT_BUDGET;
+            break;
+        }
+        /* The core skips its first word, so check chunk boundaries here */
+        if (used && (stop & D17B_STOP_BREAKPOINT) && cpu->breakpoint_count &&
+            d17b_at_breakpoint(cpu)) {
+            reason = D17B_EXIT_BREAKPOINT;
             break;
         }
+
+        uint64_t due = d17b_sched_next(cpu);
+        if (due - before < chunk) {
+            chunk = due - before;
+        }
+
+        /* Fast-forward probes between slices of ordinary running */
+        if (idle) {
+            if (!probed) {
+                idle_skip(cpu, chunk);
+                probed = true;
+                continue;
+            }
+            probed = false;
+            if (chunk > IDLE_SLICE) {
+                chunk = IDLE_SLICE;
+            }
+        }
+
+        run_chunk(cpu, stop, chunk);
+
+        if (cpu->halted) {
+            if (idle) {
+                continue;           /* Wait for an event to proceed */
+            }
+            reason = D17B_EXIT_HALT;
+        } else if ((stop & D17B_STOP_ERROR) && cpu->error) {
+            reason = D17B_EXIT_ERROR;
+        } else if ((stop & D17B_STOP_IO) && cpu->io_event) {
+            reason = D17B_EXIT_IO;
+        } else if (cpu->cycle_count - before < chunk) {
+            reason = D17B_EXIT_BREAKPOINT;
+        } else {
+            continue;
+        }
+        d17b_sched_advance(cpu);
+        break;
     }
 
-    return cpu->halted ? -1 : 0;
+    cpu->run_stop = 0;
+    if (retired) {
+        *retired = cpu->cycle_count - start;
+    }
+    return reason;
+}
+
+void d17b_set_breakpoint(d17b_cpu_t *cpu, uint8_t channel, uint8_t sector,
+                         bool enable) {
+    if (channel >= CHANNELS || sector >= SECTORS) {
+        return;
+    }
+
+    uint64_t bit = 1ULL << (sector & 63);
+    uint64_t *word = &cpu->breakpoints[channel][sector >> 6];
+    if (enable && !(*word & bit)) {
+        *word |= bit;
+        cpu->breakpoint_count++;
+    } else if (!enable && (*word & bit)) {
+        *word &= ~bit;
+        cpu->breakpoint_count--;
+    }
+}
+
+void d17b_clear_breakpoints(d17b_cpu_t *cpu) {
+    memset(cpu->breakpoints, 0, sizeof(cpu->breakpoints));
+    cpu->breakpoint_count = 0;
 }
 
 /* ============================================================================
@@ -744,6 +1176,11 @@ void d17b_dump_state(d17b_cpu_t *cpu) {
     printf("P:  %d\n", cpu->P);
     printf("U:  %08o\n", cpu->U);
     printf("Cycles: %llu\n", (unsigned long long)cpu->cycle_count);
+    if (cpu->timing) {
+        printf("Time:   %.3f ms (%llu word times waiting)\n",
+               cpu->cycle_count * WORD_TIME_US / 1000.0,
+               (unsigned long long)cpu->latency_cycles);
+    }
     printf("Halted: %s\n", cpu->halted ? "YES" : "NO");
     printf("\nF-loop: ");
     for (int i = 0; i < F_LOOP_SIZE; i++) printf("%08o ", cpu->F[i]);
@@ -754,6 +1191,329 @@ void d17b_dump_state(d17b_cpu_t *cpu) {
     printf("...\n");
 }
 
+/* ============================================================================
+ * OPERATION PROFILE
+ * ============================================================================ */
+
+#ifdef D17B_PROFILE
+typedef char profile_ops_fit[DOP_COUNT <= D17B_PROFILE_OPS ? 1 : -1];
+
+#define DOP_NAME(name, fn) #name,
+static const char *const dop_names[DOP_COUNT] = {
+    "UNDECODED",
+    DOP_LIST(DOP_NAME)
+};
+#undef DOP_NAME
+
+/* Most word times first */
+static int op_count_order(const void *a, const void *b) {
+    const d17b_op_count_t *x = a, *y = b;
+    if (x->word_times != y->word_times) {
+        return x->word_times < y->word_times ? 1 : -1;
+    }
+    return x->retired < y->retired ? 1 : x->retired > y->retired ? -1 : 0;
+}
+#endif
+
+uint32_t d17b_op_counts(const d17b_cpu_t *cpu, d17b_op_count_t *counts,
+                        uint32_t max) {
+    uint32_t n = 0;
+#ifdef D17B_PROFILE
+    for (uint32_t op = 0; op < DOP_COUNT && n < max; op++) {
+        if (cpu->op_retired[op]) {
+            counts[n].name = dop_names[op];
+            counts[n].retired = cpu->op_retired[op];
+            counts[n].word_times = cpu->op_word_times[op];
+            n++;
+        }
+    }
+    qsort(counts, n, sizeof(*counts), op_count_order);
+#else
+    (void)cpu;
+    (void)counts;
+    (void)max;
+#endif
+    return n;
+}
+
+void d17b_op_counts_clear(d17b_cpu_t *cpu) {
+#ifdef D17B_PROFILE
+    memset(cpu->op_retired, 0, sizeof(cpu->op_retired));
+    memset(cpu->op_word_times, 0, sizeof(cpu->op_word_times));
+#else
+    (void)cpu;
+#endif
+}
+
+void d17b_dump_op_counts(const d17b_cpu_t *cpu) {
+    d17b_op_count_t counts[DOP_COUNT];
+    uint32_t n = d17b_op_counts(cpu, counts, DOP_COUNT);
+    if (!D17B_PROFILING) {
+        printf("Operation profile not built (make PROFILE=1)\n");
+        return;
+    }
+
+    uint64_t retired = 0, words = 0;
+    for (uint32_t i = 0; i < n; i++) {
+        retired += counts[i].retired;
+        words += counts[i].word_times;
+    }
+    printf("%-10s %14s %7s %14s %7s %6s\n",
+           "Operation", "Retired", "%", "Word times", "%", "Avg");
+    for (uint32_t i = 0; i < n; i++) {
+        printf("%-10s %14llu %6.2f%% %14llu %6.2f%% %6.2f\n", counts[i].name,
+               (unsigned long long)counts[i].retired,
+               100.0 * counts[i].retired / retired,
+               (unsigned long long)counts[i].word_times,
+               100.0 * counts[i].word_times / words,
+               (double)counts[i].word_times / counts[i].retired);
+    }
+    printf("%-10s %14llu %7s %14llu\n", "Total",
+           (unsigned long long)retired, "",
+           (unsigned long long)words);
+}
+
+/* ============================================================================
+ * SECTOR HEAT MAP
+ * ============================================================================ */
+
+#define HEAT_SHADES     " .:-=+*#%@"
+
+bool d17b_heat_matrix(const d17b_cpu_t *cpu, d17b_heat_kind_t kind,
+                      uint64_t out[CHANNELS][SECTORS]) {
+#ifdef D17B_PROFILE
+    for (int ch = 0; ch < CHANNELS; ch++) {
+        for (int sec = 0; sec < SECTORS; sec++) {
+            out[ch][sec] = kind == D17B_HEAT_ALL
+                ? cpu->heat[D17B_HEAT_FETCH][ch][sec] +
+                  cpu->heat[D17B_HEAT_READ][ch][sec] +
+                  cpu->heat[D17B_HEAT_WRITE][ch][sec]
+                : cpu->heat[kind][ch][sec];
+        }
+    }
+    return true;
+#else
+    (void)cpu;
+    (void)kind;
+    (void)out;
+    return false;
+#endif
+}
+
+bool d17b_heat_save(const d17b_cpu_t *cpu, d17b_heat_kind_t kind,
+                    const char *path) {
+    uint64_t heat[CHANNELS][SECTORS];
+    if (!d17b_heat_matrix(cpu, kind, heat)) {
+        return false;
+    }
+
+    FILE *f = fopen(path, "w");
+    if (!f) {
+        return false;
+    }
+    for (int ch = 0; ch < CHANNELS; ch++) {
+        for (int sec = 0; sec < SECTORS; sec++) {
+            fprintf(f, sec ? " %llu" : "%llu", (unsigned long long)heat[ch][sec]);
+        }
+        fputc('\n', f);
+    }
+    bool ok = !ferror(f);
+    return fclose(f) == 0 && ok;
+}
+
+void d17b_heat_clear(d17b_cpu_t *cpu) {
+#ifdef D17B_PROFILE
+    memset(cpu->heat, 0, sizeof(cpu->heat));
+#else
+    (void)cpu;
+#endif
+}
+
+/*
+ * One row per channel, one column per pair of sectors. Shades step by
+ * powers of two down from the hottest cell, so a loop run a million
+ * times and a table read once both show.
+ */
+void d17b_dump_heat(const d17b_cpu_t *cpu, d17b_heat_kind_t kind) {
+    uint64_t heat[CHANNELS][SECTORS];
+    if (!d17b_heat_matrix(cpu, kind, heat)) {
+        printf("Heat map not built (make PROFILE=1)\n");
+        return;
+    }
+
+    uint64_t max = 0;
+    for (int ch = 0; ch < CHANNELS; ch++) {
+        for (int sec = 0; sec < SECTORS; sec++) {
+            if (heat[ch][sec] > max) {
+                max = heat[ch][sec];
+            }
+        }
+    }
+
+    const int shades = (int)sizeof(HEAT_SHADES) - 2;
+    int top = 0;
+    while (top < 63 && (max >> (top + 1))) {
+        top++;
+    }
+
+    printf("CH  ");
+    for (int sec = 0; sec < SECTORS; sec += 16) {
+        printf("%-8.3o", sec);
+    }
+    printf("\n");
+    for (int ch = 0; ch < CHANNELS; ch++) {
+        char row[SECTORS / 2 + 1];
+        for (int col = 0; col < SECTORS / 2; col++) {
+            uint64_t v = heat[ch][2 * col] > heat[ch][2 * col + 1]
+                       ? heat[ch][2 * col] : heat[ch][2 * col + 1];
+            int shade = 0;
+            if (v) {
+                int bits = 0;
+                while (bits < 63 && (v >> (bits + 1))) {
+                    bits++;
+                }
+                shade = shades - (top - bits);
+                if (shade < 1) {
+                    shade = 1;
+                }
+            }
+            row[col] = HEAT_SHADES[shade];
+        }
+        row[SECTORS / 2] = '\0';
+        printf("%02o  %s\n", ch, row);
+    }
+    printf("Hottest sector %llu, each shade half the one above\n",
+           (unsigned long long)max);
+}
+
+/* ============================================================================
+ * ROTATIONAL LATENCY
+ * ============================================================================ */
+
+#ifdef D17B_PROFILE
+/* Most word times waiting first */
+static int latency_order(const void *a, const void *b) {
+    const d17b_latency_rank_t *x = a, *y = b;
+    uint64_t wx = x->wait.operand_wait + x->wait.next_wait;
+    uint64_t wy = y->wait.operand_wait + y->wait.next_wait;
+    if (wx != wy) {
+        return wx < wy ? 1 : -1;
+    }
+    return x->wait.executed < y->wait.executed ? 1 :
+           x->wait.executed > y->wait.executed ? -1 : 0;
+}
+#endif
+
+uint32_t d17b_latency_worst(const d17b_cpu_t *cpu, d17b_latency_rank_t *out,
+                            uint32_t max) {
+    uint32_t n = 0;
+#ifdef D17B_PROFILE
+    d17b_latency_rank_t *all = malloc(CHANNELS * SECTORS * sizeof(*all));
+    if (!all) {
+        return 0;
+    }
+    for (int ch = 0; ch < CHANNELS; ch++) {
+        for (int sec = 0; sec < SECTORS; sec++) {
+            if (cpu->latency[ch][sec].executed) {
+                all[n].channel = (uint8_t)ch;
+                all[n].sector = (uint8_t)sec;
+                all[n].wait = cpu->latency[ch][sec];
+                n++;
+            }
+        }
+    }
+    qsort(all, n, sizeof(*all), latency_order);
+    if (n > max) {
+        n = max;
+    }
+    memcpy(out, all, n * sizeof(*out));
+    free(all);
+#else
+    (void)cpu;
+    (void)out;
+    (void)max;
+#endif
+    return n;
+}
+
+void d17b_latency_clear(d17b_cpu_t *cpu) {
+#ifdef D17B_PROFILE
+    memset(cpu->latency, 0, sizeof(cpu->latency));
+    cpu->latency_next = UINT32_MAX;
+#else
+    (void)cpu;
+#endif
+}
+
+/*
+ * The worst n addresses. The ideal places the operand in the sector
+ * after the instruction and the next instruction in the sector after
+ * that (after the instruction, for one without an operand): with the
+ * operand where it is, "next" is where the following word should go.
+ */
+void d17b_dump_latency(const d17b_cpu_t *cpu, uint32_t n) {
+#ifdef D17B_PROFILE
+    uint64_t waited = 0, executed = 0;
+    for (int ch = 0; ch < CHANNELS; ch++) {
+        for (int sec = 0; sec < SECTORS; sec++) {
+            waited += cpu->latency[ch][sec].operand_wait +
+                      cpu->latency[ch][sec].next_wait;
+            executed += cpu->latency[ch][sec].executed;
+        }
+    }
+    if (!executed) {
+        printf("No timed instructions (timing is off or nothing ran)\n");
+        return;
+    }
+
+    d17b_latency_rank_t *worst = malloc((n ? n : 1) * sizeof(*worst));
+    if (!worst) {
+        return;
+    }
+    uint32_t count = d17b_latency_worst(cpu, worst, n);
+
+    printf("%-7s %-12s %10s %12s %12s %6s %6s %7s %5s\n", "Address",
+           "Instruction", "Executed", "Operand", "Next", "Avg", "Share",
+           "Ideal S", "next");
+    for (uint32_t i = 0; i < count; i++) {
+        const d17b_latency_rank_t *r = &worst[i];
+        const d17b_map_t *m = &cpu->map[r->channel];
+        uint32_t instr = CPU_WORD(cpu, m->read + (r->sector & m->mask));
+        uint64_t total = r->wait.operand_wait + r->wait.next_wait;
+        char text[32], best_s[8] = "-", best_next[8] = "-";
+        d17b_disassemble(instr, text, sizeof(text));
+
+        /* Only words the decode cache still holds are known to have run */
+        const d17b_decoded_t *d = &cpu->decoded[r->channel][r->sector];
+        if (d->handler) {
+            uint32_t pos = r->sector + 1u;
+            if (DOP_HAS_OPERAND(d->op)) {
+                const d17b_map_t *o = &cpu->map[GET_CHANNEL(d->target)];
+                snprintf(best_s, sizeof(best_s), "%03o", pos & o->mask);
+                pos += ((GET_SECTOR(d->target) - pos) & o->mask) + 1;
+            }
+            snprintf(best_next, sizeof(best_next), "%03o", pos & 0x7F);
+        }
+
+        printf("%02o:%03o  %-12s %10llu %12llu %12llu %6.1f %5.1f%% %7s %5s\n",
+               r->channel, r->sector, text,
+               (unsigned long long)r->wait.executed,
+               (unsigned long long)r->wait.operand_wait,
+               (unsigned long long)r->wait.next_wait,
+               (double)total / r->wait.executed,
+               waited ? 100.0 * total / waited : 0.0, best_s, best_next);
+    }
+    printf("%llu word times waiting over %llu instructions, %.2f per instruction; ideal 0\n",
+           (unsigned long long)waited, (unsigned long long)executed,
+           (double)waited / executed);
+    free(worst);
+#else
+    (void)cpu;
+    (void)n;
+    printf("Latency profile not built (make PROFILE=1)\n");
+#endif
+}
+
 static const char* opcode_names[] = {
     "SHIFT", "SCL", "TMI", "???", "SMP", "MPY", "TMI", "MPM",
     "SPEC", "CLA", "TRA", "STO", "SAD", "ADD", "SSU", "SUB"
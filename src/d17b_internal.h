@@ -0,0 +1,345 @@
+/*
+ * D17B Minuteman I Guidance Computer Emulator
+ * Internal definitions shared by the execution cores
+ *
+ * Copyright 2025 Zane Hambly - Apache 2.0 License
+ */
+
+#ifndef D17B_INTERNAL_H
+#define D17B_INTERNAL_H
+
+#include <stddef.h>
+#include <stdio.h>
+#include "d17b.h"
+
+/* Channels backed by cpu->memory (the F, H and E loops shadow 52/54/56) */
+#define DISC_CHANNEL_MASK \
+    (((1ULL << CHANNELS) - 1) & ~((1ULL << CHAN_F_LOOP) | \
+                                  (1ULL << CHAN_H_LOOP) | \
+                                  (1ULL << CHAN_E_LOOP)))
+#define IS_DISC_CHANNEL(ch)  ((DISC_CHANNEL_MASK >> (ch)) & 1)
+
+/* Word offsets into d17b_cpu_t, used for pre-resolved operands */
+#define WORD_OFFSET(field)   ((uint16_t)(offsetof(d17b_cpu_t, field) / sizeof(uint32_t)))
+#define CPU_WORD(cpu, off)   (((uint32_t *)(cpu))[off])
+
+/*
+ * Sign-magnitude and split-word arithmetic, shared by the reference
+ * executors, the decoded handlers and the ensemble lanes. Bit 23 is the
+ * sign, bits 22-0 the magnitude; this is NOT two's complement.
+ */
+static inline int32_t to_signed(uint32_t val) {
+    if (val & SIGN_BIT) {
+        return -(int32_t)(val & MAGNITUDE_MASK);
+    }
+    return (int32_t)(val & MAGNITUDE_MASK);
+}
+
+static inline uint32_t from_signed(int32_t val) {
+    if (val < 0) {
+        return SIGN_BIT | ((-val) & MAGNITUDE_MASK);
+    }
+    return val & MAGNITUDE_MASK;
+}
+
+/* Clamp a sum or difference to the 23-bit magnitude range */
+static inline uint32_t saturate_signed(int32_t result) {
+    if (result > (int32_t)MAGNITUDE_MASK) {
+        result = MAGNITUDE_MASK;
+    } else if (result < -(int32_t)MAGNITUDE_MASK) {
+        result = -(int32_t)MAGNITUDE_MASK;
+    }
+    return from_signed(result);
+}
+
+/* The two 12-bit halves are handled independently */
+static inline uint32_t split_add(uint32_t a, uint32_t b) {
+    uint32_t hi = ((a >> 12) & 0xFFF) + ((b >> 12) & 0xFFF);
+    uint32_t lo = (a & 0xFFF) + (b & 0xFFF);
+    return ((hi << 12) | (lo & 0xFFF)) & WORD_MASK;
+}
+
+static inline uint32_t split_sub(uint32_t a, uint32_t b) {
+    uint32_t hi = ((a >> 12) & 0xFFF) - ((b >> 12) & 0xFFF);
+    uint32_t lo = (a & 0xFFF) - (b & 0xFFF);
+    return ((hi << 12) | (lo & 0xFFF)) & WORD_MASK;
+}
+
+/*
+ * Shift bodies. The split forms treat A as two 12-bit halves; the cycle
+ * forms are D37C rotates that reuse the D17B SRL/SRR slots.
+ */
+static inline uint32_t shift_sal(uint32_t a, unsigned n) {
+    uint32_t hi = (((a >> 12) & 0xFFF) << n) & 0xFFF;
+    uint32_t lo = ((a & 0xFFF) << n) & 0xFFF;
+    return (hi << 12) | lo;
+}
+
+static inline uint32_t shift_sll(uint32_t a, unsigned n) {
+    uint32_t hi = (((a >> 12) & 0xFFF) << n) & 0xFFF;
+    return (hi << 12) | (a & 0xFFF);
+}
+
+static inline uint32_t shift_srl(uint32_t a, unsigned n) {
+    uint32_t lo = ((a & 0xFFF) << n) & 0xFFF;
+    return (a & 0xFFF000) | lo;
+}
+
+static inline uint32_t shift_sar(uint32_t a, unsigned n) {
+    uint32_t hi = ((a >> 12) & 0xFFF) >> n;
+    uint32_t lo = (a & 0xFFF) >> n;
+    return (hi << 12) | lo;
+}
+
+static inline uint32_t shift_slr(uint32_t a, unsigned n) {
+    uint32_t hi = ((a >> 12) & 0xFFF) >> n;
+    return (hi << 12) | (a & 0xFFF);
+}
+
+static inline uint32_t shift_srr(uint32_t a, unsigned n) {
+    uint32_t lo = (a & 0xFFF) >> n;
+    return (a & 0xFFF000) | lo;
+}
+
+static inline uint32_t shift_alc(uint32_t a, unsigned n) {
+    uint32_t val = a & WORD_MASK;
+    return ((val << n) | (val >> (24 - n))) & WORD_MASK;
+}
+
+static inline uint32_t shift_arc(uint32_t a, unsigned n) {
+    uint32_t val = a & WORD_MASK;
+    return ((val >> n) | (val << (24 - n))) & WORD_MASK;
+}
+
+/*
+ * Multiply: a * operand -> hi:lo (48-bit result). Split multiply uses
+ * only the 10-bit fields in bits 23-14 and 11-2.
+ */
+static inline void multiply_words(uint32_t a_word, uint32_t operand, bool split,
+                                  uint32_t *hi, uint32_t *lo) {
+    int32_t a = to_signed(a_word);
+    int32_t b = to_signed(operand);
+
+    if (split) {
+        a = (a >> 14) & 0x3FF;
+        if (a_word & SIGN_BIT) a = -a;
+        b = (b >> 14) & 0x3FF;
+        if (operand & SIGN_BIT) b = -b;
+    }
+
+    int64_t product = (int64_t)a * (int64_t)b;
+
+    if (product < 0) {
+        product = -product;
+        *hi = SIGN_BIT | ((product >> 23) & MAGNITUDE_MASK);
+    } else {
+        *hi = (product >> 23) & MAGNITUDE_MASK;
+    }
+    *lo = product & MAGNITUDE_MASK;
+}
+
+/* Decoded operations: X(enum suffix, handler suffix) */
+#define DOP_LIST(X) \
+    X(NOP, nop)             X(REFERENCE, reference) \
+    X(CLA, cla)             X(ADD, add)             X(SUB, sub) \
+    X(SAD, sad)             X(SSU, ssu)             X(MPY, mpy) \
+    X(SMP, smp)             X(DIV_MPM, div_mpm)     X(STO, sto) \
+    X(SCL, scl) \
+    X(TRA, tra)             X(TMI_TZE, tmi_tze)     X(TMI, tmi) \
+    X(SAL, sal)             X(ALS, als)             X(SLL, sll) \
+    X(ALC_SRL, alc_srl)     X(SAR, sar)             X(ARS, ars) \
+    X(SLR, slr)             X(ARC_SRR, arc_srr) \
+    X(ORA, ora)             X(ANA, ana)             X(MIM, mim) \
+    X(COM, com)             X(HPR, hpr)             X(RSD, rsd) \
+    X(EFC, efc)             X(HFC, hfc)             X(LPR, lpr) \
+    X(DIA, dia)             X(DIB, dib)             X(DOA, doa) \
+    X(VOA, voa)             X(VOB, vob)             X(VOC, voc) \
+    X(BOA, boa)             X(BOB, bob)             X(BOC, boc)
+
+#define DOP_ENUM(name, fn) DOP_##name,
+enum {
+    DOP_UNDECODED = 0,
+    DOP_LIST(DOP_ENUM)
+    DOP_COUNT
+};
+#undef DOP_ENUM
+
+/*
+ * Per-operation and per-sector counters, compiled in by D17B_PROFILE.
+ * Runs then go through the step loop, the only place they are kept;
+ * without it the step loop has no trace of them. PROFILE_ACCESS counts
+ * the fetch at C,S and the operand access of a decoded instruction;
+ * flagged arithmetic (REFERENCE) counts its own in d17b_exec_*.
+ * PROFILE_WAITS, in the timed step only, charges the wait for this word
+ * to the instruction that chose it and the operand wait to this one.
+ */
+#ifdef D17B_PROFILE
+#define D17B_PROFILING  1
+#define PROFILE_OP(cpu, op, words) \
+    do { (cpu)->op_retired[op]++; (cpu)->op_word_times[op] += (words); } while (0)
+#define PROFILE_HEAT(cpu, kind, channel, sector) \
+    do { \
+        if ((channel) < CHANNELS) { \
+            (cpu)->heat[kind][channel][(sector) & 0x7F]++; \
+        } \
+    } while (0)
+#define PROFILE_WAITS(cpu, channel, sector, fetch_wait, operand_wait) \
+    d17b_profile_waits(cpu, channel, sector, fetch_wait, operand_wait)
+#define PROFILE_ACCESS(cpu, d, channel, sector) \
+    do { \
+        PROFILE_HEAT(cpu, D17B_HEAT_FETCH, channel, sector); \
+        if (DOP_HAS_OPERAND((d)->op) && (d)->op != DOP_REFERENCE) { \
+            PROFILE_HEAT(cpu, (d)->op == DOP_STO ? D17B_HEAT_WRITE \
+                                                 : D17B_HEAT_READ, \
+                         GET_CHANNEL((d)->target), GET_SECTOR((d)->target)); \
+        } \
+    } while (0)
+#else
+#define D17B_PROFILING  0
+#define PROFILE_OP(cpu, op, words) ((void)0)
+#define PROFILE_HEAT(cpu, kind, channel, sector) ((void)0)
+#define PROFILE_WAITS(cpu, channel, sector, fetch_wait, operand_wait) ((void)0)
+#define PROFILE_ACCESS(cpu, d, channel, sector) ((void)0)
+#endif
+
+#ifdef D17B_PROFILE
+#define I_ADDRESS_MASK  ((0x3Fu << 9) | (0x7Fu << 2))   /* C,S bits of I */
+
+static inline void d17b_profile_waits(d17b_cpu_t *cpu, uint8_t channel,
+                                      uint8_t sector, uint32_t fetch_wait,
+                                      uint32_t operand_wait) {
+    uint32_t at = ((uint32_t)channel << 9) | ((uint32_t)sector << 2);
+    if (cpu->latency_next == at) {
+        cpu->latency[GET_CHANNEL(cpu->latency_from)]
+                    [GET_SECTOR(cpu->latency_from)].next_wait += fetch_wait;
+    }
+    if (channel < CHANNELS) {
+        cpu->latency[channel][sector].executed++;
+        cpu->latency[channel][sector].operand_wait += operand_wait;
+        cpu->latency_from = at;
+        cpu->latency_next = cpu->I & I_ADDRESS_MASK;
+    } else {
+        cpu->latency_next = UINT32_MAX;
+    }
+}
+#endif
+
+/*
+ * Trace ring. The step loop is the only producer and the drain thread
+ * in trace.c the only consumer; each publishes its position with a
+ * release store and reads the other's with an acquire load, and the
+ * producer only looks at the consumer's position when the ring seems
+ * full. The consumer's file and thread live in 'io'.
+ */
+struct d17b_trace {
+    d17b_trace_rec_t *ring;
+    uint64_t mask;                      /* Records - 1 */
+    uint64_t head;                      /* Next record to fill */
+    uint64_t tail_seen;                 /* tail when the producer last looked */
+    uint64_t dropped;
+    uint32_t gap;                       /* Dropped since the last record */
+    uint8_t full;                       /* d17b_trace_full_t */
+    uint8_t pad[64];                    /* Keep tail off the producer's line */
+    uint64_t tail;                      /* Next record to write out */
+    struct d17b_trace_io *io;
+};
+
+bool d17b_trace_wait(struct d17b_trace *t);
+
+/* Packed trace writer, in tracefile.c; the drain thread feeds it */
+typedef struct d17b_packer d17b_packer_t;
+
+d17b_packer_t *d17b_pack_open(FILE *f);
+void d17b_pack_put(d17b_packer_t *p, const d17b_trace_rec_t *r);
+bool d17b_pack_close(d17b_packer_t *p);
+
+/* Write the record for the instruction about to run from C,S */
+static inline void d17b_trace_fetch(d17b_cpu_t *cpu, uint8_t channel,
+                                    uint8_t sector) {
+    struct d17b_trace *t = cpu->trace;
+    uint64_t head = t->head;
+    if (head - t->tail_seen > t->mask) {
+        t->tail_seen = __atomic_load_n(&t->tail, __ATOMIC_ACQUIRE);
+        if (head - t->tail_seen > t->mask && !d17b_trace_wait(t)) {
+            return;
+        }
+    }
+
+    /* The flags are bools, so they pack without branches */
+    d17b_trace_rec_t *r = &t->ring[head & t->mask];
+    r->cycle = cpu->cycle_count;
+    r->I = ((uint32_t)channel << 9) | ((uint32_t)sector << 2);
+    r->instr = d17b_read(cpu, channel, sector);
+    r->A = cpu->A;
+    r->L = cpu->L;
+    r->flags = (uint32_t)cpu->detector | (uint32_t)cpu->error << 1 |
+               (uint32_t)cpu->d37c_mode << 2 | (uint32_t)cpu->timing << 3;
+    r->dropped = t->gap;
+    t->gap = 0;
+    __atomic_store_n(&t->head, head + 1, __ATOMIC_RELEASE);
+}
+
+/* Operations that read or write their C,S operand */
+#define DOP_HAS_OPERAND(op)  ((op) >= DOP_REFERENCE && (op) <= DOP_SCL)
+
+/* Operations after which a run checks d17b_stop_pending */
+#define DOP_IS_EVENT(op) \
+    ((op) == DOP_HPR || (op) == DOP_REFERENCE || (op) == DOP_DIV_MPM || \
+     ((op) >= DOP_DOA && (op) <= DOP_BOC))
+
+/* I/O or error stop requested by d17b_run_until and now due */
+static inline bool d17b_stop_pending(const d17b_cpu_t *cpu) {
+    return ((cpu->run_stop & D17B_STOP_IO) && cpu->io_event) ||
+           ((cpu->run_stop & D17B_STOP_ERROR) && cpu->error);
+}
+
+/* I is at a breakpoint (disc words only) */
+static inline bool d17b_at_breakpoint(const d17b_cpu_t *cpu) {
+    uint8_t ch = GET_CHANNEL(cpu->I);
+    uint8_t sec = GET_SECTOR(cpu->I);
+    return ch < CHANNELS && ((cpu->breakpoints[ch][sec >> 6] >> (sec & 63)) & 1);
+}
+
+/* Operations that need cycle_count to be current when they execute */
+#define DOP_NEEDS_TIME(op)   ((op) == DOP_EFC || (op) == DOP_HFC)
+
+/* Bring fine_countdown up to cycle_count */
+static inline void d17b_countdown_sync(d17b_cpu_t *cpu) {
+    if (cpu->countdown_enabled) {
+        uint64_t ran = cpu->cycle_count - cpu->countdown_base;
+        cpu->fine_countdown = ran < cpu->fine_countdown
+                            ? cpu->fine_countdown - (uint32_t)ran : 0;
+    }
+    cpu->countdown_base = cpu->cycle_count;
+}
+
+/* Event scheduler hooks (sched.c) */
+uint64_t d17b_sched_next(const d17b_cpu_t *cpu);
+void d17b_sched_advance(d17b_cpu_t *cpu);
+void d17b_sched_free(struct d17b_sched *s);
+struct d17b_sched *d17b_sched_clone(const struct d17b_sched *s);
+void d17b_apply_event(d17b_cpu_t *cpu, const d17b_event_t *ev);
+
+/* Input log hook (replay.c), called for every input applied */
+void d17b_record_input(d17b_cpu_t *cpu, const d17b_event_t *ev);
+
+/* Drop logged inputs later than cycle_count, after going back to it */
+void d17b_record_rewind(d17b_cpu_t *cpu);
+
+/* How far a replay has read, so a history checkpoint can go back to it */
+typedef struct {
+    uintptr_t generation;               /* 0: no replay */
+    long offset;                        /* Of the next entry to apply */
+} d17b_replay_pos_t;
+
+d17b_replay_pos_t d17b_replay_tell(const d17b_cpu_t *cpu);
+void d17b_replay_seek(d17b_cpu_t *cpu, d17b_replay_pos_t pos);
+
+/* Basic-block JIT hooks (jit_x86.c) */
+#ifdef D17B_JIT
+int d17b_jit_run(d17b_cpu_t *cpu, uint64_t max_cycles);
+void d17b_jit_invalidate(d17b_cpu_t *cpu, uint8_t channel, uint8_t sector);
+void d17b_jit_flush(d17b_cpu_t *cpu);
+#endif
+
+#endif /* D17B_INTERNAL_H */
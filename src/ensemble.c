@@ -0,0 +1,627 @@
+/*
+ * D17B Minuteman I Guidance Computer Emulator
+ * Lockstep ensemble engine
+ *
+ * An ensemble is many copies of one machine run side by side, typically
+ * one drum image under perturbed initial conditions. State is kept as a
+ * structure of arrays: every 32-bit word of d17b_cpu_t up to the end of
+ * the disc becomes a row of ENS_LANES values, one per lane, so cpu->map
+ * offsets index rows directly. Lanes whose I registers agree execute one
+ * decoded instruction as a loop across the row, which the compiler turns
+ * into vector code: 8 lanes to a 256-bit AVX2 register, 16 with AVX-512
+ * (make SIMD=avx2 or SIMD=avx512; plain SSE2 does 4 at a time).
+ *
+ * Lanes that split at a TMI/TZE stay in their group under a lane mask.
+ * Each step runs the instruction at the I of the lane furthest behind
+ * for every lane at that I, so the paths interleave and the lanes run
+ * as one again wherever they meet. Operations with no lane form here
+ * (I/O, divide, SCL and the like) run the scalar handler one lane at a
+ * time on a scratch cpu holding that lane's registers.
+ *
+ * Packed ensembles keep the disc rows at 3 bytes a word, four words to
+ * each 96-bit group, and unpack a row only when an instruction reads it.
+ * The registers and loops stay as plain rows.
+ *
+ * Ensembles run untimed and take no scheduled events.
+ *
+ * Copyright 2025 Zane Hambly - Apache 2.0 License
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "d17b.h"
+#include "d17b_internal.h"
+
+/*
+ * Lanes per vector register, and per group: four registers' worth, so
+ * decode and dispatch are paid once for every 32 or 64 lanes.
+ */
+#if defined(__AVX512F__)
+#define ENS_VECTOR  16
+#else
+#define ENS_VECTOR  8
+#endif
+#define ENS_LANES   (4 * ENS_VECTOR)
+
+#define ENS_ROWS    WORD_OFFSET(current_sector)     /* Registers .. memory */
+#define ENS_REGS    WORD_OFFSET(zero)               /* A through R */
+#define ENS_HOT     WORD_OFFSET(memory)             /* Rows never packed */
+
+#define ROW_A       WORD_OFFSET(A)
+#define ROW_L       WORD_OFFSET(L)
+#define ROW_I       WORD_OFFSET(I)
+
+#define LANES(l)    for (int l = 0; l < ENS_LANES; l++)
+
+typedef uint32_t ens_row_t[ENS_LANES];
+typedef uint32_t ens_packed_t[3 * ENS_LANES / 4];  /* A row at 24 bits a word */
+
+/* Per-lane state outside the rows; only the scalar fallback touches it */
+typedef struct {
+    bool error;
+    bool detector;
+    bool countdown_enabled;
+    uint32_t fine_countdown;
+    uint64_t countdown_base;
+    uint32_t discrete_in_a;
+    uint32_t discrete_in_b;
+    uint32_t discrete_out_a;
+    int16_t voltage_out[4];
+    uint8_t binary_out[4];
+} ens_cold_t;
+
+/*
+ * A group of lanes. During a run, cycles and sector hold the values at
+ * the start and ran counts the words each lane has executed since, so
+ * the step loop only keeps 32-bit counters.
+ */
+typedef struct {
+    ens_row_t *row;                     /* ENS_ROWS rows, or ENS_HOT if packed */
+    ens_packed_t *packed;               /* Disc rows of a packed ensemble */
+    uint64_t cycles[ENS_LANES];
+    uint32_t sector[ENS_LANES];
+    uint32_t ran[ENS_LANES];
+    uint32_t halted[ENS_LANES];         /* All ones if halted or unused */
+    ens_cold_t cold[ENS_LANES];
+} ens_group_t;
+
+typedef struct {
+    d17b_decoded_t d;
+    uint32_t word;                      /* Instruction the entry decodes */
+    bool valid;
+} ens_decoded_t;
+
+struct d17b_ensemble {
+    uint32_t count;
+    uint32_t groups;
+    bool packed;
+    ens_group_t *group;
+    d17b_cpu_t *scratch;                /* Map, decoder, scalar fallback */
+    ens_decoded_t decoded[1 << 6][SECTORS];
+};
+
+/* ============================================================================
+ * ROW STORAGE
+ * ============================================================================ */
+
+/*
+ * Packed rows hold four 24-bit words in three 32-bit words. Unpacking is
+ * shifts and ors on whole groups, which vectorise like the lane loops.
+ */
+static inline void unpack_row(const uint32_t *p, uint32_t *w) {
+    for (int q = 0; q < ENS_LANES / 4; q++) {
+        uint32_t a = p[3 * q], b = p[3 * q + 1], c = p[3 * q + 2];
+        w[4 * q]     = a & WORD_MASK;
+        w[4 * q + 1] = ((a >> 24) | (b << 8)) & WORD_MASK;
+        w[4 * q + 2] = ((b >> 16) | (c << 16)) & WORD_MASK;
+        w[4 * q + 3] = c >> 8;
+    }
+}
+
+static inline void pack_row(const uint32_t *w, uint32_t *p) {
+    for (int q = 0; q < ENS_LANES / 4; q++) {
+        uint32_t w0 = w[4 * q] & WORD_MASK, w1 = w[4 * q + 1] & WORD_MASK;
+        uint32_t w2 = w[4 * q + 2] & WORD_MASK, w3 = w[4 * q + 3] & WORD_MASK;
+        p[3 * q]     = w0 | (w1 << 24);
+        p[3 * q + 1] = (w1 >> 8) | (w2 << 16);
+        p[3 * q + 2] = (w2 >> 16) | (w3 << 8);
+    }
+}
+
+/* Row r, unpacked into buf if it is packed */
+static inline uint32_t *row_get(const d17b_ensemble_t *ens, const ens_group_t *g,
+                                unsigned r, uint32_t *buf) {
+    if (!ens->packed || r < ENS_HOT) {
+        return g->row[r];
+    }
+    unpack_row(g->packed[r - ENS_HOT], buf);
+    return buf;
+}
+
+/* Write back a row changed through row_get */
+static inline void row_put(const d17b_ensemble_t *ens, ens_group_t *g,
+                           unsigned r, const uint32_t *w) {
+    if (ens->packed && r >= ENS_HOT) {
+        pack_row(w, g->packed[r - ENS_HOT]);
+    }
+}
+
+/* One lane of row r */
+static inline uint32_t lane_get(const d17b_ensemble_t *ens, const ens_group_t *g,
+                                unsigned r, int l) {
+    if (!ens->packed || r < ENS_HOT) {
+        return g->row[r][l];
+    }
+    const uint32_t *p = &g->packed[r - ENS_HOT][3 * (l / 4)];
+    switch (l % 4) {
+        case 0:  return p[0] & WORD_MASK;
+        case 1:  return ((p[0] >> 24) | (p[1] << 8)) & WORD_MASK;
+        case 2:  return ((p[1] >> 16) | (p[2] << 16)) & WORD_MASK;
+        default: return p[2] >> 8;
+    }
+}
+
+static inline void lane_set(const d17b_ensemble_t *ens, ens_group_t *g,
+                            unsigned r, int l, uint32_t v) {
+    if (!ens->packed || r < ENS_HOT) {
+        g->row[r][l] = v;
+        return;
+    }
+    uint32_t *p = &g->packed[r - ENS_HOT][3 * (l / 4)];
+    v &= WORD_MASK;
+    switch (l % 4) {
+        case 0:
+            p[0] = (p[0] & 0xFF000000u) | v;
+            break;
+        case 1:
+            p[0] = (p[0] & WORD_MASK) | (v << 24);
+            p[1] = (p[1] & 0xFFFF0000u) | (v >> 8);
+            break;
+        case 2:
+            p[1] = (p[1] & 0x0000FFFFu) | (v << 16);
+            p[2] = (p[2] & 0xFFFFFF00u) | (v >> 16);
+            break;
+        default:
+            p[2] = (p[2] & 0x000000FFu) | (v << 8);
+            break;
+    }
+}
+
+/* ============================================================================
+ * LANE TRANSFER
+ * ============================================================================ */
+
+static void lane_to_cpu(const d17b_ensemble_t *ens, const ens_group_t *g,
+                        int l, d17b_cpu_t *cpu, unsigned rows) {
+    const ens_cold_t *c = &g->cold[l];
+
+    for (unsigned r = 0; r < rows; r++) {
+        CPU_WORD(cpu, r) = lane_get(ens, g, r, l);
+    }
+    cpu->cycle_count = g->cycles[l] + g->ran[l];
+    cpu->current_sector = (g->sector[l] + g->ran[l]) & 0x7F;
+    cpu->halted = g->halted[l] != 0;
+
+    cpu->error = c->error;
+    cpu->detector = c->detector;
+    cpu->countdown_enabled = c->countdown_enabled;
+    cpu->fine_countdown = c->fine_countdown;
+    cpu->countdown_base = c->countdown_base;
+    cpu->discrete_in_a = c->discrete_in_a;
+    cpu->discrete_in_b = c->discrete_in_b;
+    cpu->discrete_out_a = c->discrete_out_a;
+    memcpy(cpu->voltage_out, c->voltage_out, sizeof(c->voltage_out));
+    memcpy(cpu->binary_out, c->binary_out, sizeof(c->binary_out));
+}
+
+static void cpu_to_lane(const d17b_ensemble_t *ens, const d17b_cpu_t *cpu,
+                        ens_group_t *g, int l, unsigned rows) {
+    const uint32_t *word = (const uint32_t *)cpu;
+    ens_cold_t *c = &g->cold[l];
+
+    for (unsigned r = 0; r < rows; r++) {
+        lane_set(ens, g, r, l, word[r]);
+    }
+    g->cycles[l] = cpu->cycle_count - g->ran[l];
+    g->sector[l] = (cpu->current_sector - g->ran[l]) & 0x7F;
+    g->halted[l] = cpu->halted ? ~0u : 0;
+
+    c->error = cpu->error;
+    c->detector = cpu->detector;
+    c->countdown_enabled = cpu->countdown_enabled;
+    c->fine_countdown = cpu->fine_countdown;
+    c->countdown_base = cpu->countdown_base;
+    c->discrete_in_a = cpu->discrete_in_a;
+    c->discrete_in_b = cpu->discrete_in_b;
+    c->discrete_out_a = cpu->discrete_out_a;
+    memcpy(c->voltage_out, cpu->voltage_out, sizeof(c->voltage_out));
+    memcpy(c->binary_out, cpu->binary_out, sizeof(c->binary_out));
+}
+
+/* Row a channel/sector reads from or writes to, as d17b_read/write */
+static inline unsigned read_row(const d17b_ensemble_t *ens, uint16_t at) {
+    const d17b_map_t *m = &ens->scratch->map[GET_CHANNEL(at)];
+    return m->read + (GET_SECTOR(at) & m->mask);
+}
+
+static inline unsigned write_row(const d17b_ensemble_t *ens, uint16_t at) {
+    const d17b_map_t *m = &ens->scratch->map[GET_CHANNEL(at)];
+    return m->write + (GET_SECTOR(at) & m->mask);
+}
+
+/* ============================================================================
+ * LANE EXECUTION
+ * ============================================================================ */
+
+static inline uint32_t sel(uint32_t mask, uint32_t a, uint32_t b) {
+    return (a & mask) | (b & ~mask);
+}
+
+static const d17b_decoded_t *ens_decode(d17b_ensemble_t *ens, uint32_t I,
+                                        uint32_t word) {
+    ens_decoded_t *e = &ens->decoded[GET_CHANNEL(I)][GET_SECTOR(I)];
+    if (!e->valid || e->word != word) {
+        d17b_decode(ens->scratch, word, GET_CHANNEL(I), &e->d);
+        e->word = word;
+        e->valid = true;
+    }
+    return &e->d;
+}
+
+/*
+ * Run the scalar handler for each masked lane in turn. Decoded handlers
+ * touch the registers and their own operand word; REFERENCE forms go
+ * back to the reference executors, which may address anything, so they
+ * get the whole lane.
+ */
+static void exec_scalar(d17b_ensemble_t *ens, ens_group_t *g,
+                        const d17b_decoded_t *d, const uint32_t *mask) {
+    d17b_cpu_t *cpu = ens->scratch;
+    unsigned rd = read_row(ens, d->target), wr = write_row(ens, d->target);
+    unsigned rows = d->op == DOP_REFERENCE ? ENS_ROWS : ENS_REGS;
+
+    LANES(l) {
+        if (!mask[l]) {
+            continue;
+        }
+        lane_to_cpu(ens, g, l, cpu, rows);
+        CPU_WORD(cpu, rd) = lane_get(ens, g, rd, l);
+        CPU_WORD(cpu, wr) = lane_get(ens, g, wr, l);
+
+        d->handler(cpu, d);
+
+        cpu_to_lane(ens, cpu, g, l, rows);
+        lane_set(ens, g, wr, l, CPU_WORD(cpu, wr));
+    }
+}
+
+/* One decoded instruction across every lane in the mask */
+static void exec_lanes(d17b_ensemble_t *ens, ens_group_t *g,
+                       const d17b_decoded_t *d, const uint32_t *mask) {
+    uint32_t *A = g->row[ROW_A];
+    uint32_t *L = g->row[ROW_L];
+    uint32_t *I = g->row[ROW_I];
+    uint32_t buf[ENS_LANES];
+    const uint32_t *op = row_get(ens, g, d->operand, buf);
+    uint32_t next = d->next, target = d->target;
+    unsigned n = d->aux;
+
+    switch (d->op) {
+        case DOP_NOP:
+            break;
+
+        case DOP_CLA:
+            LANES(l) A[l] = sel(mask[l], op[l], A[l]);
+            break;
+
+        case DOP_ADD:
+            LANES(l) A[l] = sel(mask[l], saturate_signed(to_signed(A[l]) +
+                                                         to_signed(op[l])), A[l]);
+            break;
+
+        case DOP_SUB:
+            LANES(l) A[l] = sel(mask[l], saturate_signed(to_signed(A[l]) -
+                                                         to_signed(op[l])), A[l]);
+            break;
+
+        case DOP_SAD:
+            LANES(l) A[l] = sel(mask[l], split_add(A[l], op[l]), A[l]);
+            break;
+
+        case DOP_SSU:
+            LANES(l) A[l] = sel(mask[l], split_sub(A[l], op[l]), A[l]);
+            break;
+
+        case DOP_MPY:
+        case DOP_SMP: {
+            bool split = d->op == DOP_SMP;
+            LANES(l) {
+                uint32_t hi, lo;
+                multiply_words(A[l], op[l], split, &hi, &lo);
+                A[l] = sel(mask[l], hi, A[l]);
+                L[l] = sel(mask[l], lo, L[l]);
+            }
+            break;
+        }
+
+        case DOP_STO: {
+            unsigned r = write_row(ens, target);
+            uint32_t *w = row_get(ens, g, r, buf);
+            LANES(l) w[l] = sel(mask[l], A[l] & WORD_MASK, w[l]);
+            row_put(ens, g, r, w);
+            break;
+        }
+
+        case DOP_ANA:
+            LANES(l) A[l] = sel(mask[l], A[l] & L[l], A[l]);
+            break;
+
+        case DOP_ORA:
+            if (ens->scratch->d37c_mode) {
+                LANES(l) A[l] = sel(mask[l], A[l] | L[l], A[l]);
+            }
+            break;
+
+        case DOP_MIM:
+            LANES(l) A[l] = sel(mask[l], SIGN_BIT | (A[l] & MAGNITUDE_MASK), A[l]);
+            break;
+
+        case DOP_COM:
+            LANES(l) A[l] = sel(mask[l], A[l] ^ SIGN_BIT, A[l]);
+            break;
+
+        case DOP_SAL:
+            LANES(l) A[l] = sel(mask[l], shift_sal(A[l], n), A[l]);
+            break;
+
+        case DOP_ALS:
+            LANES(l) A[l] = sel(mask[l], (A[l] << n) & WORD_MASK, A[l]);
+            break;
+
+        case DOP_SLL:
+            LANES(l) A[l] = sel(mask[l], shift_sll(A[l], n), A[l]);
+            break;
+
+        case DOP_SAR:
+            LANES(l) A[l] = sel(mask[l], shift_sar(A[l], n), A[l]);
+            break;
+
+        case DOP_ARS:
+            LANES(l) A[l] = sel(mask[l], A[l] >> n, A[l]);
+            break;
+
+        case DOP_SLR:
+            LANES(l) A[l] = sel(mask[l], shift_slr(A[l], n), A[l]);
+            break;
+
+        case DOP_ALC_SRL:
+            if (ens->scratch->d37c_mode) {
+                LANES(l) A[l] = sel(mask[l], shift_alc(A[l], n), A[l]);
+            } else {
+                LANES(l) A[l] = sel(mask[l], shift_srl(A[l], n), A[l]);
+            }
+            break;
+
+        case DOP_ARC_SRR:
+            if (ens->scratch->d37c_mode) {
+                LANES(l) A[l] = sel(mask[l], shift_arc(A[l], n), A[l]);
+            } else {
+                LANES(l) A[l] = sel(mask[l], shift_srr(A[l], n), A[l]);
+            }
+            break;
+
+        /* Branches: this is where lanes part company */
+        case DOP_TRA:
+            LANES(l) I[l] = sel(mask[l], target, I[l]);
+            return;
+
+        case DOP_TMI:
+            LANES(l) I[l] = sel(mask[l], (A[l] & SIGN_BIT) ? target : next, I[l]);
+            return;
+
+        case DOP_TMI_TZE:
+            if (ens->scratch->d37c_mode) {
+                LANES(l) I[l] = sel(mask[l], (A[l] & MAGNITUDE_MASK) == 0
+                                             ? target : next, I[l]);
+            } else {
+                LANES(l) I[l] = sel(mask[l], (A[l] & SIGN_BIT) ? target : next,
+                                    I[l]);
+            }
+            return;
+
+        default:
+            exec_scalar(ens, g, d, mask);
+            return;
+    }
+
+    LANES(l) I[l] = sel(mask[l], next, I[l]);
+}
+
+/* Run a group for up to 'budget' words per lane, returns words retired */
+static uint64_t run_group(d17b_ensemble_t *ens, ens_group_t *g,
+                          uint32_t budget) {
+    uint32_t *ran = g->ran;
+    uint32_t *I = g->row[ROW_I];
+    uint64_t retired = 0;
+    uint32_t strays = 1;
+    int lead = -1;
+
+    for (;;) {
+        /*
+         * Lead with the lane furthest behind so split lanes can catch up.
+         * While every live lane ran the last step, the lead still is.
+         */
+        if (strays || g->halted[lead] || ran[lead] >= budget) {
+            lead = -1;
+            LANES(l) {
+                if (!g->halted[l] && ran[l] < budget &&
+                    (lead < 0 || ran[l] < ran[lead])) {
+                    lead = l;
+                }
+            }
+            if (lead < 0) {
+                break;
+            }
+        }
+
+        uint32_t at_I = I[lead];
+        uint32_t buf[ENS_LANES];
+        const uint32_t *code = row_get(ens, g, read_row(ens, (uint16_t)at_I),
+                                       buf);
+        uint32_t word = code[lead];
+        const d17b_decoded_t *d = ens_decode(ens, at_I, word);
+
+        /* Same place, same instruction (a lane may have stored over it) */
+        uint32_t mask[ENS_LANES];
+        strays = 0;
+        LANES(l) {
+            uint32_t live = (~g->halted[l]) & (ran[l] < budget ? ~0u : 0);
+            uint32_t here = (I[l] == at_I && code[l] == word) ? ~0u : 0;
+            mask[l] = live & here;
+            strays |= live & ~here;
+        }
+
+        exec_lanes(ens, g, d, mask);
+
+        LANES(l) ran[l] += mask[l] & 1;
+    }
+
+    LANES(l) {
+        retired += ran[l];
+        g->cycles[l] += ran[l];
+        g->sector[l] = (g->sector[l] + ran[l]) & 0x7F;
+        ran[l] = 0;
+    }
+    return retired;
+}
+
+/* ============================================================================
+ * INTERFACE
+ * ============================================================================ */
+
+void d17b_ensemble_free(d17b_ensemble_t *ens) {
+    if (!ens) {
+        return;
+    }
+    for (uint32_t i = 0; i < ens->groups; i++) {
+        free(ens->group[i].row);
+        free(ens->group[i].packed);
+    }
+    free(ens->group);
+    free(ens->scratch);
+    free(ens);
+}
+
+static d17b_ensemble_t *ensemble_create(const d17b_cpu_t *image,
+                                        uint32_t count, bool packed) {
+    if (count == 0) {
+        return NULL;
+    }
+
+    d17b_ensemble_t *ens = calloc(1, sizeof(*ens));
+    if (!ens) {
+        return NULL;
+    }
+    ens->count = count;
+    ens->packed = packed;
+    ens->groups = (count + ENS_LANES - 1) / ENS_LANES;
+    ens->group = calloc(ens->groups, sizeof(*ens->group));
+    ens->scratch = malloc(sizeof(*ens->scratch));
+    if (!ens->group || !ens->scratch) {
+        d17b_ensemble_free(ens);
+        return NULL;
+    }
+
+    d17b_init(ens->scratch);
+    ens->scratch->d37c_mode = image->d37c_mode;
+
+    for (uint32_t i = 0; i < ens->groups; i++) {
+        ens_group_t *g = &ens->group[i];
+        if (packed) {
+            g->row = calloc(ENS_HOT, sizeof(ens_row_t));
+            g->packed = calloc(ENS_ROWS - ENS_HOT, sizeof(ens_packed_t));
+        } else {
+            g->row = calloc(ENS_ROWS, sizeof(ens_row_t));
+        }
+        if (!g->row || (packed && !g->packed)) {
+            d17b_ensemble_free(ens);
+            return NULL;
+        }
+        LANES(l) g->halted[l] = ~0u;                /* Unused until loaded */
+    }
+
+    for (uint32_t lane = 0; lane < count; lane++) {
+        d17b_ensemble_load(ens, lane, image);
+    }
+    return ens;
+}
+
+d17b_ensemble_t *d17b_ensemble_create(const d17b_cpu_t *image, uint32_t count) {
+    return ensemble_create(image, count, false);
+}
+
+d17b_ensemble_t *d17b_ensemble_create_packed(const d17b_cpu_t *image,
+                                             uint32_t count) {
+    return ensemble_create(image, count, true);
+}
+
+uint32_t d17b_ensemble_count(const d17b_ensemble_t *ens) {
+    return ens->count;
+}
+
+void d17b_ensemble_load(d17b_ensemble_t *ens, uint32_t lane,
+                        const d17b_cpu_t *cpu) {
+    if (lane < ens->count) {
+        cpu_to_lane(ens, cpu, &ens->group[lane / ENS_LANES], lane % ENS_LANES,
+                    ENS_ROWS);
+    }
+}
+
+void d17b_ensemble_store(const d17b_ensemble_t *ens, uint32_t lane,
+                         d17b_cpu_t *cpu) {
+    if (lane < ens->count) {
+        lane_to_cpu(ens, &ens->group[lane / ENS_LANES], lane % ENS_LANES, cpu,
+                    ENS_ROWS);
+        cpu->d37c_mode = ens->scratch->d37c_mode;
+        d17b_flush_decode(cpu);
+        d17b_countdown_sync(cpu);
+    }
+}
+
+uint32_t d17b_ensemble_read(const d17b_ensemble_t *ens, uint32_t lane,
+                            uint8_t channel, uint8_t sector) {
+    if (lane >= ens->count) {
+        return 0;
+    }
+    const d17b_map_t *m = &ens->scratch->map[channel];
+    return lane_get(ens, &ens->group[lane / ENS_LANES],
+                    m->read + (sector & m->mask), lane % ENS_LANES);
+}
+
+void d17b_ensemble_write(d17b_ensemble_t *ens, uint32_t lane,
+                         uint8_t channel, uint8_t sector, uint32_t value) {
+    if (lane >= ens->count) {
+        return;
+    }
+    const d17b_map_t *m = &ens->scratch->map[channel];
+    lane_set(ens, &ens->group[lane / ENS_LANES], m->write + (sector & m->mask),
+             lane % ENS_LANES, value & WORD_MASK);
+}
+
+uint64_t d17b_ensemble_run(d17b_ensemble_t *ens, uint64_t max_cycles) {
+    uint64_t retired = 0;
+
+    for (uint32_t i = 0; i < ens->groups; i++) {
+        uint64_t left = max_cycles;
+        while (left) {
+            uint32_t budget = left > UINT32_MAX ? UINT32_MAX : (uint32_t)left;
+            uint64_t n = run_group(ens, &ens->group[i], budget);
+            if (n == 0) {
+                break;                      /* Every lane halted */
+            }
+            retired += n;
+            left -= budget;
+        }
+    }
+    return retired;
+}
@@ -0,0 +1,313 @@
+/*
+ * D17B Minuteman I Guidance Computer Emulator
+ * Reverse execution by checkpoint and replay
+ *
+ * A history keeps snapshots of a cpu taken every 'interval' word times
+ * as it runs forward. Going back to an earlier point restores the
+ * nearest checkpoint before it and replays forward; execution is
+ * deterministic, so the replay arrives at exactly the state the cpu
+ * passed through. When the checkpoint budget is full every other
+ * checkpoint is dropped and the interval doubles, so memory stays
+ * within the budget however long the run and a replay is never more
+ * than about one interval.
+ *
+ * Finding the instruction before a point, or the last breakpoint before
+ * it, needs the instruction boundaries in between, which only the step
+ * loop sees: those searches step from the checkpoint once to find the
+ * target and then run the fast core to it from the checkpoint again.
+ *
+ * Checkpoints are ordinary snapshots, so restoring one re-bases the
+ * cpu's delta snapshots. A snapshot leaves out pending events, so each
+ * checkpoint keeps its own copy of them, and of how far an input replay
+ * had read; a replay stays open at the end of its log, so going back
+ * before its last inputs feeds them again. Going back re-runs
+ * instructions a trace already holds and inputs an input log already
+ * holds, so both are set aside for it, and the log then loses the
+ * inputs after the point it went back to.
+ *
+ * Copyright 2025 Zane Hambly - Apache 2.0 License
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "d17b.h"
+#include "d17b_internal.h"
+
+#define HISTORY_INTERVAL    4096        /* Initial word times per checkpoint */
+#define HISTORY_MIN_KEEP    4
+
+typedef struct {
+    uint64_t cycle;
+    uint8_t *state;
+    struct d17b_sched *sched;           /* Pending events, or NULL */
+    d17b_replay_pos_t replay;
+} history_point_t;
+
+struct d17b_history {
+    history_point_t *point;             /* In cycle order */
+    uint32_t count;
+    uint32_t capacity;                  /* Budget, in checkpoints */
+    uint64_t interval;
+};
+
+/* ============================================================================
+ * CHECKPOINTS
+ * ============================================================================ */
+
+static void point_free(history_point_t *p) {
+    free(p->state);
+    d17b_sched_free(p->sched);
+}
+
+/* Halve the checkpoints, keeping the first, and double the interval */
+static void thin(d17b_history_t *h) {
+    uint32_t kept = 0;
+    for (uint32_t i = 0; i < h->count; i++) {
+        if (i % 2 == 0) {
+            h->point[kept++] = h->point[i];
+        } else {
+            point_free(&h->point[i]);
+        }
+    }
+    h->count = kept;
+    h->interval *= 2;
+}
+
+static bool checkpoint(d17b_history_t *h, d17b_cpu_t *cpu) {
+    if (h->count == h->capacity) {
+        thin(h);
+    }
+
+    uint8_t *state = malloc(d17b_state_size());
+    struct d17b_sched *sched = d17b_sched_clone(cpu->sched);
+    if (!state || (cpu->sched && !sched)) {
+        free(state);
+        d17b_sched_free(sched);
+        return false;
+    }
+    d17b_state_encode(cpu, state);
+    h->point[h->count].cycle = cpu->cycle_count;
+    h->point[h->count].state = state;
+    h->point[h->count].sched = sched;
+    h->point[h->count].replay = d17b_replay_tell(cpu);
+    h->count++;
+    return true;
+}
+
+/* Drop checkpoints at or after 'cycle' */
+static void truncate_from(d17b_history_t *h, uint64_t cycle) {
+    while (h->count > 0 && h->point[h->count - 1].cycle >= cycle) {
+        point_free(&h->point[--h->count]);
+    }
+}
+
+/* Latest checkpoint strictly before 'cycle', or -1 */
+static int32_t point_before(const d17b_history_t *h, uint64_t cycle) {
+    int32_t lo = 0, hi = (int32_t)h->count - 1, found = -1;
+    while (lo <= hi) {
+        int32_t mid = (lo + hi) / 2;
+        if (h->point[mid].cycle < cycle) {
+            found = mid;
+            lo = mid + 1;
+        } else {
+            hi = mid - 1;
+        }
+    }
+    return found;
+}
+
+static void restore(const d17b_history_t *h, d17b_cpu_t *cpu, int32_t i) {
+    d17b_state_decode(cpu, h->point[i].state, d17b_state_size());
+    cpu->sched = d17b_sched_clone(h->point[i].sched);
+    d17b_replay_seek(cpu, h->point[i].replay);
+}
+
+/* From checkpoint i, run forward to the instruction boundary 'cycle' */
+static void replay(const d17b_history_t *h, d17b_cpu_t *cpu, int32_t i,
+                   uint64_t cycle) {
+    restore(h, cpu, i);
+    if (cycle > cpu->cycle_count) {
+        d17b_run_until(cpu, cycle - cpu->cycle_count, 0, NULL);
+    }
+}
+
+/* Take the checkpoints a forward run has come due for */
+static void keep_up(d17b_history_t *h, d17b_cpu_t *cpu) {
+    uint64_t last = h->count ? h->point[h->count - 1].cycle : 0;
+    if (h->count == 0 || cpu->cycle_count >= last + h->interval) {
+        checkpoint(h, cpu);
+    }
+}
+
+/* ============================================================================
+ * INTERFACE
+ * ============================================================================ */
+
+d17b_history_t *d17b_history_create(d17b_cpu_t *cpu, size_t max_bytes) {
+    d17b_history_t *h = calloc(1, sizeof(*h));
+    if (!h) {
+        return NULL;
+    }
+
+    h->capacity = (uint32_t)(max_bytes / d17b_state_size());
+    if (h->capacity < HISTORY_MIN_KEEP) {
+        h->capacity = HISTORY_MIN_KEEP;
+    }
+    h->interval = HISTORY_INTERVAL;
+    h->point = malloc(h->capacity * sizeof(*h->point));
+    if (!h->point || !checkpoint(h, cpu)) {
+        d17b_history_free(h);
+        return NULL;
+    }
+    return h;
+}
+
+void d17b_history_free(d17b_history_t *h) {
+    if (!h) {
+        return;
+    }
+
+    for (uint32_t i = 0; i < h->count; i++) {
+        point_free(&h->point[i]);
+    }
+    free(h->point);
+    free(h);
+}
+
+uint32_t d17b_history_checkpoints(const d17b_history_t *h) {
+    return h->count;
+}
+
+uint64_t d17b_history_interval(const d17b_history_t *h) {
+    return h->interval;
+}
+
+void d17b_history_mark(d17b_history_t *h, d17b_cpu_t *cpu) {
+    /* What came after this point no longer happens */
+    truncate_from(h, cpu->cycle_count);
+    checkpoint(h, cpu);
+}
+
+int d17b_history_step(d17b_history_t *h, d17b_cpu_t *cpu) {
+    int result = d17b_step(cpu);
+    keep_up(h, cpu);
+    return result;
+}
+
+d17b_exit_t d17b_history_run(d17b_history_t *h, d17b_cpu_t *cpu,
+                             uint64_t max_cycles, unsigned stop,
+                             uint64_t *retired) {
+    uint64_t start = cpu->cycle_count;
+    d17b_exit_t why;
+
+    /* Run up to each checkpoint in turn */
+    for (;;) {
+        uint64_t used = cpu->cycle_count - start;
+        uint64_t due = h->point[h->count - 1].cycle + h->interval;
+        uint64_t chunk = max_cycles - used;
+        if (due > cpu->cycle_count && due - cpu->cycle_count < chunk) {
+            chunk = due - cpu->cycle_count;
+        }
+
+        uint64_t before = cpu->cycle_count;
+        why = d17b_run_until(cpu, chunk, stop, NULL);
+        keep_up(h, cpu);
+        if (why != D17B_EXIT_BUDGET || cpu->cycle_count - start >= max_cycles ||
+            cpu->cycle_count == before) {
+            break;
+        }
+    }
+
+    if (retired) {
+        *retired = cpu->cycle_count - start;
+    }
+    return why;
+}
+
+static bool step_back(d17b_history_t *h, d17b_cpu_t *cpu, uint32_t n) {
+    uint64_t now = cpu->cycle_count;
+    int32_t i = point_before(h, now);
+    if (i < 0 || n == 0) {
+        return false;
+    }
+
+    /* Step over the gap once, keeping the last n boundaries */
+    uint64_t *ring = malloc(n * sizeof(*ring));
+    if (!ring) {
+        return false;
+    }
+    uint64_t seen = 0;
+    restore(h, cpu, i);
+    while (cpu->cycle_count < now) {
+        uint64_t at = cpu->cycle_count;
+        ring[seen++ % n] = at;
+        d17b_step(cpu);
+        if (cpu->cycle_count == at) {
+            break;                      /* Halted short of 'now' */
+        }
+    }
+
+    /* Too few in this interval: go to the checkpoint and on from there */
+    uint64_t target = seen >= n ? ring[seen % n] : h->point[i].cycle;
+    free(ring);
+    replay(h, cpu, i, target);
+    if (seen < n && i > 0) {
+        return step_back(h, cpu, (uint32_t)(n - seen));
+    }
+    return seen >= n;
+}
+
+static bool continue_back(d17b_history_t *h, d17b_cpu_t *cpu) {
+    uint64_t end = cpu->cycle_count;
+
+    /* Search one interval at a time, latest first */
+    for (int32_t i = point_before(h, end); i >= 0; i--) {
+        uint64_t hit = UINT64_MAX;
+        restore(h, cpu, i);
+        while (cpu->cycle_count < end) {
+            uint64_t at = cpu->cycle_count;
+            if (d17b_at_breakpoint(cpu)) {
+                hit = at;
+            }
+            d17b_step(cpu);
+            if (cpu->cycle_count == at) {
+                break;
+            }
+        }
+        if (hit != UINT64_MAX) {
+            replay(h, cpu, i, hit);
+            return true;
+        }
+        end = h->point[i].cycle;
+    }
+
+    /* No breakpoint: stop at the start of the history */
+    restore(h, cpu, 0);
+    return false;
+}
+
+/* Both searches re-run instructions and inputs; keep them out of any
+ * trace and input log, and cut the log back to where they stop */
+bool d17b_history_step_back(d17b_history_t *h, d17b_cpu_t *cpu, uint32_t n) {
+    struct d17b_trace *trace = cpu->trace;
+    struct d17b_record *record = cpu->record;
+    cpu->trace = NULL;
+    cpu->record = NULL;
+    bool found = step_back(h, cpu, n);
+    cpu->trace = trace;
+    cpu->record = record;
+    d17b_record_rewind(cpu);
+    return found;
+}
+
+bool d17b_history_continue_back(d17b_history_t *h, d17b_cpu_t *cpu) {
+    struct d17b_trace *trace = cpu->trace;
+    struct d17b_record *record = cpu->record;
+    cpu->trace = NULL;
+    cpu->record = NULL;
+    bool found = continue_back(h, cpu);
+    cpu->trace = trace;
+    cpu->record = record;
+    d17b_record_rewind(cpu);
+    return found;
+}
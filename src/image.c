@@ -0,0 +1,198 @@
+/*
+ * D17B Minuteman I Guidance Computer Emulator
+ * Shared drum images with copy-on-write instances
+ *
+ * An image is an immutable copy of a drum. An instance is the rest of a
+ * machine - registers, loops, I/O and timing state, pending events - and
+ * a table of private channels: a NULL entry reads through to the image,
+ * and the first write to a channel copies just that channel. A campaign
+ * of instances that only touch a few variable channels costs a few
+ * hundred bytes each instead of a whole d17b_cpu_t.
+ *
+ * Instances run by being attached to a working cpu, which brings its
+ * drum up to date channel by channel, and detached afterwards, which
+ * copies back the channels the run changed.
+ *
+ * Copyright 2025 Zane Hambly - Apache 2.0 License
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "d17b.h"
+#include "d17b_internal.h"
+
+/* The cpu state an instance keeps, either side of memory[][] */
+#define STATE_HEAD      offsetof(d17b_cpu_t, memory)
+#define STATE_TAIL      offsetof(d17b_cpu_t, current_sector)
+#define STATE_TAIL_END  offsetof(d17b_cpu_t, breakpoint_count)
+#define CHANNEL_BYTES   (SECTORS * sizeof(uint32_t))
+
+struct d17b_image {
+    uint32_t memory[CHANNELS][SECTORS];
+};
+
+struct d17b_instance {
+    const d17b_image_t *image;
+    uint32_t *page[CHANNELS];           /* Private channels, NULL = image */
+    uint32_t pages;
+    uint8_t head[STATE_HEAD];
+    uint8_t tail[STATE_TAIL_END - STATE_TAIL];
+};
+
+/* ============================================================================
+ * IMAGES
+ * ============================================================================ */
+
+d17b_image_t *d17b_image_create(const d17b_cpu_t *cpu) {
+    d17b_image_t *image = malloc(sizeof(*image));
+    if (image) {
+        memcpy(image->memory, cpu->memory, sizeof(image->memory));
+    }
+    return image;
+}
+
+void d17b_image_free(d17b_image_t *image) {
+    free(image);
+}
+
+/* ============================================================================
+ * INSTANCES
+ * ============================================================================ */
+
+/* The pending events live in the saved tail, as cpu->sched */
+#define SCHED_AT        (offsetof(d17b_cpu_t, sched) - STATE_TAIL)
+
+static inline struct d17b_sched *instance_sched(const d17b_instance_t *inst) {
+    struct d17b_sched *s;
+    memcpy(&s, inst->tail + SCHED_AT, sizeof(s));
+    return s;
+}
+
+static inline void instance_set_sched(d17b_instance_t *inst,
+                                      struct d17b_sched *s) {
+    memcpy(inst->tail + SCHED_AT, &s, sizeof(s));
+}
+
+static inline const uint32_t *channel_words(const d17b_instance_t *inst,
+                                            uint8_t channel) {
+    return inst->page[channel] ? inst->page[channel]
+                               : inst->image->memory[channel];
+}
+
+d17b_instance_t *d17b_instance_create(const d17b_image_t *image,
+                                      d17b_cpu_t *cpu) {
+    d17b_instance_t *inst = calloc(1, sizeof(*inst));
+    if (!inst) {
+        return NULL;
+    }
+
+    inst->image = image;
+    if (!d17b_instance_detach(cpu, inst)) {
+        d17b_instance_free(inst);
+        return NULL;
+    }
+    return inst;
+}
+
+void d17b_instance_free(d17b_instance_t *inst) {
+    if (!inst) {
+        return;
+    }
+
+    for (uint32_t ch = 0; ch < CHANNELS; ch++) {
+        free(inst->page[ch]);
+    }
+    d17b_sched_free(instance_sched(inst));
+    free(inst);
+}
+
+uint32_t d17b_instance_pages(const d17b_instance_t *inst) {
+    return inst->pages;
+}
+
+uint32_t d17b_instance_read(const d17b_instance_t *inst, uint8_t channel,
+                            uint8_t sector) {
+    if (channel >= CHANNELS) {
+        return 0;
+    }
+    return channel_words(inst, channel)[sector & 0x7F];
+}
+
+bool d17b_instance_write(d17b_instance_t *inst, uint8_t channel,
+                         uint8_t sector, uint32_t value) {
+    if (channel >= CHANNELS) {
+        return false;
+    }
+
+    if (!inst->page[channel]) {
+        uint32_t *page = malloc(CHANNEL_BYTES);
+        if (!page) {
+            return false;
+        }
+        memcpy(page, inst->image->memory[channel], CHANNEL_BYTES);
+        inst->page[channel] = page;
+        inst->pages++;
+    }
+    inst->page[channel][sector & 0x7F] = value & WORD_MASK;
+    return true;
+}
+
+/* ============================================================================
+ * ATTACH AND DETACH
+ * ============================================================================ */
+
+void d17b_instance_attach(d17b_cpu_t *cpu, d17b_instance_t *inst) {
+    bool changed = false;
+
+    /* Only channels that differ from what the cpu holds are copied */
+    for (uint32_t ch = 0; ch < CHANNELS; ch++) {
+        const uint32_t *words = channel_words(inst, (uint8_t)ch);
+        if (memcmp(cpu->memory[ch], words, CHANNEL_BYTES) != 0) {
+            memcpy(cpu->memory[ch], words, CHANNEL_BYTES);
+            memset(cpu->decoded[ch], 0, sizeof(cpu->decoded[ch]));
+            memset(cpu->dirty[ch], 0xFF, sizeof(cpu->dirty[ch]));
+            changed = true;
+        }
+    }
+#ifdef D17B_JIT
+    if (changed && cpu->jit) {
+        d17b_jit_flush(cpu);
+    }
+#else
+    (void)changed;
+#endif
+
+    /* The events move to the cpu until detach */
+    d17b_sched_clear(cpu);
+    memcpy(cpu, inst->head, STATE_HEAD);
+    memcpy((uint8_t *)cpu + STATE_TAIL, inst->tail, sizeof(inst->tail));
+    instance_set_sched(inst, NULL);
+}
+
+bool d17b_instance_detach(d17b_cpu_t *cpu, d17b_instance_t *inst) {
+    bool ok = true;
+
+    for (uint32_t ch = 0; ch < CHANNELS; ch++) {
+        if (inst->page[ch]) {
+            memcpy(inst->page[ch], cpu->memory[ch], CHANNEL_BYTES);
+        } else if (memcmp(cpu->memory[ch], inst->image->memory[ch],
+                          CHANNEL_BYTES) != 0) {
+            uint32_t *page = malloc(CHANNEL_BYTES);
+            if (!page) {
+                ok = false;
+                continue;
+            }
+            memcpy(page, cpu->memory[ch], CHANNEL_BYTES);
+            inst->page[ch] = page;
+            inst->pages++;
+        }
+    }
+
+    /* The events go back with the instance */
+    d17b_countdown_sync(cpu);
+    d17b_sched_free(instance_sched(inst));
+    memcpy(inst->head, cpu, STATE_HEAD);
+    memcpy(inst->tail, (uint8_t *)cpu + STATE_TAIL, sizeof(inst->tail));
+    cpu->sched = NULL;
+    return ok;
+}
@@ -0,0 +1,772 @@
+/*
+ * D17B Minuteman I Guidance Computer Emulator
+ * x86-64 basic-block JIT
+ *
+ * D17B code runs in straight lines chained through each word's Sp field
+ * and only TRA, TMI and TZE break them, so a block is simply the Sp chain
+ * from an entry sector up to the first transfer. Blocks are translated
+ * to native code on first execution and looked up by entry sector.
+ *
+ * Entry sectors that keep being dispatched are retranslated as traces:
+ * the path is followed through TRA and through every TMI/TZE whose
+ * recorded direction is strongly biased, with a side exit back to the
+ * dispatcher when a guard goes the other way. A trace that comes back to
+ * its own entry loops in native code until the cycle budget runs out.
+ *
+ * The code buffer is never writable and executable at once: the pages a
+ * block is about to be written into are made read-write for it and
+ * read-execute again before it runs. Blocks are never patched once
+ * written, so that is the only time code is written.
+ *
+ * Copyright 2025 Zane Hambly - Apache 2.0 License
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "d17b.h"
+#include "d17b_internal.h"
+
+#if defined(D17B_JIT) && defined(__x86_64__) && !defined(_WIN32)
+
+#include <sys/mman.h>
+#include <unistd.h>
+
+/*
+ * Block formation
+ *
+ * A block follows the Sp chain until a transfer or HPR, a sector it has
+ * already visited, or JIT_MAX_BLOCK words. EFC/HFC only ever form a
+ * one-word block, so the dispatcher has cycle_count current for them.
+ *
+ * Traces stay inside one channel so invalidation keeps working per
+ * channel, and stop at JIT_MAX_TRACE words.
+ *
+ * Register use inside generated code:
+ *   rbx  - d17b_cpu_t *
+ *   r12d - A
+ *   r13d - L
+ *   r14d - words retired by earlier trips round a trace loop
+ *   r15d - word limit passed in by the dispatcher
+ * A and L are written back before every call into C and at every exit.
+ * A block returns the number of words it retired and leaves I set.
+ */
+
+#define JIT_CODE_SIZE       (4u << 20)
+#define JIT_MAX_BLOCK       32
+#define JIT_MAX_TRACE       128
+#define JIT_MAX_BLOCKS      8192
+#define JIT_MAX_ENTRIES     (JIT_MAX_BLOCKS * 4)
+#define JIT_BLOCK_BYTES     (JIT_MAX_TRACE * 256 + 128)  /* Worst case */
+
+#define JIT_HOT_THRESHOLD   64      /* Dispatches before an entry is traced */
+#define JIT_BIAS_MIN        16      /* Branch outcomes needed to predict */
+#define JIT_BIAS_SHIFT      5       /* Minority must be under 1/32 */
+
+typedef uint32_t (*jit_fn_t)(d17b_cpu_t *cpu, uint32_t limit);
+
+typedef struct jit_block {
+    jit_fn_t code;
+    uint64_t slots[2];                  /* Sectors covered in .channel */
+    struct jit_block *next_in_channel;
+    uint16_t taken_i;                   /* Target of a final TMI/TZE */
+    uint8_t channel;
+    uint8_t entry;                      /* Entry sector */
+    uint8_t len;                        /* Most words one run can retire */
+    uint8_t last;                       /* Sector of the final word */
+    bool branch;                        /* Ends in TMI/TZE: profile it */
+    bool trace;
+} jit_block_t;
+
+/* Outcomes of the TMI/TZE word at one sector */
+typedef struct {
+    uint16_t taken;
+    uint16_t fall;
+} jit_profile_t;
+
+struct d17b_jit {
+    uint8_t *code;                      /* Executable buffer */
+    size_t code_used;
+    size_t page;                        /* Host page size */
+
+    jit_block_t *map[CHANNELS][SECTORS];    /* Entry sector -> block */
+    jit_block_t *chain[CHANNELS];           /* Live blocks per channel */
+    uint8_t cover[CHANNELS][SECTORS];       /* Live blocks holding a word */
+
+    jit_block_t blocks[JIT_MAX_BLOCKS];
+    size_t nblocks;
+
+    /* Stable copies of decoded words handed to C fallback handlers */
+    d17b_decoded_t entries[JIT_MAX_ENTRIES];
+    size_t nentries;
+
+    /* Hot-path detection */
+    uint16_t hot[CHANNELS][SECTORS];        /* Dispatches per entry sector */
+    jit_profile_t profile[CHANNELS][SECTORS];
+
+    uint8_t dirty;                      /* A store killed a block */
+    bool d37c_mode;                     /* Model the blocks were built for */
+};
+
+/* ============================================================================
+ * CODE EMISSION
+ * ============================================================================ */
+
+typedef struct {
+    uint8_t *p;
+} emit_t;
+
+#define OFF(field)  ((uint32_t)offsetof(d17b_cpu_t, field))
+
+static void b1(emit_t *e, uint8_t v) {
+    *e->p++ = v;
+}
+
+static void b4(emit_t *e, uint32_t v) {
+    memcpy(e->p, &v, 4);
+    e->p += 4;
+}
+
+static void b8(emit_t *e, uint64_t v) {
+    memcpy(e->p, &v, 8);
+    e->p += 8;
+}
+
+static void bn(emit_t *e, const char *bytes, size_t n) {
+    memcpy(e->p, bytes, n);
+    e->p += n;
+}
+
+/* mov r12d, [rbx+disp32] */
+static void emit_load_a(emit_t *e, uint32_t disp) {
+    bn(e, "\x44\x8B\xA3", 3);
+    b4(e, disp);
+}
+
+/* mov eax, [rbx+disp32] */
+static void emit_load_eax(emit_t *e, uint32_t disp) {
+    bn(e, "\x8B\x83", 2);
+    b4(e, disp);
+}
+
+/* Write A and L back to the CPU structure */
+static void emit_spill(emit_t *e) {
+    bn(e, "\x44\x89\xA3", 3);           /* mov [rbx+A], r12d */
+    b4(e, OFF(A));
+    bn(e, "\x44\x89\xAB", 3);           /* mov [rbx+L], r13d */
+    b4(e, OFF(L));
+}
+
+static void emit_reload(emit_t *e) {
+    emit_load_a(e, OFF(A));
+    bn(e, "\x44\x8B\xAB", 3);           /* mov r13d, [rbx+L] */
+    b4(e, OFF(L));
+}
+
+/* mov dword [rbx+I], imm32 */
+static void emit_set_i(emit_t *e, uint32_t value) {
+    bn(e, "\xC7\x83", 2);
+    b4(e, OFF(I));
+    b4(e, value);
+}
+
+static void emit_call(emit_t *e, const void *fn) {
+    bn(e, "\x48\xB8", 2);               /* mov rax, imm64 */
+    b8(e, (uint64_t)(uintptr_t)fn);
+    bn(e, "\xFF\xD0", 2);               /* call rax */
+}
+
+static void emit_prologue(emit_t *e) {
+    b1(e, 0x53);                        /* push rbx */
+    bn(e, "\x41\x54", 2);               /* push r12 */
+    bn(e, "\x41\x55", 2);               /* push r13 */
+    bn(e, "\x41\x56", 2);               /* push r14 */
+    bn(e, "\x41\x57", 2);               /* push r15 - rsp now 16-aligned */
+    bn(e, "\x48\x89\xFB", 3);           /* mov rbx, rdi */
+    bn(e, "\x41\x89\xF7", 3);           /* mov r15d, esi */
+    bn(e, "\x45\x31\xF6", 3);           /* xor r14d, r14d */
+    emit_reload(e);
+}
+
+/* Leave the block having retired r14d + 'retired' words */
+static void emit_exit(emit_t *e, uint32_t retired, bool set_i, uint32_t i_value) {
+    if (set_i) {
+        emit_set_i(e, i_value);
+    }
+    emit_spill(e);
+    bn(e, "\x41\x8D\x86", 3);           /* lea eax, [r14+imm32] */
+    b4(e, retired);
+    bn(e, "\x41\x5F", 2);               /* pop r15 */
+    bn(e, "\x41\x5E", 2);               /* pop r14 */
+    bn(e, "\x41\x5D", 2);               /* pop r13 */
+    bn(e, "\x41\x5C", 2);               /* pop r12 */
+    b1(e, 0x5B);                        /* pop rbx */
+    b1(e, 0xC3);                        /* ret */
+}
+
+/* After a call that may have stored into translated code, bail out */
+static void emit_dirty_exit(emit_t *e, struct d17b_jit *jit,
+                            uint32_t retired, uint32_t next_i) {
+    bn(e, "\x48\xB8", 2);               /* mov rax, &jit->dirty */
+    b8(e, (uint64_t)(uintptr_t)&jit->dirty);
+    bn(e, "\x80\x38\x00", 3);           /* cmp byte [rax], 0 */
+    bn(e, "\x0F\x84", 2);               /* je over */
+    uint8_t *patch = e->p;
+    b4(e, 0);
+    emit_exit(e, retired, true, next_i);
+    uint32_t rel = (uint32_t)(e->p - (patch + 4));
+    memcpy(patch, &rel, 4);
+}
+
+/*
+ * A = A +/- eax, sign-magnitude with saturation at +/-(2^23 - 1).
+ * Mirrors d17b_add_24bit / d17b_sub_24bit.
+ */
+static void emit_addsub(emit_t *e, bool subtract) {
+    /* ecx = to_signed(A) */
+    bn(e, "\x44\x89\xE1", 3);           /* mov ecx, r12d */
+    bn(e, "\x81\xE1", 2); b4(e, MAGNITUDE_MASK);   /* and ecx, MAG */
+    bn(e, "\x89\xCA", 2);               /* mov edx, ecx */
+    bn(e, "\xF7\xDA", 2);               /* neg edx */
+    bn(e, "\x41\xF7\xC4", 3); b4(e, SIGN_BIT);     /* test r12d, SIGN */
+    bn(e, "\x0F\x45\xCA", 3);           /* cmovnz ecx, edx */
+
+    /* edx = to_signed(operand) */
+    bn(e, "\x89\xC2", 2);               /* mov edx, eax */
+    bn(e, "\x81\xE2", 2); b4(e, MAGNITUDE_MASK);   /* and edx, MAG */
+    bn(e, "\x89\xD6", 2);               /* mov esi, edx */
+    bn(e, "\xF7\xDE", 2);               /* neg esi */
+    b1(e, 0xA9); b4(e, SIGN_BIT);       /* test eax, SIGN */
+    bn(e, "\x0F\x45\xD6", 3);           /* cmovnz edx, esi */
+
+    /* ecx = clamp(ecx +/- edx) */
+    bn(e, subtract ? "\x29\xD1" : "\x01\xD1", 2);   /* sub/add ecx, edx */
+    b1(e, 0xBA); b4(e, MAGNITUDE_MASK); /* mov edx, MAG */
+    bn(e, "\x39\xD1", 2);               /* cmp ecx, edx */
+    bn(e, "\x0F\x4F\xCA", 3);           /* cmovg ecx, edx */
+    b1(e, 0xBA); b4(e, (uint32_t)-(int32_t)MAGNITUDE_MASK);   /* mov edx, -MAG */
+    bn(e, "\x39\xD1", 2);               /* cmp ecx, edx */
+    bn(e, "\x0F\x4C\xCA", 3);           /* cmovl ecx, edx */
+
+    /* A = from_signed(ecx) */
+    bn(e, "\x89\xCE", 2);               /* mov esi, ecx */
+    bn(e, "\x89\xCA", 2);               /* mov edx, ecx */
+    bn(e, "\xF7\xDA", 2);               /* neg edx */
+    bn(e, "\x81\xE2", 2); b4(e, MAGNITUDE_MASK);   /* and edx, MAG */
+    bn(e, "\x81\xCA", 2); b4(e, SIGN_BIT);         /* or edx, SIGN */
+    bn(e, "\x81\xE1", 2); b4(e, MAGNITUDE_MASK);   /* and ecx, MAG */
+    bn(e, "\x85\xF6", 2);               /* test esi, esi */
+    bn(e, "\x0F\x48\xCA", 3);           /* cmovs ecx, edx */
+    bn(e, "\x41\x89\xCC", 3);           /* mov r12d, ecx */
+}
+
+/* Conditional transfer: I = cond ? target : next, then leave */
+static void emit_branch(emit_t *e, uint32_t test_mask, bool jump_if_zero,
+                        const d17b_decoded_t *d, uint32_t retired) {
+    emit_set_i(e, d->next);
+    bn(e, "\x41\xF7\xC4", 3);           /* test r12d, mask */
+    b4(e, test_mask);
+    b1(e, jump_if_zero ? 0x75 : 0x74);  /* skip the taken store */
+    b1(e, 10);
+    emit_set_i(e, d->target);           /* 10 bytes */
+    emit_exit(e, retired, false, 0);
+}
+
+/*
+ * Trace guard: keep going on the predicted side of a TMI/TZE, otherwise
+ * side-exit to the dispatcher with I set to the other side.
+ */
+static void emit_guard(emit_t *e, uint32_t test_mask, bool jump_if_zero,
+                       const d17b_decoded_t *d, bool taken, uint32_t retired) {
+    bn(e, "\x41\xF7\xC4", 3);           /* test r12d, mask */
+    b4(e, test_mask);
+    bn(e, taken == jump_if_zero ? "\x0F\x84" : "\x0F\x85", 2);  /* je/jne on */
+    uint8_t *patch = e->p;
+    b4(e, 0);
+    emit_exit(e, retired, true, taken ? d->next : d->target);
+    uint32_t rel = (uint32_t)(e->p - (patch + 4));
+    memcpy(patch, &rel, 4);
+}
+
+/* Called from generated code after a word that can raise a stop */
+static bool jit_stop_pending(const d17b_cpu_t *cpu) {
+    return cpu->run_stop && d17b_stop_pending(cpu);
+}
+
+/* Hand one word to its C handler */
+static void emit_fallback(emit_t *e, struct d17b_jit *jit,
+                          const d17b_decoded_t *d, uint16_t at,
+                          uint32_t retired) {
+    d17b_decoded_t *copy = &jit->entries[jit->nentries++];
+    *copy = *d;
+
+    emit_spill(e);
+    emit_set_i(e, at);                  /* h_reference refetches from I */
+    bn(e, "\x48\x89\xDF", 3);           /* mov rdi, rbx */
+    bn(e, "\x48\xBE", 2);               /* mov rsi, imm64 */
+    b8(e, (uint64_t)(uintptr_t)copy);
+    emit_call(e, (const void *)d->handler);
+    emit_reload(e);
+
+    if (d->op == DOP_REFERENCE) {
+        /* Flag store can reach channel 50 */
+        emit_dirty_exit(e, jit, retired, d->next);
+    }
+
+    if (DOP_IS_EVENT(d->op)) {
+        /* An I/O or error stop must end a looping trace too */
+        bn(e, "\x48\x89\xDF", 3);       /* mov rdi, rbx */
+        emit_call(e, (const void *)jit_stop_pending);
+        bn(e, "\x84\xC0", 2);           /* test al, al */
+        bn(e, "\x0F\x84", 2);           /* je over */
+        uint8_t *patch = e->p;
+        b4(e, 0);
+        emit_exit(e, retired, true, d->next);
+        uint32_t rel = (uint32_t)(e->p - (patch + 4));
+        memcpy(patch, &rel, 4);
+    }
+}
+
+/* ============================================================================
+ * BLOCK MANAGEMENT
+ * ============================================================================ */
+
+/* A path of words from one entry sector, ready for emission */
+typedef struct {
+    d17b_decoded_t words[JIT_MAX_TRACE];
+    uint16_t at[JIT_MAX_TRACE];
+    int8_t taken[JIT_MAX_TRACE];        /* Predicted TMI/TZE side, or -1 */
+    uint64_t seen[2];
+    int n;
+    uint16_t end_i;                     /* I after an open end */
+    bool open;                          /* Falls off the end of the path */
+    bool loops;                         /* Open end is the entry sector */
+} jit_path_t;
+
+static bool is_conditional(uint8_t op) {
+    return op == DOP_TMI || op == DOP_TMI_TZE;
+}
+
+/* Predicted side of the TMI/TZE at channel/sector: 1 taken, 0 not, -1 none */
+static int predict(const struct d17b_jit *jit, uint8_t channel, uint8_t sector) {
+    const jit_profile_t *p = &jit->profile[channel][sector];
+    uint32_t total = (uint32_t)p->taken + p->fall;
+
+    if (total < JIT_BIAS_MIN) {
+        return -1;
+    }
+    if (p->fall < (total >> JIT_BIAS_SHIFT)) {
+        return 1;
+    }
+    if (p->taken < (total >> JIT_BIAS_SHIFT)) {
+        return 0;
+    }
+    return -1;
+}
+
+static void record_branch(struct d17b_jit *jit, const jit_block_t *b,
+                          uint16_t next_i) {
+    jit_profile_t *p = &jit->profile[b->channel][b->last];
+
+    if (next_i == b->taken_i) {
+        p->taken++;
+    } else {
+        p->fall++;
+    }
+    if (p->taken == UINT16_MAX || p->fall == UINT16_MAX) {
+        p->taken >>= 1;
+        p->fall >>= 1;
+    }
+}
+
+/*
+ * Follow the code from an entry sector. A basic block stops at the first
+ * transfer; a trace follows TRA and predicted TMI/TZE words for as long as
+ * they stay in the channel.
+ */
+static void gather_path(const d17b_cpu_t *cpu, uint8_t channel, uint8_t sector,
+                        bool trace, jit_path_t *path) {
+    const struct d17b_jit *jit = cpu->jit;
+    int limit = trace ? JIT_MAX_TRACE : JIT_MAX_BLOCK;
+    uint8_t s = sector;
+
+    path->seen[0] = path->seen[1] = 0;
+    path->n = 0;
+    path->open = true;
+    path->loops = false;
+
+    for (;;) {
+        d17b_decoded_t *d = &path->words[path->n];
+        d17b_decode((d17b_cpu_t *)cpu, cpu->memory[channel][s], channel, d);
+
+        if ((d->op == DOP_EFC || d->op == DOP_HFC) && path->n > 0) {
+            path->end_i = (uint16_t)((channel << 9) | (s << 2));
+            break;
+        }
+
+        path->seen[s >> 6] |= 1ULL << (s & 63);
+        path->at[path->n] = (uint16_t)((channel << 9) | (s << 2));
+        path->taken[path->n] = -1;
+        path->n++;
+
+        uint16_t next = d->next;
+        if (d->op == DOP_HPR) {
+            path->open = false;
+            break;
+        } else if (d->op == DOP_EFC || d->op == DOP_HFC) {
+            path->end_i = next;
+            break;
+        } else if (d->op == DOP_TRA) {
+            next = d->target;
+            if (!trace || GET_CHANNEL(next) != channel) {
+                path->end_i = next;
+                break;
+            }
+        } else if (is_conditional(d->op)) {
+            int side = trace ? predict(jit, channel, s) : -1;
+            if (side < 0 || GET_CHANNEL(side ? d->target : d->next) != channel) {
+                path->open = false;
+                break;
+            }
+            path->taken[path->n - 1] = (int8_t)side;
+            next = side ? d->target : d->next;
+        }
+
+        path->end_i = next;
+        s = GET_SECTOR(next);
+        if ((path->seen[s >> 6] >> (s & 63)) & 1) {
+            path->loops = trace && s == sector;
+            break;
+        }
+        if (path->n == limit) {
+            break;
+        }
+    }
+}
+
+/* Drop a block from the lookup map and its channel chain */
+static void unlink_block(struct d17b_jit *jit, jit_block_t *b) {
+    jit_block_t **pp = &jit->chain[b->channel];
+
+    while (*pp != b) {
+        pp = &(*pp)->next_in_channel;
+    }
+    *pp = b->next_in_channel;
+
+    if (jit->map[b->channel][b->entry] == b) {
+        jit->map[b->channel][b->entry] = NULL;
+    }
+    for (int s = 0; s < SECTORS; s++) {
+        if ((b->slots[s >> 6] >> (s & 63)) & 1) {
+            jit->cover[b->channel][s]--;
+        }
+    }
+}
+
+void d17b_jit_flush(d17b_cpu_t *cpu) {
+    struct d17b_jit *jit = cpu->jit;
+
+    memset(jit->map, 0, sizeof(jit->map));
+    memset(jit->chain, 0, sizeof(jit->chain));
+    memset(jit->cover, 0, sizeof(jit->cover));
+    memset(jit->hot, 0, sizeof(jit->hot));
+    memset(jit->profile, 0, sizeof(jit->profile));
+    jit->nblocks = 0;
+    jit->nentries = 0;
+    jit->code_used = 0;
+    jit->dirty = 1;
+
+    /* d17b_run flushes on a model switch, so this is the model to fold */
+    jit->d37c_mode = cpu->d37c_mode;
+}
+
+/* Switch the pages a block from code_used may reach between RW and RX */
+static bool protect_block(struct d17b_jit *jit, size_t from, bool write) {
+    size_t lo = from & ~(jit->page - 1);
+    size_t hi = (from + JIT_BLOCK_BYTES + jit->page - 1) & ~(jit->page - 1);
+    if (hi > JIT_CODE_SIZE) {
+        hi = JIT_CODE_SIZE;
+    }
+    int prot = write ? PROT_READ | PROT_WRITE : PROT_READ | PROT_EXEC;
+    return mprotect(jit->code + lo, hi - lo, prot) == 0;
+}
+
+void d17b_jit_invalidate(d17b_cpu_t *cpu, uint8_t channel, uint8_t sector) {
+    struct d17b_jit *jit = cpu->jit;
+
+    if (!jit->cover[channel][sector]) {
+        return;
+    }
+
+    /* The code bytes stay put until the next flush */
+    jit_block_t *b = jit->chain[channel];
+    while (b) {
+        jit_block_t *next = b->next_in_channel;
+        if ((b->slots[sector >> 6] >> (sector & 63)) & 1) {
+            unlink_block(jit, b);
+            jit->hot[channel][b->entry] = 0;
+        }
+        b = next;
+    }
+
+    jit->dirty = 1;
+}
+
+static jit_block_t *compile_block(d17b_cpu_t *cpu, uint8_t channel,
+                                  uint8_t sector, bool trace) {
+    struct d17b_jit *jit = cpu->jit;
+    jit_path_t path;
+
+    if (jit->nblocks == JIT_MAX_BLOCKS ||
+        jit->nentries + JIT_MAX_TRACE > JIT_MAX_ENTRIES ||
+        jit->code_used + JIT_BLOCK_BYTES > JIT_CODE_SIZE) {
+        d17b_jit_flush(cpu);
+    }
+
+    gather_path(cpu, channel, sector, trace, &path);
+    if (!protect_block(jit, jit->code_used, true)) {
+        return NULL;                    /* Interpret this one */
+    }
+
+    int n = path.n;
+    emit_t e = { jit->code + jit->code_used };
+    uint8_t *start = e.p;
+
+    emit_prologue(&e);
+    uint8_t *top = e.p;
+
+    for (int j = 0; j < n; j++) {
+        const d17b_decoded_t *d = &path.words[j];
+        uint32_t retired = (uint32_t)(j + 1);
+
+        switch (d->op) {
+            case DOP_NOP:
+            case DOP_TRA:               /* Followed, or the open end */
+                break;
+
+            case DOP_CLA:
+                emit_load_a(&e, d->operand * 4u);
+                break;
+
+            case DOP_ADD:
+            case DOP_SUB:
+                emit_load_eax(&e, d->operand * 4u);
+                emit_addsub(&e, d->op == DOP_SUB);
+                break;
+
+            case DOP_COM:
+                bn(&e, "\x41\x81\xF4", 3); b4(&e, SIGN_BIT);    /* xor r12d */
+                break;
+
+            case DOP_MIM:
+                bn(&e, "\x41\x81\xE4", 3); b4(&e, MAGNITUDE_MASK); /* and r12d */
+                bn(&e, "\x41\x81\xCC", 3); b4(&e, SIGN_BIT);       /* or r12d */
+                break;
+
+            case DOP_ANA:
+                bn(&e, "\x45\x21\xEC", 3);      /* and r12d, r13d */
+                break;
+
+            case DOP_ORA:
+                if (jit->d37c_mode) {
+                    bn(&e, "\x45\x09\xEC", 3);  /* or r12d, r13d */
+                }
+                break;
+
+            case DOP_ALS:
+                bn(&e, "\x41\xC1\xE4", 3); b1(&e, d->aux);       /* shl r12d */
+                bn(&e, "\x41\x81\xE4", 3); b4(&e, WORD_MASK);    /* and r12d */
+                break;
+
+            case DOP_ARS:
+                bn(&e, "\x41\xC1\xEC", 3); b1(&e, d->aux);       /* shr r12d */
+                break;
+
+            case DOP_STO:
+                emit_spill(&e);
+                bn(&e, "\x48\x89\xDF", 3);      /* mov rdi, rbx */
+                b1(&e, 0xBE); b4(&e, GET_CHANNEL(d->target));  /* mov esi */
+                b1(&e, 0xBA); b4(&e, GET_SECTOR(d->target));   /* mov edx */
+                bn(&e, "\x44\x89\xE1", 3);      /* mov ecx, r12d */
+                emit_call(&e, (const void *)d17b_write);
+                emit_reload(&e);                /* L may have been the target */
+                emit_dirty_exit(&e, jit, retired, d->next);
+                break;
+
+            case DOP_HPR:
+                bn(&e, "\xC6\x83", 2); b4(&e, OFF(halted)); b1(&e, 1);
+                emit_exit(&e, retired, true, d->next);
+                break;
+
+            case DOP_TMI:
+            case DOP_TMI_TZE: {
+                uint32_t mask = SIGN_BIT;
+                bool zero = false;
+                if (d->op == DOP_TMI_TZE && jit->d37c_mode) {
+                    mask = MAGNITUDE_MASK;
+                    zero = true;
+                }
+                if (path.taken[j] < 0) {
+                    emit_branch(&e, mask, zero, d, retired);
+                } else {
+                    emit_guard(&e, mask, zero, d, path.taken[j] != 0, retired);
+                }
+                break;
+            }
+
+            default:
+                emit_fallback(&e, jit, d, path.at[j], retired);
+                break;
+        }
+    }
+
+    if (path.loops) {
+        /*
+         * Go round again while another full trip fits under the limit,
+         * comparing what is left so a limit near UINT32_MAX cannot wrap
+         */
+        bn(&e, "\x41\x81\xC6", 3); b4(&e, (uint32_t)n);  /* add r14d, n */
+        bn(&e, "\x44\x89\xF8", 3);                       /* mov eax, r15d */
+        bn(&e, "\x44\x29\xF0", 3);                       /* sub eax, r14d */
+        b1(&e, 0x3D); b4(&e, (uint32_t)n);               /* cmp eax, n */
+        bn(&e, "\x0F\x83", 2);                           /* jae top */
+        b4(&e, (uint32_t)(top - (e.p + 4)));
+        emit_exit(&e, 0, true, path.end_i);
+    } else if (path.open) {
+        emit_exit(&e, (uint32_t)n, true, path.end_i);
+    }
+
+    /* Back to RX; failing that, earlier blocks on these pages cannot run */
+    if (!protect_block(jit, jit->code_used, false)) {
+        d17b_jit_flush(cpu);
+        return NULL;
+    }
+    jit->code_used += (size_t)(e.p - start);
+
+    const d17b_decoded_t *last = &path.words[n - 1];
+    jit_block_t *b = &jit->blocks[jit->nblocks++];
+    b->code = (jit_fn_t)(void *)start;
+    b->slots[0] = path.seen[0];
+    b->slots[1] = path.seen[1];
+    b->channel = channel;
+    b->entry = sector;
+    b->len = (uint8_t)n;
+    b->last = GET_SECTOR(path.at[n - 1]);
+    b->branch = is_conditional(last->op) && path.taken[n - 1] < 0;
+    b->taken_i = last->target;
+    b->trace = trace;
+
+    /* A trace replaces the basic block at its entry */
+    if (jit->map[channel][sector]) {
+        unlink_block(jit, jit->map[channel][sector]);
+    }
+    b->next_in_channel = jit->chain[channel];
+    jit->chain[channel] = b;
+    jit->map[channel][sector] = b;
+    for (int j = 0; j < n; j++) {
+        jit->cover[channel][GET_SECTOR(path.at[j])]++;
+    }
+
+    return b;
+}
+
+/* ============================================================================
+ * DISPATCHER
+ * ============================================================================ */
+
+int d17b_jit_run(d17b_cpu_t *cpu, uint64_t max_cycles) {
+    struct d17b_jit *jit = cpu->jit;
+    uint64_t budget = max_cycles;
+
+    while (!cpu->halted && budget > 0) {
+        uint8_t channel = GET_CHANNEL(cpu->I);
+        uint8_t sector = GET_SECTOR(cpu->I);
+        jit_block_t *b = NULL;
+
+        if (IS_DISC_CHANNEL(channel)) {
+            b = jit->map[channel][sector];
+            if (!b) {
+                b = compile_block(cpu, channel, sector, false);
+            } else if (!b->trace &&
+                       ++jit->hot[channel][sector] == JIT_HOT_THRESHOLD) {
+                b = compile_block(cpu, channel, sector, true);
+            }
+        }
+
+        /* Loop-channel code and budget tails go through the interpreter */
+        if (!b || b->len > budget) {
+            d17b_step(cpu);
+            budget--;
+        } else {
+            jit->dirty = 0;
+            uint32_t limit = budget > UINT32_MAX ? UINT32_MAX : (uint32_t)budget;
+            uint32_t retired = b->code(cpu, limit);
+
+            if (b->branch && retired == b->len) {
+                record_branch(jit, b, (uint16_t)cpu->I);
+            }
+
+            cpu->current_sector = (cpu->current_sector + retired) & 0x7F;
+            cpu->cycle_count += retired;
+            budget -= retired;
+        }
+
+        /* I/O and error stops, also checked after each event word inside */
+        if (cpu->run_stop && d17b_stop_pending(cpu)) {
+            break;
+        }
+    }
+
+    return cpu->halted ? -1 : 0;
+}
+
+bool d17b_jit_enable(d17b_cpu_t *cpu) {
+    if (!cpu->jit) {
+        struct d17b_jit *jit = calloc(1, sizeof(*jit));
+        if (!jit) {
+            return false;
+        }
+
+        /* RX a page at a time as code is written (protect_block) */
+        void *code = mmap(NULL, JIT_CODE_SIZE, PROT_READ | PROT_WRITE,
+                          MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (code == MAP_FAILED) {
+            free(jit);
+            return false;
+        }
+
+        jit->code = code;
+        jit->page = (size_t)sysconf(_SC_PAGESIZE);
+        jit->d37c_mode = cpu->d37c_mode;
+        cpu->jit = jit;
+    }
+
+    cpu->core = D17B_CORE_JIT;
+    return true;
+}
+
+void d17b_jit_disable(d17b_cpu_t *cpu) {
+    if (!cpu->jit) {
+        return;
+    }
+
+    munmap(cpu->jit->code, JIT_CODE_SIZE);
+    free(cpu->jit);
+    cpu->jit = NULL;
+
+    if (cpu->core == D17B_CORE_JIT) {
+        cpu->core = D17B_HAVE_THREADED ? D17B_CORE_THREADED : D17B_CORE_STEP;
+    }
+}
+
+#else
+
+bool d17b_jit_enable(d17b_cpu_t *cpu) {
+    (void)cpu;
+    return false;
+}
+
+void d17b_jit_disable(d17b_cpu_t *cpu) {
+    (void)cpu;
+}
+
+#endif
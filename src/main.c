@@ -5,9 +5,23 @@
  * Copyright 2025 Zane Hambly - Apache 2.0 License
  */
 
+#ifdef __linux__
+#define _GNU_SOURCE                 /* sched_setaffinity */
+#endif
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
+#ifndef _WIN32
+#include <fcntl.h>
+#include <poll.h>
+#include <sched.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
 #include "d17b.h"
 
 /*
@@ -68,13 +82,218 @@ static void load_test_program(d17b_cpu_t *cpu) {
     cpu->memory[0][6] = 0x000000;
 }
 
-/* Interactive mode */
+/* Load a looping benchmark program (runs until the cycle budget is spent) */
+static void load_bench_program(d17b_cpu_t *cpu) {
+    /*
+     * Channel 02 holds data:
+     *   Sector 000: 00000001   ; Increment
+     *   Sector 001: 00000000   ; Counter
+     *   Sector 002: 00000003   ; Scale factor
+     *   Sector 003: 00000000   ; Scratch
+     *
+     * Channel 01 holds a loop mixing the common instruction classes:
+     *   Sector 000: CLA 02,001 ; Counter            -> next=001
+     *   Sector 001: ADD 02,000 ; +1                 -> next=002
+     *   Sector 002: STO 02,001 ; Save counter       -> next=003
+     *   Sector 003: MPY 02,002 ; A:L = counter * 3  -> next=004
+     *   Sector 004: ALS 2      ; Shift left 2       -> next=005
+     *   Sector 005: SUB 02,002 ; -3                 -> next=006
+     *   Sector 006: COM        ; Flip sign          -> next=007
+     *   Sector 007: TMI 01,012 ; Negative?          -> next=010
+     *   Sector 010: ADD 02,002 ;                    -> next=011
+     *   Sector 011: TRA 01,000 ; Loop
+     *   Sector 012: STO 02,003 ;                    -> next=013
+     *   Sector 013: SAD 02,002 ;                    -> next=011
+     */
+    cpu->memory[2][0] = 1;
+    cpu->memory[2][1] = 0;
+    cpu->memory[2][2] = 3;
+    cpu->memory[2][3] = 0;
+
+    cpu->memory[1][0]  = ENCODE_INSTR(0x9, 0, 1, 2, 1);
+    cpu->memory[1][1]  = ENCODE_INSTR(0xD, 0, 2, 2, 0);
+    cpu->memory[1][2]  = ENCODE_INSTR(0xB, 0, 3, 2, 1);
+    cpu->memory[1][3]  = ENCODE_INSTR(0x5, 0, 4, 2, 2);
+    cpu->memory[1][4]  = ENCODE_INSTR(0x0, 0, 5, 0, (0x09 << 3) | 2);
+    cpu->memory[1][5]  = ENCODE_INSTR(0xF, 0, 6, 2, 2);
+    cpu->memory[1][6]  = ENCODE_INSTR(0x8, 0, 7, 0, 0x13 << 1);
+    cpu->memory[1][7]  = ENCODE_INSTR(0x6, 0, 8, 1, 10);
+    cpu->memory[1][8]  = ENCODE_INSTR(0xD, 0, 9, 2, 2);
+    cpu->memory[1][9]  = ENCODE_INSTR(0xA, 0, 0, 1, 0);
+    cpu->memory[1][10] = ENCODE_INSTR(0xB, 0, 11, 2, 3);
+    cpu->memory[1][11] = ENCODE_INSTR(0xC, 0, 9, 2, 2);
+
+    cpu->I = (1 << 9);  /* Start at 01,000 */
+}
+
+/* Architectural state comparison used to cross-check the cores */
+static bool same_state(const d17b_cpu_t *a, const d17b_cpu_t *b) {
+    return a->A == b->A && a->L == b->L && a->I == b->I &&
+           a->cycle_count == b->cycle_count &&
+           a->current_sector == b->current_sector &&
+           a->halted == b->halted &&
+           memcmp(a->memory, b->memory, sizeof(a->memory)) == 0;
+}
+
+/* Time one core on the benchmark program, returns instructions/second */
+static double bench_core(d17b_cpu_t *cpu, d17b_core_t core, uint64_t cycles) {
+    d17b_init(cpu);
+    if (core == D17B_CORE_JIT && !d17b_jit_enable(cpu)) {
+        return -1.0;
+    }
+    load_bench_program(cpu);
+    cpu->core = core;
+
+    clock_t start = clock();
+    d17b_run(cpu, cycles);
+    double secs = (double)(clock() - start) / CLOCKS_PER_SEC;
+
+    return secs > 0 ? (double)cpu->cycle_count / secs : 0.0;
+}
+
+#ifndef _WIN32
+/*
+ * The step core with a blocking trace into /dev/null. Wall time, as
+ * clock() would add in the drain thread's time.
+ */
+static double bench_traced(d17b_cpu_t *cpu, uint64_t cycles,
+                           d17b_trace_format_t format) {
+    struct timespec t0, t1;
+    d17b_init(cpu);
+    load_bench_program(cpu);
+    if (!d17b_trace_start(cpu, "/dev/null", 0, D17B_TRACE_BLOCK, format)) {
+        return -1.0;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    d17b_run(cpu, cycles);
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    d17b_trace_stop(cpu, NULL);
+
+    double secs = (double)(t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) / 1e9;
+    return secs > 0 ? (double)cpu->cycle_count / secs : 0.0;
+}
+#endif
+
+/* Compare the execution cores on the same drum image */
+static int run_bench(uint64_t cycles) {
+    static d17b_cpu_t ref;
+
+    printf("D17B Emulator - Core Benchmark\n");
+    printf("==============================\n\n");
+    printf("Cycles per core: %llu\n\n", (unsigned long long)cycles);
+
+    double step_ips = bench_core(&ref, D17B_CORE_STEP, cycles);
+    printf("step core:      %8.2f M instr/s\n", step_ips / 1e6);
+
+#ifndef _WIN32
+    static d17b_cpu_t traced;
+    double traced_ips = bench_traced(&traced, cycles, D17B_TRACE_RAW);
+    if (traced_ips > 0 && step_ips > 0) {
+        printf("traced step:    %8.2f M instr/s  (%+.2f ns/instr)\n",
+               traced_ips / 1e6, 1e9 / traced_ips - 1e9 / step_ips);
+    }
+    if (!same_state(&traced, &ref)) {
+        printf("\n*** CORE MISMATCH ***\n");
+        return 1;
+    }
+    traced_ips = bench_traced(&traced, cycles, D17B_TRACE_PACKED);
+    if (traced_ips > 0 && step_ips > 0) {
+        printf("packed trace:   %8.2f M instr/s  (%+.2f ns/instr)\n",
+               traced_ips / 1e6, 1e9 / traced_ips - 1e9 / step_ips);
+    }
+    if (!same_state(&traced, &ref)) {
+        printf("\n*** CORE MISMATCH ***\n");
+        return 1;
+    }
+#endif
+
+#if D17B_HAVE_THREADED
+    static d17b_cpu_t cpu;
+    double threaded_ips = bench_core(&cpu, D17B_CORE_THREADED, cycles);
+    printf("threaded core:  %8.2f M instr/s  (%.2fx)\n",
+           threaded_ips / 1e6, step_ips > 0 ? threaded_ips / step_ips : 0.0);
+
+    if (!same_state(&cpu, &ref)) {
+        printf("\n*** CORE MISMATCH ***\n");
+        return 1;
+    }
+#else
+    printf("threaded core:  not built\n");
+#endif
+
+    static d17b_cpu_t jit;
+    double jit_ips = bench_core(&jit, D17B_CORE_JIT, cycles);
+    if (jit_ips >= 0) {
+        printf("jit core:       %8.2f M instr/s  (%.2fx)\n",
+               jit_ips / 1e6, step_ips > 0 ? jit_ips / step_ips : 0.0);
+        d17b_jit_disable(&jit);
+
+        if (!same_state(&jit, &ref)) {
+            printf("\n*** CORE MISMATCH ***\n");
+            return 1;
+        }
+    } else {
+        printf("jit core:       not built\n");
+    }
+
+    /* Same program across an ensemble, each lane's counter perturbed */
+    static d17b_cpu_t image, lane;
+    const uint32_t lanes = 64;
+    d17b_init(&image);
+    load_bench_program(&image);
+    for (int packed = 0; packed < 2; packed++) {
+        d17b_ensemble_t *ens = packed ? d17b_ensemble_create_packed(&image, lanes)
+                                      : d17b_ensemble_create(&image, lanes);
+        if (!ens) {
+            printf("\n*** ENSEMBLE ALLOCATION FAILED ***\n");
+            return 1;
+        }
+        for (uint32_t i = 0; i < lanes; i++) {
+            d17b_ensemble_write(ens, i, 2, 1, i * 1000);
+        }
+
+        clock_t start = clock();
+        uint64_t retired = d17b_ensemble_run(ens, cycles / lanes);
+        double secs = (double)(clock() - start) / CLOCKS_PER_SEC;
+        double ens_ips = secs > 0 ? (double)retired / secs : 0.0;
+        printf("ensemble x%-3u%s %8.2f M instr/s  (%.2fx)\n", lanes,
+               packed ? "p" : " ", ens_ips / 1e6,
+               step_ips > 0 ? ens_ips / step_ips : 0.0);
+
+        d17b_init(&lane);
+        d17b_ensemble_store(ens, lanes - 1, &lane);
+        d17b_ensemble_free(ens);
+        bench_core(&ref, D17B_CORE_STEP, 0);
+        ref.memory[2][1] = (lanes - 1) * 1000;
+        d17b_run(&ref, cycles / lanes);
+        if (!same_state(&lane, &ref)) {
+            printf("\n*** ENSEMBLE MISMATCH ***\n");
+            return 1;
+        }
+    }
+
+    printf("\nFinal states match.\n");
+    return 0;
+}
+
+/* Interactive mode; S and R go back through a history of checkpoints */
+#define HISTORY_BYTES       (16u << 20)
+
 static void run_interactive(d17b_cpu_t *cpu) {
     char cmd[256];
     char disasm[64];
 
+    d17b_history_t *history = d17b_history_create(cpu, HISTORY_BYTES);
+    if (!history) {
+        fprintf(stderr, "Out of memory for history\n");
+        return;
+    }
+
     printf("D17B Emulator - Interactive Mode\n");
-    printf("Commands: s(tep), r(un), d(ump), q(uit), l(oad addr), m(emory addr)\n\n");
+    printf("Commands: s(tep), r(un [n]), b(reak ch sec), d(ump), p(rofile), q(uit), l(oad addr), m(emory addr)\n");
+    printf("          S (step back [n]), R (run back to a breakpoint), h(eat [a|f|r|w [file]])\n");
+    printf("          T (toggle timing), w (worst waits [n]), t (trace [file [z]])\n\n");
 
     while (1) {
         /* Show current instruction */
@@ -90,18 +309,62 @@ static void run_interactive(d17b_cpu_t *cpu) {
 
         switch (cmd[0]) {
             case 's':  /* Step */
-                d17b_step(cpu);
+                d17b_history_step(history, cpu);
                 if (cpu->halted) {
                     printf("*** HALTED ***\n");
                 }
                 break;
 
             case 'r':  /* Run */
-                printf("Running...\n");
-                d17b_run(cpu, 10000);
-                if (cpu->halted) {
-                    printf("*** HALTED after %llu cycles ***\n",
+                {
+                    unsigned long long n = 10000;
+                    uint64_t retired;
+                    sscanf(cmd + 1, "%llu", &n);
+                    printf("Running...\n");
+                    d17b_exit_t why = d17b_history_run(history, cpu, n,
+                                                       D17B_STOP_BREAKPOINT,
+                                                       &retired);
+                    if (why == D17B_EXIT_HALT) {
+                        printf("*** HALTED after %llu cycles ***\n",
+                               (unsigned long long)cpu->cycle_count);
+                    } else if (why == D17B_EXIT_BREAKPOINT) {
+                        printf("*** BREAKPOINT after %llu instructions ***\n",
+                               (unsigned long long)retired);
+                    }
+                }
+                break;
+
+            case 'S':  /* Step back */
+                {
+                    unsigned int n = 1;
+                    sscanf(cmd + 1, "%u", &n);
+                    if (!d17b_history_step_back(history, cpu, n)) {
+                        printf("*** START OF HISTORY ***\n");
+                    }
+                    printf("At cycle %llu\n",
+                           (unsigned long long)cpu->cycle_count);
+                }
+                break;
+
+            case 'R':  /* Run back to the previous breakpoint */
+                if (d17b_history_continue_back(history, cpu)) {
+                    printf("*** BREAKPOINT at cycle %llu ***\n",
                            (unsigned long long)cpu->cycle_count);
+                } else {
+                    printf("*** START OF HISTORY ***\n");
+                }
+                break;
+
+            case 'b':  /* Toggle breakpoint */
+                {
+                    unsigned int ch, sec;
+                    if (sscanf(cmd + 1, "%o %o", &ch, &sec) == 2 &&
+                        ch < CHANNELS && sec < SECTORS) {
+                        bool on = !((cpu->breakpoints[ch][sec >> 6] >> (sec & 63)) & 1);
+                        d17b_set_breakpoint(cpu, ch, sec, on);
+                        printf("Breakpoint [%02o:%03o] %s\n", ch, sec,
+                               on ? "set" : "cleared");
+                    }
                 }
                 break;
 
@@ -109,11 +372,63 @@ static void run_interactive(d17b_cpu_t *cpu) {
                 d17b_dump_state(cpu);
                 break;
 
+            case 'p':  /* Operation profile */
+                d17b_dump_op_counts(cpu);
+                break;
+
+            case 'w':  /* Worst rotational waits */
+                {
+                    unsigned int n = 10;
+                    sscanf(cmd + 1, "%u", &n);
+                    d17b_dump_latency(cpu, n);
+                }
+                break;
+
+            case 't':  /* Trace to a file (z: packed), or stop tracing */
+                {
+                    char path[200], packed = 0;
+                    if (sscanf(cmd + 1, "%199s %c", path, &packed) >= 1) {
+                        d17b_trace_format_t format = packed == 'z'
+                            ? D17B_TRACE_PACKED : D17B_TRACE_RAW;
+                        printf(d17b_trace_start(cpu, path, 0, D17B_TRACE_BLOCK, format)
+                               ? "Tracing to %s\n" : "Cannot trace to %s\n", path);
+                    } else if (cpu->trace) {
+                        bool ok = d17b_trace_stop(cpu, NULL);
+                        printf("Trace %s\n", ok ? "closed" : "write failed");
+                    }
+                }
+                break;
+
+            case 'T':  /* Toggle rotational timing */
+                cpu->timing = !cpu->timing;
+                d17b_history_mark(history, cpu);
+                printf("Timing %s\n", cpu->timing ? "on" : "off");
+                break;
+
+            case 'h':  /* Sector heat map, or save it */
+                {
+                    char which = 'a', path[200];
+                    d17b_heat_kind_t kind = D17B_HEAT_ALL;
+                    int got = sscanf(cmd + 1, " %c %199s", &which, path);
+                    if (which == 'f') kind = D17B_HEAT_FETCH;
+                    if (which == 'r') kind = D17B_HEAT_READ;
+                    if (which == 'w') kind = D17B_HEAT_WRITE;
+                    if (got < 2) {
+                        d17b_dump_heat(cpu, kind);
+                    } else if (d17b_heat_save(cpu, kind, path)) {
+                        printf("Saved %s\n", path);
+                    } else {
+                        printf("Cannot save %s\n", path);
+                    }
+                }
+                break;
+
             case 'l':  /* Load address */
                 {
                     unsigned int addr;
                     if (sscanf(cmd + 1, "%o", &addr) == 1) {
                         cpu->I = addr << 2;
+                        d17b_history_mark(history, cpu);
                         printf("Set I to %08o\n", cpu->I);
                     }
                 }
@@ -133,6 +448,8 @@ static void run_interactive(d17b_cpu_t *cpu) {
 
             case 'q':
                 printf("Goodbye.\n");
+                d17b_trace_stop(cpu, NULL);
+                d17b_history_free(history);
                 return;
 
             case '\n':
@@ -143,11 +460,509 @@ static void run_interactive(d17b_cpu_t *cpu) {
                 break;
         }
     }
+    d17b_trace_stop(cpu, NULL);
+    d17b_history_free(history);
+}
+
+/*
+ * Fork server. The program is booted once to a fork point, then every
+ * scenario on the input runs in a child forked from that state, so the
+ * common prefix is shared copy-on-write by the OS instead of re-run.
+ * Children send back a fixed-size record over a pipe (one write, under
+ * PIPE_BUF), which the server prints as it arrives. A scenario is a line
+ * of octal assignments: "CC:SSS=word" for a disc word, "da=" and "db="
+ * for the discrete inputs and "det=" for the detector.
+ */
+#ifndef _WIN32
+#define FORK_BAD_SCENARIO   UINT32_MAX
+
+typedef struct {
+    uint32_t index;
+    uint32_t exit;                  /* d17b_exit_t, or FORK_BAD_SCENARIO */
+    uint64_t cycles;
+    uint32_t A, L, I;
+    uint32_t discrete_out_a;
+} fork_result_t;
+
+static const char *const exit_names[] = {
+    "budget", "halt", "breakpoint", "io", "error"
+};
+
+static bool apply_scenario(d17b_cpu_t *cpu, char *line) {
+    for (char *tok = strtok(line, " \t\r\n"); tok;
+         tok = strtok(NULL, " \t\r\n")) {
+        unsigned int ch, sec, value;
+        if (sscanf(tok, "%o:%o=%o", &ch, &sec, &value) == 3 &&
+            ch < CHANNELS && sec < SECTORS) {
+            d17b_write(cpu, ch, sec, value);
+        } else if (sscanf(tok, "da=%o", &value) == 1) {
+            d17b_input(cpu, D17B_EV_DISCRETE_A, 0, value);
+        } else if (sscanf(tok, "db=%o", &value) == 1) {
+            d17b_input(cpu, D17B_EV_DISCRETE_B, 0, value);
+        } else if (sscanf(tok, "det=%o", &value) == 1) {
+            d17b_input(cpu, D17B_EV_DETECTOR, 0, value);
+        } else {
+            return false;
+        }
+    }
+    return true;
+}
+
+static void scenario_result(d17b_cpu_t *cpu, char *line, uint32_t index,
+                            uint64_t cycles, fork_result_t *r) {
+    uint64_t retired;
+
+    memset(r, 0, sizeof(*r));
+    r->index = index;
+    if (apply_scenario(cpu, line)) {
+        r->exit = d17b_run_until(cpu, cycles, 0, &retired);
+    } else {
+        r->exit = FORK_BAD_SCENARIO;
+    }
+    r->cycles = cpu->cycle_count;
+    r->A = cpu->A;
+    r->L = cpu->L;
+    r->I = cpu->I;
+    r->discrete_out_a = cpu->discrete_out_a;
+}
+
+/* Child side: runs in the forked copy, never returns */
+static void run_scenario(d17b_cpu_t *cpu, char *line, uint32_t index,
+                         uint64_t cycles, int fd) {
+    fork_result_t r;
+    scenario_result(cpu, line, index, cycles, &r);
+
+    ssize_t n = write(fd, &r, sizeof(r));
+    _exit(n == (ssize_t)sizeof(r) ? 0 : 1);
+}
+
+static void report_scenario(FILE *out, uint32_t index, const fork_result_t *r,
+                            int status) {
+    if (!r) {
+        fprintf(out, "%u crashed status=%d\n", index, status);
+    } else if (r->exit == FORK_BAD_SCENARIO) {
+        fprintf(out, "%u bad-scenario\n", index);
+    } else {
+        fprintf(out, "%u %s cycles=%llu A=%08o L=%08o I=%08o DOA=%08o\n",
+                index, exit_names[r->exit], (unsigned long long)r->cycles,
+                r->A, r->L, r->I, r->discrete_out_a);
+    }
+    fflush(out);
+}
+
+/* Fork up to 'jobs' scenarios at a time from cpu, print results as they end */
+static int run_fork_server(d17b_cpu_t *cpu, FILE *in, FILE *out,
+                           uint64_t cycles, unsigned int jobs) {
+    struct pollfd *pfd = calloc(jobs, sizeof(*pfd));
+    pid_t *pid = calloc(jobs, sizeof(*pid));
+    uint32_t *slot_index = calloc(jobs, sizeof(*slot_index));
+    uint32_t index = 0;
+    unsigned int active = 0;
+    bool eof = false;
+    char line[1024];
+
+    if (!pfd || !pid || !slot_index) {
+        free(pfd);
+        free(pid);
+        free(slot_index);
+        return 1;
+    }
+
+    d17b_clear_breakpoints(cpu);
+    fflush(out);
+
+    while (!eof || active) {
+        /* Keep 'jobs' children running while there are scenarios */
+        while (!eof && active < jobs) {
+            if (!fgets(line, sizeof(line), in)) {
+                eof = true;
+                break;
+            }
+            if (line[0] == '#' || line[strspn(line, " \t\r\n")] == '\0') {
+                continue;
+            }
+
+            int fds[2];
+            if (pipe(fds) != 0) {
+                eof = true;
+                break;
+            }
+            pid_t child = fork();
+            if (child == 0) {
+                close(fds[0]);
+                run_scenario(cpu, line, index, cycles, fds[1]);
+            }
+            close(fds[1]);
+            if (child < 0) {
+                close(fds[0]);
+                eof = true;
+                break;
+            }
+            pfd[active].fd = fds[0];
+            pfd[active].events = POLLIN;
+            pid[active] = child;
+            slot_index[active] = index++;
+            active++;
+        }
+        if (active == 0) {
+            break;
+        }
+
+        if (poll(pfd, active, -1) < 0) {
+            continue;                       /* EINTR */
+        }
+        for (unsigned int i = active; i-- > 0; ) {
+            if (!pfd[i].revents) {
+                continue;
+            }
+            fork_result_t r;
+            int status = 0;
+            ssize_t n = read(pfd[i].fd, &r, sizeof(r));
+            close(pfd[i].fd);
+            waitpid(pid[i], &status, 0);
+            report_scenario(out, slot_index[i],
+                            n == (ssize_t)sizeof(r) ? &r : NULL, status);
+
+            active--;
+            pfd[i] = pfd[active];
+            pid[i] = pid[active];
+            slot_index[i] = slot_index[active];
+        }
+    }
+
+    free(pfd);
+    free(pid);
+    free(slot_index);
+    return 0;
+}
+
+/*
+ * Sharded campaign runner. The scenarios are dealt round-robin to a
+ * fixed set of worker processes forked from the booted state, each
+ * pinned to its own processor where the host allows it. A worker runs
+ * its shard scenario by scenario from a copy of that state, with its
+ * own copy of the pending events, and publishes each result into its
+ * own single-producer ring in a POSIX shared memory segment, which the
+ * launcher drains, prints and totals. Rings are per worker and results
+ * are in shard order, so when a worker dies the launcher still holds
+ * everything it finished: it reports the scenario in hand as crashed
+ * and starts a fresh worker on the rest.
+ */
+#define SHARD_RING          256
+
+typedef struct {
+    uint32_t head;                  /* Records published (worker) */
+    uint32_t tail;                  /* Records taken (launcher) */
+    fork_result_t rec[SHARD_RING];
+} shard_ring_t;
+
+typedef struct {
+    uint32_t count[5];              /* By d17b_exit_t */
+    uint32_t bad;
+    uint32_t crashed;
+    uint64_t cycles;
+} shard_totals_t;
+
+/* Worker side: runs shard positions from 'start' on, never returns */
+static void shard_worker(const d17b_cpu_t *boot, char **line, uint32_t count,
+                         uint32_t shards, uint32_t shard, uint32_t start,
+                         shard_ring_t *ring, uint64_t cycles) {
+    static d17b_cpu_t cpu;
+    char buf[1024];
+
+#ifdef __linux__
+    long online = sysconf(_SC_NPROCESSORS_ONLN);
+    if (online > 0) {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(shard % (uint32_t)online, &set);
+        sched_setaffinity(0, sizeof(set), &set);
+    }
+#endif
+
+    for (uint32_t i = shard + start * shards; i < count; i += shards) {
+        fork_result_t r;
+        memcpy(&cpu, boot, sizeof(cpu));
+        cpu.sched = NULL;
+        if (!d17b_sched_copy(&cpu, boot)) {
+            _exit(1);
+        }
+        snprintf(buf, sizeof(buf), "%s", line[i]);
+        scenario_result(&cpu, buf, i, cycles, &r);
+        d17b_sched_clear(&cpu);
+
+        uint32_t head = ring->head;
+        while (head - __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE) ==
+               SHARD_RING) {
+            sched_yield();
+        }
+        ring->rec[head % SHARD_RING] = r;
+        __atomic_store_n(&ring->head, head + 1, __ATOMIC_RELEASE);
+    }
+    _exit(0);
+}
+
+static pid_t shard_spawn(const d17b_cpu_t *boot, char **line, uint32_t count,
+                         uint32_t shards, uint32_t shard, uint32_t start,
+                         shard_ring_t *ring, uint64_t cycles) {
+    pid_t child = fork();
+    if (child == 0) {
+        shard_worker(boot, line, count, shards, shard, start, ring, cycles);
+    }
+    return child;
+}
+
+/* A shard that cannot go on: report the rest of it from 'next' as lost */
+static uint32_t shard_abandon(FILE *out, uint32_t next, uint32_t count,
+                              uint32_t shards, int status) {
+    uint32_t lost = 0;
+    for (; next < count; next += shards, lost++) {
+        report_scenario(out, next, NULL, status);
+    }
+    return lost;
+}
+
+/* Take what a worker has published; returns the number taken */
+static uint32_t shard_drain(FILE *out, shard_ring_t *ring, shard_totals_t *t) {
+    uint32_t tail = ring->tail;
+    uint32_t head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+    uint32_t taken = head - tail;
+
+    for (; tail != head; tail++) {
+        const fork_result_t *r = &ring->rec[tail % SHARD_RING];
+        report_scenario(out, r->index, r, 0);
+        if (r->exit == FORK_BAD_SCENARIO) {
+            t->bad++;
+        } else {
+            t->count[r->exit]++;
+            t->cycles += r->cycles;
+        }
+    }
+    __atomic_store_n(&ring->tail, tail, __ATOMIC_RELEASE);
+    return taken;
+}
+
+/* Run stdin's scenarios over 'shards' pinned workers, print and total */
+static int run_shards(const d17b_cpu_t *cpu, FILE *in, FILE *out,
+                      uint64_t cycles, uint32_t shards) {
+    char **line = NULL;
+    uint32_t count = 0, capacity = 0;
+    char buf[1024];
+    int status = 1;
+
+    /* Workers copy the cpu, which cannot share these */
+    if (cpu->jit || cpu->record || cpu->replay || cpu->trace) {
+        fprintf(stderr, "Cannot shard a cpu with a JIT, input log or trace\n");
+        return 1;
+    }
+
+    while (fgets(buf, sizeof(buf), in)) {
+        if (buf[0] == '#' || buf[strspn(buf, " \t\r\n")] == '\0') {
+            continue;
+        }
+        if (count == capacity) {
+            capacity = capacity ? capacity * 2 : 256;
+            char **grown = realloc(line, capacity * sizeof(*line));
+            if (!grown) {
+                goto out;
+            }
+            line = grown;
+        }
+        if (!(line[count] = strdup(buf))) {
+            goto out;
+        }
+        count++;
+    }
+
+    /* The segment is unlinked at once; the mapping lives on in the workers */
+    char name[64];
+    snprintf(name, sizeof(name), "/d17b-shards-%ld", (long)getpid());
+    size_t bytes = shards * sizeof(shard_ring_t);
+    int fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0600);
+    if (fd < 0) {
+        goto out;
+    }
+    shm_unlink(name);
+    shard_ring_t *ring = ftruncate(fd, (off_t)bytes) == 0
+        ? mmap(NULL, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0)
+        : MAP_FAILED;
+    close(fd);
+    if (ring == MAP_FAILED) {
+        goto out;
+    }
+
+    pid_t *pid = calloc(shards, sizeof(*pid));
+    uint32_t *done = calloc(shards, sizeof(*done));
+    shard_totals_t totals;
+    memset(&totals, 0, sizeof(totals));
+    if (!pid || !done) {
+        free(pid);
+        free(done);
+        munmap(ring, bytes);
+        goto out;
+    }
+
+    fflush(out);
+    uint32_t running = 0;
+    for (uint32_t s = 0; s < shards && s < count; s++) {
+        pid[s] = shard_spawn(cpu, line, count, shards, s, 0, &ring[s], cycles);
+        if (pid[s] > 0) {
+            running++;
+        } else {
+            totals.crashed += shard_abandon(out, s, count, shards, -1);
+        }
+    }
+
+    while (running) {
+        bool progress = false;
+        for (uint32_t s = 0; s < shards; s++) {
+            done[s] += shard_drain(out, &ring[s], &totals);
+            if (pid[s] <= 0) {
+                continue;
+            }
+
+            int ws;
+            if (waitpid(pid[s], &ws, WNOHANG) != pid[s]) {
+                continue;
+            }
+            progress = true;
+            done[s] += shard_drain(out, &ring[s], &totals);
+
+            /* Short of the end of its shard: the next one killed it */
+            uint32_t next = s + done[s] * shards;
+            pid[s] = 0;
+            if (next < count) {
+                report_scenario(out, next, NULL, ws);
+                totals.crashed++;
+                done[s]++;
+                if (next + shards < count) {
+                    pid[s] = shard_spawn(cpu, line, count, shards, s, done[s],
+                                         &ring[s], cycles);
+                    if (pid[s] < 0) {
+                        totals.crashed += shard_abandon(out, next + shards,
+                                                        count, shards, -1);
+                    }
+                }
+            }
+            running -= pid[s] <= 0;
+        }
+        if (!progress) {
+            usleep(200);
+        }
+    }
+
+    fprintf(out, "# %u scenarios:", count);
+    for (int i = 0; i < 5; i++) {
+        fprintf(out, " %s=%u", exit_names[i], totals.count[i]);
+    }
+    fprintf(out, " bad=%u crashed=%u cycles=%llu\n", totals.bad, totals.crashed,
+            (unsigned long long)totals.cycles);
+    fflush(out);
+
+    free(pid);
+    free(done);
+    munmap(ring, bytes);
+    status = 0;
+out:
+    for (uint32_t i = 0; i < count; i++) {
+        free(line[i]);
+    }
+    free(line);
+    return status;
+}
+
+/* The benchmark program, or the machine saved in a snapshot file */
+static bool boot_from(d17b_cpu_t *cpu, const char *snapshot) {
+    d17b_init(cpu);
+    if (!snapshot) {
+        load_bench_program(cpu);
+        return true;
+    }
+    return d17b_load_state(cpu, snapshot);
+}
+
+/* Run to "CC:SSS" (octal, reached from the next word on) or a cycle count */
+static bool boot_to(d17b_cpu_t *cpu, const char *point) {
+    unsigned int ch, sec;
+    uint64_t retired;
+
+    if (sscanf(point, "%o:%o", &ch, &sec) == 2) {
+        if (ch >= CHANNELS || sec >= SECTORS) {
+            return false;
+        }
+        d17b_set_breakpoint(cpu, ch, sec, true);
+        return d17b_run_until(cpu, UINT64_MAX, D17B_STOP_BREAKPOINT,
+                              &retired) == D17B_EXIT_BREAKPOINT;
+    }
+    d17b_run_until(cpu, strtoull(point, NULL, 10), 0, &retired);
+    return !cpu->halted;
+}
+
+/* Sharding test: an event that kills the worker running one scenario */
+static void crash_scenario(d17b_cpu_t *cpu, void *user) {
+    if (cpu->memory[2][1] == *(const uint32_t *)user) {
+        raise(SIGKILL);
+    }
+}
+#endif
+
+/* Periodic event callback for the scheduler test */
+typedef struct {
+    uint32_t fired;
+    uint32_t late;                  /* Firings not on a 1000-word boundary */
+} tick_log_t;
+
+static void log_tick(d17b_cpu_t *cpu, void *user) {
+    tick_log_t *log = user;
+    log->fired++;
+    if (cpu->cycle_count % 1000) {
+        log->late++;
+    }
+}
+
+/* Scheduler test: a callback that replaces every event with its next firing */
+static void restart_events(d17b_cpu_t *cpu, void *user) {
+    tick_log_t *log = user;
+    d17b_sched_clear(cpu);
+    if (++log->fired < 5) {
+        d17b_event_t again = { .when = cpu->cycle_count + 100,
+                               .kind = D17B_EV_CALL, .fn = restart_events,
+                               .user = log };
+        d17b_schedule(cpu, &again);
+    }
+}
+
+/* Batch test: generated countdowns, reduced per worker */
+#define BATCH_WORKERS 4
+
+typedef struct {
+    const d17b_cpu_t *image;
+    uint64_t words[BATCH_WORKERS];
+    uint32_t halted[BATCH_WORKERS];
+} batch_log_t;
+
+static uint32_t batch_count(uint32_t index) {
+    return 20 + (index * index * 97) % 3000;
+}
+
+static void batch_setup(d17b_cpu_t *cpu, uint32_t index, void *user) {
+    batch_log_t *log = user;
+    memcpy(cpu->memory, log->image->memory, sizeof(cpu->memory));
+    cpu->memory[4][1] = batch_count(index);
+    cpu->I = log->image->I;
+}
+
+static void batch_finish(d17b_cpu_t *cpu, uint32_t index, d17b_exit_t why,
+                         uint32_t worker, void *user) {
+    batch_log_t *log = user;
+    (void)index;
+    log->words[worker] += cpu->cycle_count;
+    log->halted[worker] += why == D17B_EXIT_HALT;
 }
 
 /* Simple automated test */
 static int run_test(void) {
-    d17b_cpu_t cpu;
+    static d17b_cpu_t cpu;
 
     printf("D17B Emulator - Automated Test\n");
     printf("===============================\n\n");
@@ -251,36 +1066,1360 @@ static int run_test(void) {
         return 1;
     }
 
-    printf("\n=== ALL TESTS PASSED ===\n");
-    return 0;
-}
+    /* The same decoded word must follow a model switch */
+    printf("\n=== MODEL SWITCH TEST ===\n");
+    printf("Testing: sub-op 26 re-run as D17B SRL 1 on 0x800001\n\n");
 
-int main(int argc, char *argv[]) {
-    printf("\n");
-    printf("  ╔═══════════════════════════════════════════════════════╗\n");
-    printf("  ║   D17B/D37C MINUTEMAN GUIDANCE COMPUTER EMULATOR      ║\n");
-    printf("  ║                                                       ║\n");
-    printf("  ║   D17B: Minuteman I (1962) - 39 instructions          ║\n");
-    printf("  ║   D37C: Minuteman II/III (1965) - 57 instructions     ║\n");
-    printf("  ║                                                       ║\n");
-    printf("  ║   400 nuclear missiles still fly on this code         ║\n");
-    printf("  ╚═══════════════════════════════════════════════════════╝\n");
-    printf("\n");
+    cpu.d37c_mode = false;
+    cpu.A = 0x800001;
+    cpu.I = 0;
+    d17b_step(&cpu);
+    cpu.d37c_mode = true;
 
-    if (argc > 1 && strcmp(argv[1], "-i") == 0) {
-        /* Interactive mode */
-        d17b_cpu_t cpu;
-        d17b_init(&cpu);
-        load_test_program(&cpu);
-        run_interactive(&cpu);
-        return 0;
-    } else if (argc > 1 && strcmp(argv[1], "-t") == 0) {
-        /* Test mode */
-        return run_test();
+    printf("After SRL 1: A = 0x%06X (expected 0x800002)\n", cpu.A);
+
+    if (cpu.A == 0x800002) {
+        printf("*** MODEL SWITCH TEST PASSED ***\n");
+    } else {
+        printf("*** MODEL SWITCH TEST FAILED ***\n");
+        return 1;
+    }
+
+    /* Decoded instruction cache must notice stores into code */
+    printf("\n=== DECODE CACHE TEST ===\n");
+    printf("Testing: rewrite ADD as SUB after it has been decoded\n\n");
+
+    d17b_reset(&cpu);
+    load_test_program(&cpu);
+    d17b_run(&cpu, 1000);
+
+    d17b_write(&cpu, 0, 2, ENCODE_INSTR(0xF, 0, 4, 0, 3));  /* SUB 00,003 */
+    cpu.I = 0;
+    cpu.halted = false;
+    d17b_run(&cpu, 1000);
+
+    printf("After rewrite: [00:006] = %08o (expected 00000002)\n",
+           cpu.memory[0][6]);
+
+    if (cpu.memory[0][6] == 2) {
+        printf("*** DECODE CACHE TEST PASSED ***\n");
+    } else {
+        printf("*** DECODE CACHE TEST FAILED ***\n");
+        return 1;
+    }
+
+    /* d17b_run_until must say why it stopped and how far it got */
+    printf("\n=== RUN UNTIL TEST ===\n");
+    printf("Testing: breakpoint, halt, I/O and budget exits\n\n");
+
+    d17b_reset(&cpu);
+    load_test_program(&cpu);
+    d17b_set_breakpoint(&cpu, 0, 4, true);   /* STO 00,006 */
+
+    uint64_t n1, n2, n3, n4;
+    d17b_exit_t r1 = d17b_run_until(&cpu, 1000, D17B_STOP_BREAKPOINT, &n1);
+    d17b_exit_t r2 = d17b_run_until(&cpu, 1000, D17B_STOP_BREAKPOINT, &n2);
+    d17b_clear_breakpoints(&cpu);
+
+    /* CLA, DOA, TRA back: an output every third word */
+    d17b_reset(&cpu);
+    cpu.memory[5][0] = ENCODE_INSTR(0x9, 0, 1, 5, 3);           /* CLA 05,003 */
+    cpu.memory[5][1] = ENCODE_INSTR(0x8, 0, 2, 0, 0x0B << 1);   /* DOA */
+    cpu.memory[5][2] = ENCODE_INSTR(0xA, 0, 0, 5, 0);           /* TRA 05,000 */
+    cpu.memory[5][3] = 0x1234;
+    cpu.I = (5 << 9);
+    d17b_exit_t r3 = d17b_run_until(&cpu, 1000, D17B_STOP_IO, &n3);
+    d17b_exit_t r4 = d17b_run_until(&cpu, 1000, 0, &n4);
+
+    printf("breakpoint: reason %d after %llu, halt: reason %d after %llu\n",
+           r1, (unsigned long long)n1, r2, (unsigned long long)n2);
+    printf("output:     reason %d after %llu, budget: reason %d after %llu\n",
+           r3, (unsigned long long)n3, r4, (unsigned long long)n4);
+
+    if (r1 == D17B_EXIT_BREAKPOINT && n1 == 2 && r2 == D17B_EXIT_HALT &&
+        n2 == 2 && cpu.discrete_out_a == 0x1234 &&
+        r3 == D17B_EXIT_IO && n3 == 2 && r4 == D17B_EXIT_BUDGET && n4 == 1000) {
+        printf("*** RUN UNTIL TEST PASSED ***\n");
+    } else {
+        printf("*** RUN UNTIL TEST FAILED ***\n");
+        return 1;
+    }
+
+    /*
+     * Rotational timing on the add program. CLA and ADD find their
+     * operands in the next sector (2 word times each), STO 00,006 from
+     * sector 004 waits one, and HPR at 005 has just gone past the head
+     * so it waits 126: 2 + 2 + 3 + 127 = 134 word times, 127 waiting.
+     */
+    printf("\n=== DISC TIMING TEST ===\n");
+    printf("Testing: word times for 5 + 3 with rotational latency\n\n");
+
+    d17b_reset(&cpu);
+    load_test_program(&cpu);
+    cpu.timing = true;
+    d17b_run(&cpu, 1000);
+    cpu.timing = false;
+
+    printf("Cycles = %llu, waiting = %llu (expected 134, 127)\n",
+           (unsigned long long)cpu.cycle_count,
+           (unsigned long long)cpu.latency_cycles);
+
+    if (cpu.cycle_count == 134 && cpu.latency_cycles == 127 &&
+        cpu.current_sector == 6 && cpu.memory[0][6] == 8) {
+        printf("*** DISC TIMING TEST PASSED ***\n");
+    } else {
+        printf("*** DISC TIMING TEST FAILED ***\n");
+        return 1;
+    }
+
+    /* Every execution core must agree with the d17b_step reference */
+    printf("\n=== CORE EQUIVALENCE TEST ===\n");
+    printf("Testing: benchmark loop, 100000 cycles per core\n\n");
+
+    static d17b_cpu_t ref, other;
+    bench_core(&ref, D17B_CORE_STEP, 100000);
+
+    const d17b_core_t cores[] = { D17B_CORE_THREADED, D17B_CORE_JIT };
+    const char *core_names[] = { "threaded", "jit" };
+    for (int i = 0; i < 2; i++) {
+        if (bench_core(&other, cores[i], 100000) < 0) {
+            printf("%-9s not built\n", core_names[i]);
+            continue;
+        }
+        bool match = same_state(&other, &ref);
+        d17b_jit_disable(&other);
+        printf("%-9s %s\n", core_names[i], match ? "matches" : "DIFFERS");
+        if (!match) {
+            printf("*** CORE EQUIVALENCE TEST FAILED ***\n");
+            return 1;
+        }
+    }
+    printf("*** CORE EQUIVALENCE TEST PASSED ***\n");
+
+    /* A hot loop becomes a trace; its exit branch must leave it cleanly */
+    printf("\n=== TRACE SIDE EXIT TEST ===\n");
+    printf("Testing: count 500 down to -1, then halt\n\n");
+
+    bool traced = false;
+    for (int i = 0; i < 2; i++) {
+        d17b_cpu_t *c = i ? &other : &ref;
+        d17b_init(c);
+        if (i && !(traced = d17b_jit_enable(c))) {
+            printf("jit       not built\n");
+            break;
+        }
+        c->memory[4][0] = 1;
+        c->memory[4][1] = 500;
+        c->memory[3][0] = ENCODE_INSTR(0x9, 0, 1, 4, 1);    /* CLA 04,001 */
+        c->memory[3][1] = ENCODE_INSTR(0xF, 0, 2, 4, 0);    /* SUB 04,000 */
+        c->memory[3][2] = ENCODE_INSTR(0xB, 0, 3, 4, 1);    /* STO 04,001 */
+        c->memory[3][3] = ENCODE_INSTR(0x6, 0, 4, 3, 5);    /* TMI 03,005 */
+        c->memory[3][4] = ENCODE_INSTR(0xA, 0, 0, 3, 0);    /* TRA 03,000 */
+        c->memory[3][5] = ENCODE_INSTR(0x8, 0, 6, 0, 18);   /* HPR */
+        c->I = (3 << 9);
+        d17b_run(c, 10000);
+    }
+    d17b_jit_disable(&other);
+
+    printf("Counter = %08o, cycles = %llu (expected 40000001, 2505)\n",
+           ref.memory[4][1], (unsigned long long)ref.cycle_count);
+
+    if (ref.memory[4][1] == (SIGN_BIT | 1) && ref.cycle_count == 2505 &&
+        ref.halted && (!traced || same_state(&other, &ref))) {
+        printf("*** TRACE SIDE EXIT TEST PASSED ***\n");
+    } else {
+        printf("*** TRACE SIDE EXIT TEST FAILED ***\n");
+        return 1;
+    }
+
+    /*
+     * The CLA/DOA/TRA loop from the run until test, well past the point
+     * where the JIT turns it into a looping trace: every output must
+     * still end the run. A trace that runs to its limit must stop there
+     * even when the limit is the largest it takes.
+     */
+    printf("\n=== JIT STOP TEST ===\n");
+    printf("Testing: I/O and budget stops inside a looping trace\n\n");
+
+    d17b_init(&other);
+    bool jit_stop_ok = true;
+    if (d17b_jit_enable(&other)) {
+        other.memory[5][0] = ENCODE_INSTR(0x9, 0, 1, 5, 3);           /* CLA 05,003 */
+        other.memory[5][1] = ENCODE_INSTR(0x8, 0, 2, 0, 0x0B << 1);   /* DOA */
+        other.memory[5][2] = ENCODE_INSTR(0xA, 0, 0, 5, 0);           /* TRA 05,000 */
+        other.memory[5][3] = 0x1234;
+        other.I = (5 << 9);
+        uint64_t most = 0;
+        for (int i = 0; i < 200 && jit_stop_ok; i++) {
+            uint64_t n = 0;
+            jit_stop_ok = d17b_run_until(&other, 1000000, D17B_STOP_IO, &n) ==
+                          D17B_EXIT_IO && n <= 3;
+            most = n > most ? n : most;
+        }
+        d17b_jit_disable(&other);
+        printf("200 runs, at most %llu words each (expected 3)\n",
+               (unsigned long long)most);
+        jit_stop_ok = jit_stop_ok && most == 3;
+
+        /* A budget past 2^32 words: the trace's limit is clamped to 32 bits */
+        d17b_init(&other);
+        d17b_jit_enable(&other);
+        other.memory[5][0] = ENCODE_INSTR(0xA, 0, 1, 5, 1);           /* TRA 05,001 */
+        other.memory[5][1] = ENCODE_INSTR(0xA, 0, 0, 5, 0);           /* TRA 05,000 */
+        other.I = (5 << 9);
+        uint64_t long_run = (1ULL << 32) + 1000;
+        d17b_run_until(&other, long_run, 0, NULL);
+        d17b_jit_disable(&other);
+        printf("Run of 2^32 + 1000 words: %llu\n",
+               (unsigned long long)other.cycle_count);
+        jit_stop_ok = jit_stop_ok && other.cycle_count == long_run;
+    } else {
+        printf("jit       not built\n");
+    }
+
+    if (jit_stop_ok) {
+        printf("*** JIT STOP TEST PASSED ***\n");
+    } else {
+        printf("*** JIT STOP TEST FAILED ***\n");
+        return 1;
+    }
+
+    /*
+     * Events 300, 70000 and every 1000 word times out land on all three
+     * wheel levels. A DIA/TRA polling loop runs 80500 words with the fine
+     * countdown going; each core must see the same inputs at the same time.
+     */
+    printf("\n=== EVENT SCHEDULER TEST ===\n");
+    printf("Testing: detector, discrete input and periodic events\n\n");
+
+    const d17b_core_t ev_cores[] = { D17B_CORE_STEP, D17B_CORE_THREADED };
+    for (int i = 0; i < 2; i++) {
+        tick_log_t log = { 0, 0 };
+        d17b_event_t det = { .when = 300, .kind = D17B_EV_DETECTOR, .value = 1 };
+        d17b_event_t dia = { .when = 70000, .kind = D17B_EV_DISCRETE_A,
+                             .value = 0x55 };
+        d17b_event_t tick = { .when = 1000, .period = 1000,
+                              .kind = D17B_EV_CALL, .fn = log_tick,
+                              .user = &log };
+
+        d17b_init(&cpu);
+        cpu.core = ev_cores[i];
+        cpu.memory[5][0] = ENCODE_INSTR(0x8, 0, 1, 0, 0x15 << 1);  /* DIA */
+        cpu.memory[5][1] = ENCODE_INSTR(0xA, 0, 0, 5, 0);          /* TRA 05,000 */
+        cpu.I = (5 << 9);
+        cpu.countdown_enabled = true;
+        cpu.fine_countdown = 90000;
+        d17b_schedule(&cpu, &det);
+        d17b_schedule(&cpu, &dia);
+        d17b_schedule(&cpu, &tick);
+
+        d17b_run(&cpu, 80500);
+
+        printf("%-9s ticks = %u (late %u), A = %o, detector = %d, "
+               "countdown = %u\n", i ? "threaded" : "step", log.fired,
+               log.late, cpu.A, cpu.detector, cpu.fine_countdown);
+
+        bool ok = log.fired == 80 && log.late == 0 && cpu.A == 0x55 &&
+                  cpu.detector && cpu.fine_countdown == 9500 &&
+                  d17b_events_pending(&cpu) == 1;
+        d17b_sched_clear(&cpu);
+        if (!ok) {
+            printf("*** EVENT SCHEDULER TEST FAILED ***\n");
+            return 1;
+        }
+    }
+
+    /*
+     * A callback that clears the events and schedules new ones: the rest
+     * of its slot (the detector event) goes with the old scheduler.
+     */
+    tick_log_t restarts = { 0, 0 };
+    d17b_event_t restart = { .when = 50, .kind = D17B_EV_CALL,
+                             .fn = restart_events, .user = &restarts };
+    d17b_event_t dropped = { .when = 50, .kind = D17B_EV_DETECTOR, .value = 1 };
+    d17b_init(&cpu);
+    d17b_schedule(&cpu, &restart);
+    d17b_schedule(&cpu, &dropped);
+    cpu.memory[5][0] = ENCODE_INSTR(0xA, 0, 0, 5, 0);              /* TRA 05,000 */
+    cpu.I = (5 << 9);
+    d17b_run(&cpu, 1000);
+    printf("restarting callback fired %u times, detector = %d\n",
+           restarts.fired, cpu.detector);
+    if (restarts.fired != 5 || cpu.detector || d17b_events_pending(&cpu) != 0) {
+        printf("*** EVENT SCHEDULER TEST FAILED ***\n");
+        return 1;
+    }
+    printf("*** EVENT SCHEDULER TEST PASSED ***\n");
+
+    /*
+     * DIA/TMI/TRA polls discrete input A, which goes negative at word
+     * time 5000000; the poll then halts. Fast-forward must land on the
+     * same state as running it out, then wait out the HPR until a
+     * proceed at 5500000 lets CLA and a second HPR run.
+     */
+    printf("\n=== IDLE FAST-FORWARD TEST ===\n");
+    printf("Testing: polling loop and HPR skipped to the next event\n\n");
+
+    for (int i = 0; i < 2; i++) {
+        d17b_cpu_t *c = i ? &other : &ref;
+        d17b_event_t in = { .when = 5000000, .kind = D17B_EV_DISCRETE_A,
+                            .value = SIGN_BIT | 1 };
+        d17b_init(c);
+        c->memory[6][0] = ENCODE_INSTR(0x8, 0, 1, 0, 0x15 << 1);   /* DIA */
+        c->memory[6][1] = ENCODE_INSTR(0x6, 0, 2, 6, 3);           /* TMI 06,003 */
+        c->memory[6][2] = ENCODE_INSTR(0xA, 0, 0, 6, 0);           /* TRA 06,000 */
+        c->memory[6][3] = ENCODE_INSTR(0x8, 0, 4, 0, 18);          /* HPR */
+        c->memory[6][4] = ENCODE_INSTR(0x9, 0, 5, 6, 8);           /* CLA 06,010 */
+        c->memory[6][5] = ENCODE_INSTR(0x8, 0, 6, 0, 18);          /* HPR */
+        c->memory[6][8] = 0x777;
+        c->I = (6 << 9);
+        c->countdown_enabled = true;
+        c->fine_countdown = 5200000;
+        c->fast_forward = i;
+        d17b_schedule(c, &in);
+        d17b_run(c, 6000000);
+    }
+
+    bool ff_same = same_state(&other, &ref) &&
+                   other.fine_countdown == ref.fine_countdown;
+    uint64_t polled = other.idle_cycles;
+
+    d17b_event_t go = { .when = 5500000, .kind = D17B_EV_PROCEED };
+    d17b_schedule(&other, &go);
+    d17b_exit_t ff_why = d17b_run_until(&other, 1000000, 0, NULL);
+
+    printf("poll: cycles = %llu, skipped %llu, %s\n",
+           (unsigned long long)ref.cycle_count, (unsigned long long)polled,
+           ff_same ? "matches" : "DIFFERS");
+    printf("hpr:  cycles = %llu, A = %o (expected 5500002, 3567)\n",
+           (unsigned long long)other.cycle_count, other.A);
+
+    if (ff_same && ref.cycle_count == 5000004 && ref.fine_countdown == 199996 &&
+        polled > 4900000 && ff_why == D17B_EXIT_HALT &&
+        other.cycle_count == 5500002 && other.A == 0x777 &&
+        other.fine_countdown == 0) {
+        printf("*** IDLE FAST-FORWARD TEST PASSED ***\n");
+    } else {
+        printf("*** IDLE FAST-FORWARD TEST FAILED ***\n");
+        return 1;
+    }
+
+    /*
+     * The countdown loop again across 37 lanes, each starting from its
+     * own count, so lanes split at TMI, leave through DOA (a scalar
+     * fallback) and HPR at different times, or run out of budget. Every
+     * lane must end exactly as a lone d17b_run would.
+     */
+    printf("\n=== ENSEMBLE TEST ===\n");
+    printf("Testing: 37 perturbed lanes, plain and packed, against the step core\n\n");
+
+    d17b_init(&ref);
+    ref.memory[4][0] = 1;
+    ref.memory[3][0] = ENCODE_INSTR(0x9, 0, 1, 4, 1);      /* CLA 04,001 */
+    ref.memory[3][1] = ENCODE_INSTR(0xF, 0, 2, 4, 0);      /* SUB 04,000 */
+    ref.memory[3][2] = ENCODE_INSTR(0xB, 0, 3, 4, 1);      /* STO 04,001 */
+    ref.memory[3][3] = ENCODE_INSTR(0x6, 0, 4, 3, 5);      /* TMI 03,005 */
+    ref.memory[3][4] = ENCODE_INSTR(0xA, 0, 0, 3, 0);      /* TRA 03,000 */
+    ref.memory[3][5] = ENCODE_INSTR(0x8, 0, 6, 0, 0x0B << 1);  /* DOA */
+    ref.memory[3][6] = ENCODE_INSTR(0x8, 0, 7, 0, 18);     /* HPR */
+    ref.I = (3 << 9);
+
+    const uint32_t ens_lanes = 37;
+    uint64_t ens_retired[2], ref_retired = 0;
+    uint32_t ens_halted = 0, ens_bad = 0;
+    for (int packed = 0; packed < 2; packed++) {
+        d17b_ensemble_t *ens = packed
+                               ? d17b_ensemble_create_packed(&ref, ens_lanes)
+                               : d17b_ensemble_create(&ref, ens_lanes);
+        if (!ens) {
+            printf("*** ENSEMBLE TEST FAILED: no memory ***\n");
+            return 1;
+        }
+        for (uint32_t i = 0; i < ens_lanes; i++) {
+            d17b_ensemble_write(ens, i, 4, 1, 100 + 13 * i);
+        }
+        ens_retired[packed] = d17b_ensemble_run(ens, 2000);
+
+        ref_retired = 0;
+        ens_halted = 0;
+        for (uint32_t i = 0; i < ens_lanes; i++) {
+            d17b_init(&other);
+            memcpy(other.memory, ref.memory, sizeof(ref.memory));
+            other.memory[4][1] = 100 + 13 * i;
+            other.I = ref.I;
+            d17b_run(&other, 2000);
+            ref_retired += other.cycle_count;
+            ens_halted += other.halted;
+
+            d17b_init(&cpu);
+            d17b_ensemble_store(ens, i, &cpu);
+            if (!same_state(&cpu, &other) ||
+                cpu.discrete_out_a != other.discrete_out_a) {
+                ens_bad++;
+            }
+        }
+        d17b_ensemble_free(ens);
+    }
+
+    printf("%u lanes halted, %u differ, %llu/%llu words retired "
+           "(expected %llu)\n", ens_halted, ens_bad,
+           (unsigned long long)ens_retired[0],
+           (unsigned long long)ens_retired[1],
+           (unsigned long long)ref_retired);
+
+    if (ens_bad == 0 && ens_retired[0] == ref_retired &&
+        ens_retired[1] == ref_retired && ens_halted > 0 &&
+        ens_halted < ens_lanes) {
+        printf("*** ENSEMBLE TEST PASSED ***\n");
+    } else {
+        printf("*** ENSEMBLE TEST FAILED ***\n");
+        return 1;
+    }
+
+    printf("\n=== BATCH RUNNER TEST ===\n");
+    printf("Testing: uneven instances on a work-stealing pool\n\n");
+
+    /* ref still holds the ensemble countdown */
+    const uint32_t batch_n = 96;
+    d17b_cpu_t *batch = malloc(batch_n * sizeof(d17b_cpu_t));
+    if (!batch) {
+        printf("*** BATCH RUNNER TEST FAILED: no memory ***\n");
+        return 1;
+    }
+    batch_log_t blog;
+    memset(&blog, 0, sizeof(blog));
+    blog.image = &ref;
+    d17b_batch_t bopt = { BATCH_WORKERS, 10000, 256, 0, NULL, NULL, &blog };
+    for (uint32_t i = 0; i < batch_n; i++) {
+        d17b_init(&batch[i]);
+        batch_setup(&batch[i], i, &blog);
+    }
+    int vec_workers = d17b_batch_run(batch, batch_n, &bopt);
+
+    bopt.setup = batch_setup;
+    bopt.finish = batch_finish;
+    int gen_workers = d17b_batch_run(NULL, batch_n, &bopt);
+
+    uint32_t batch_bad = 0, seq_halted = 0, gen_halted = 0;
+    uint64_t seq_words = 0, gen_words = 0;
+    for (uint32_t i = 0; i < batch_n; i++) {
+        d17b_init(&other);
+        batch_setup(&other, i, &blog);
+        d17b_run(&other, 10000);
+        seq_words += other.cycle_count;
+        seq_halted += other.halted;
+        batch_bad += !same_state(&batch[i], &other);
+    }
+    for (uint32_t w = 0; w < BATCH_WORKERS; w++) {
+        gen_words += blog.words[w];
+        gen_halted += blog.halted[w];
+    }
+    free(batch);
+
+    printf("%d/%d workers, %u vector results differ, %u halted, "
+           "%llu words (expected %u, %llu)\n",
+           vec_workers, gen_workers, batch_bad, gen_halted,
+           (unsigned long long)gen_words, seq_halted,
+           (unsigned long long)seq_words);
+
+    if (vec_workers > 0 && gen_workers > 0 && batch_bad == 0 &&
+        gen_words == seq_words && gen_halted == seq_halted &&
+        seq_halted > 0 && seq_halted < batch_n) {
+        printf("*** BATCH RUNNER TEST PASSED ***\n");
+    } else {
+        printf("*** BATCH RUNNER TEST FAILED ***\n");
+        return 1;
+    }
+
+    printf("\n=== SHARED IMAGE TEST ===\n");
+    printf("Testing: copy-on-write instances of one drum image\n\n");
+
+    const uint32_t inst_n = 500;
+    d17b_image_t *image = d17b_image_create(&ref);
+    d17b_instance_t **inst = calloc(inst_n, sizeof(*inst));
+    if (!image || !inst) {
+        printf("*** SHARED IMAGE TEST FAILED: no memory ***\n");
+        return 1;
+    }
+    uint32_t inst_pages = 0;
+    for (uint32_t i = 0; i < inst_n; i++) {
+        d17b_init(&other);
+        memcpy(other.memory, ref.memory, sizeof(ref.memory));
+        other.I = ref.I;
+        inst[i] = d17b_instance_create(image, &other);
+        if (!inst[i] || d17b_instance_pages(inst[i]) != 0 ||
+            !d17b_instance_write(inst[i], 4, 1, batch_count(i))) {
+            printf("*** SHARED IMAGE TEST FAILED: no memory ***\n");
+            return 1;
+        }
+    }
+    int inst_workers = d17b_batch_run_instances(inst, inst_n, &bopt);
+
+    uint32_t inst_bad = 0;
+    d17b_init(&cpu);
+    for (uint32_t i = 0; i < inst_n; i++) {
+        d17b_init(&other);
+        batch_setup(&other, i, &blog);
+        d17b_run(&other, 10000);
+        d17b_instance_attach(&cpu, inst[i]);
+        inst_bad += !same_state(&cpu, &other) ||
+                    d17b_instance_read(inst[i], 4, 1) != other.memory[4][1];
+        d17b_instance_detach(&cpu, inst[i]);
+        inst_pages += d17b_instance_pages(inst[i]);
+        d17b_instance_free(inst[i]);
+    }
+    /* The image itself still matches the drum it was made from */
+    d17b_instance_t *probe = d17b_instance_create(image, &ref);
+    bool base_kept = probe && d17b_instance_pages(probe) == 0;
+    d17b_instance_free(probe);
+    free(inst);
+    d17b_image_free(image);
+
+    printf("%d workers, %u instances differ, %u private channels\n",
+           inst_workers, inst_bad, inst_pages);
+
+    if (inst_workers > 0 && inst_bad == 0 && inst_pages == inst_n &&
+        base_kept) {
+        printf("*** SHARED IMAGE TEST PASSED ***\n");
+    } else {
+        printf("*** SHARED IMAGE TEST FAILED ***\n");
+        return 1;
+    }
+
+    printf("\n=== SNAPSHOT TEST ===\n");
+    printf("Testing: save, restore and resume against an unbroken run\n\n");
+
+    const char *snap_path = "d17b_test.snap";
+    d17b_init(&cpu);
+    load_bench_program(&cpu);
+    cpu.countdown_enabled = true;
+    cpu.fine_countdown = 50000;
+    cpu.discrete_in_a = 0x123456;
+    d17b_run(&cpu, 12345);
+    bool saved = d17b_save_state(&cpu, snap_path);
+    d17b_run(&cpu, 20000);
+
+    d17b_init(&other);
+    bool loaded = d17b_load_state(&other, snap_path);
+    d17b_run(&other, 20000);
+    bool resumed = same_state(&cpu, &other) &&
+                   other.fine_countdown == cpu.fine_countdown &&
+                   other.discrete_in_a == cpu.discrete_in_a;
+
+    /* A flipped bit anywhere in the payload is caught */
+    bool rejected = false;
+    FILE *sf = fopen(snap_path, "r+b");
+    if (sf) {
+        fseek(sf, 32 + 4 * 128 + 4 * 300, SEEK_SET);
+        fputc(0x40, sf);
+        fclose(sf);
+        rejected = !d17b_load_state(&other, snap_path);
+    }
+    remove(snap_path);
+
+    printf("Saved %s, loaded %s, resumed %s, corruption %s\n",
+           saved ? "yes" : "no", loaded ? "yes" : "no",
+           resumed ? "matches" : "differs",
+           rejected ? "rejected" : "accepted");
+
+    if (saved && loaded && resumed && rejected) {
+        printf("*** SNAPSHOT TEST PASSED ***\n");
+    } else {
+        printf("*** SNAPSHOT TEST FAILED ***\n");
+        return 1;
+    }
+
+    printf("\n=== DELTA SNAPSHOT TEST ===\n");
+    printf("Testing: a chain of deltas restores to an unbroken run\n\n");
+
+    uint8_t *full = malloc(d17b_state_size());
+    uint8_t *delta = malloc(d17b_state_size() + 4096);
+    size_t delta_len = 0;
+    bool chained = false, out_of_order = false;
+    if (full && delta) {
+        d17b_init(&cpu);
+        load_bench_program(&cpu);
+        d17b_run(&cpu, 5000);
+        d17b_state_encode(&cpu, full);
+        d17b_run(&cpu, 7000);
+        delta_len = d17b_delta_encode(&cpu, delta);
+        d17b_run(&cpu, 9000);
+        bool saved_delta = d17b_save_delta(&cpu, snap_path);
+
+        /* The second delta does not apply to the full snapshot alone */
+        d17b_init(&other);
+        out_of_order = d17b_state_decode(&other, full, d17b_state_size()) &&
+                       !d17b_load_state(&other, snap_path);
+        chained = saved_delta && d17b_delta_apply(&other, delta, delta_len) &&
+                  d17b_load_state(&other, snap_path);
+
+        /* A word poked directly, then flushed, must be in the next delta */
+        cpu.memory[6][5] = 01234567;
+        d17b_flush_decode(&cpu);
+        size_t poke_len = d17b_delta_size(&cpu) <= d17b_state_size() + 4096
+            ? d17b_delta_encode(&cpu, delta) : 0;
+        chained = chained && poke_len > 0 &&
+                  d17b_delta_apply(&other, delta, poke_len) &&
+                  other.memory[6][5] == 01234567;
+        d17b_run(&cpu, 3000);
+        d17b_run(&other, 3000);
+        chained = chained && same_state(&cpu, &other);
+        remove(snap_path);
+    }
+    free(full);
+    free(delta);
+
+    printf("Full %zu bytes, delta %zu bytes, chain %s, out of order %s\n",
+           d17b_state_size(), delta_len, chained ? "matches" : "differs",
+           out_of_order ? "rejected" : "accepted");
+
+    if (chained && out_of_order && delta_len > 0 &&
+        delta_len < d17b_state_size() / 8) {
+        printf("*** DELTA SNAPSHOT TEST PASSED ***\n");
+    } else {
+        printf("*** DELTA SNAPSHOT TEST FAILED ***\n");
+        return 1;
+    }
+
+    printf("\n=== REVERSE EXECUTION TEST ===\n");
+    printf("Testing: step and run back against unbroken runs\n\n");
+
+    /* A budget of 8 checkpoints over 2M words forces several thinnings */
+    const uint64_t rev_run = 2000000;
+    d17b_init(&cpu);
+    load_bench_program(&cpu);
+    d17b_history_t *history = d17b_history_create(&cpu, 8 * d17b_state_size());
+    bool rev_ok = history != NULL;
+    uint64_t last_hit = UINT64_MAX;
+    if (rev_ok) {
+        d17b_history_run(history, &cpu, rev_run, 0, NULL);
+        rev_ok = d17b_history_step_back(history, &cpu, 1) &&
+                 cpu.cycle_count == rev_run - 1;
+        rev_ok = rev_ok && d17b_history_step_back(history, &cpu, 1000) &&
+                 cpu.cycle_count == rev_run - 1001;
+
+        d17b_init(&other);
+        load_bench_program(&other);
+        d17b_run(&other, rev_run - 1001);
+        rev_ok = rev_ok && same_state(&cpu, &other);
+
+        /* The last visit to 01:000 before here, found by stepping */
+        d17b_init(&other);
+        load_bench_program(&other);
+        d17b_set_breakpoint(&cpu, 1, 0, true);
+        while (other.cycle_count < cpu.cycle_count) {
+            if (other.I == (1 << 9)) {
+                last_hit = other.cycle_count;
+            }
+            d17b_step(&other);
+        }
+        rev_ok = rev_ok && d17b_history_continue_back(history, &cpu) &&
+                 cpu.cycle_count == last_hit;
+
+        /* 01:012 is never reached, so the search runs back to the start */
+        d17b_clear_breakpoints(&cpu);
+        d17b_set_breakpoint(&cpu, 1, 10, true);
+        rev_ok = rev_ok && !d17b_history_continue_back(history, &cpu) &&
+                 cpu.cycle_count == 0;
+        rev_ok = rev_ok && d17b_history_checkpoints(history) <= 8;
+    }
+
+    printf("Interval %llu words, %u checkpoints, last breakpoint at %llu\n",
+           history ? (unsigned long long)d17b_history_interval(history) : 0ULL,
+           history ? d17b_history_checkpoints(history) : 0,
+           (unsigned long long)last_hit);
+    d17b_history_free(history);
+
+    /*
+     * DIA/ADD/STO sums discrete input A, which an event sets between the
+     * checkpoints at 8192 and 12288; a periodic V loop event runs past
+     * the end. Going back must replay the input and keep the events.
+     */
+    for (int i = 0; i < 2; i++) {
+        d17b_cpu_t *c = i ? &other : &cpu;
+        d17b_event_t dia = { .when = 9000, .kind = D17B_EV_DISCRETE_A, .value = 3 };
+        d17b_event_t vin = { .when = 10, .period = 37, .kind = D17B_EV_V_LOOP,
+                             .value = 1 };
+        d17b_init(c);
+        c->memory[7][0] = ENCODE_INSTR(0x8, 0, 1, 0, 0x15 << 1);   /* DIA */
+        c->memory[7][1] = ENCODE_INSTR(0xD, 0, 2, 7, 8);           /* ADD 07,010 */
+        c->memory[7][2] = ENCODE_INSTR(0xB, 0, 3, 7, 8);           /* STO 07,010 */
+        c->memory[7][3] = ENCODE_INSTR(0xA, 0, 0, 7, 0);           /* TRA 07,000 */
+        c->I = (7 << 9);
+        d17b_schedule(c, &dia);
+        d17b_schedule(c, &vin);
+    }
+    /* Recorded throughout: the re-runs going back must not log inputs again */
+    const char *rev_log = "d17b_test_rev.rlog";
+    bool rev_recorded = d17b_record_start(&cpu, rev_log);
+    history = d17b_history_create(&cpu, 8 * d17b_state_size());
+    rev_ok = rev_ok && history != NULL && rev_recorded;
+    if (history) {
+        d17b_history_run(history, &cpu, 10000, 0, NULL);
+        rev_ok = rev_ok && d17b_history_step_back(history, &cpu, 1) &&
+                 cpu.cycle_count == 9999;
+        d17b_run(&other, 9999);
+        rev_ok = rev_ok && same_state(&cpu, &other) && cpu.V[0] == other.V[0] &&
+                 cpu.memory[7][8] != 0 &&
+                 d17b_events_pending(&cpu) == d17b_events_pending(&other);
+        printf("Back to 9999 past an input: sum %o (expected %o)\n",
+               cpu.memory[7][8], other.memory[7][8]);
+
+        d17b_history_run(history, &cpu, 5000, 0, NULL);
+        d17b_run(&other, 5000);
+        rev_ok = rev_ok && same_state(&cpu, &other) && cpu.V[0] == other.V[0];
+    }
+    d17b_history_free(history);
+    rev_ok = d17b_record_stop(&cpu) && rev_ok;
+    d17b_sched_clear(&cpu);
+    d17b_sched_clear(&other);
+
+    /* The log, replayed into the same program without events */
+    d17b_init(&ref);
+    memcpy(ref.memory[7], other.memory[7], 4 * sizeof(ref.memory[7][0]));
+    ref.I = (7 << 9);
+    rev_ok = rev_ok && d17b_replay_start(&ref, rev_log);
+    d17b_run(&ref, cpu.cycle_count);
+    rev_ok = rev_ok && same_state(&ref, &cpu) && ref.V[0] == cpu.V[0];
+    printf("Recorded across the step back: replay %s (V0 %o, expected %o)\n",
+           same_state(&ref, &cpu) && ref.V[0] == cpu.V[0] ? "matches" : "DIFFERS",
+           ref.V[0], cpu.V[0]);
+    d17b_replay_stop(&ref);
+    d17b_sched_clear(&ref);
+    remove(rev_log);
+
+    if (rev_ok) {
+        printf("*** REVERSE EXECUTION TEST PASSED ***\n");
+    } else {
+        printf("*** REVERSE EXECUTION TEST FAILED ***\n");
+        return 1;
+    }
+
+    /*
+     * DIA/ADD/STO sums discrete input A into 07:010 every four words, so
+     * the drum depends on exactly when each input changed. The host sets
+     * inputs between runs of odd lengths while a periodic event feeds the
+     * V loop; a replay on the step core must end bit for bit the same.
+     */
+    printf("\n=== INPUT REPLAY TEST ===\n");
+    printf("Testing: recorded inputs fed back at the same word times\n\n");
+
+    const char *log_path = "d17b_test.rlog";
+    uint64_t rng = 12345;
+    for (int i = 0; i < 2; i++) {
+        d17b_cpu_t *c = i ? &other : &cpu;
+        d17b_init(c);
+        c->memory[7][0] = ENCODE_INSTR(0x8, 0, 1, 0, 0x15 << 1);   /* DIA */
+        c->memory[7][1] = ENCODE_INSTR(0xD, 0, 2, 7, 8);           /* ADD 07,010 */
+        c->memory[7][2] = ENCODE_INSTR(0xB, 0, 3, 7, 8);           /* STO 07,010 */
+        c->memory[7][3] = ENCODE_INSTR(0xA, 0, 0, 7, 0);           /* TRA 07,000 */
+        c->I = (7 << 9);
+        c->core = i ? D17B_CORE_STEP : c->core;
+    }
+
+    bool recorded = d17b_record_start(&cpu, log_path);
+    d17b_event_t vin = { .when = 10, .period = 37, .kind = D17B_EV_V_LOOP,
+                         .index = 1, .value = 1 };
+    d17b_schedule(&cpu, &vin);
+    for (int i = 0; i < 200; i++) {
+        rng = rng * 6364136223846793005ULL + 1442695040888963407ULL;
+        d17b_run_until(&cpu, 1 + (rng >> 33) % 5000, 0, NULL);
+        d17b_input(&cpu, D17B_EV_DISCRETE_A, 0, (uint32_t)(rng >> 40) & 0x3);
+        if (i % 7 == 0) {
+            d17b_input(&cpu, D17B_EV_DETECTOR, 0, i % 2);
+            d17b_input(&cpu, D17B_EV_R_LOOP, (uint8_t)(i & 3), (uint32_t)rng);
+        }
+    }
+    recorded = d17b_record_stop(&cpu) && recorded;
+    d17b_sched_clear(&cpu);
+
+    /* Under a history, so it can go back to the start once the log ends */
+    bool replayed = d17b_replay_start(&other, log_path);
+    d17b_history_t *replay_history = d17b_history_create(&other, 1 << 20);
+    replayed = replayed && replay_history != NULL;
+    bool rewound = false;
+    for (int pass = 0; pass < 2 && replay_history; pass++) {
+        d17b_history_run(replay_history, &other, cpu.cycle_count, 0, NULL);
+        bool same = other.replay != NULL && d17b_events_pending(&other) == 0 &&
+                    same_state(&cpu, &other) &&
+                    memcmp(cpu.V, other.V, sizeof(cpu.V)) == 0 &&
+                    memcmp(cpu.R, other.R, sizeof(cpu.R)) == 0 &&
+                    cpu.detector == other.detector &&
+                    cpu.discrete_in_a == other.discrete_in_a;
+        if (pass == 0) {
+            replayed = replayed && same;
+            d17b_history_continue_back(replay_history, &other);
+            rewound = other.cycle_count == 0;
+        } else {
+            rewound = rewound && same;
+        }
+    }
+    d17b_history_free(replay_history);
+    d17b_replay_stop(&other);
+    d17b_sched_clear(&other);
+    remove(log_path);
+
+    printf("%llu words, sum %o, V1 %o, replay %s, again from the start %s\n",
+           (unsigned long long)cpu.cycle_count, cpu.memory[7][8], cpu.V[1],
+           replayed ? "matches" : "DIFFERS", rewound ? "matches" : "DIFFERS");
+
+    if (recorded && replayed && rewound) {
+        printf("*** INPUT REPLAY TEST PASSED ***\n");
+    } else {
+        printf("*** INPUT REPLAY TEST FAILED ***\n");
+        return 1;
+    }
+
+    /*
+     * The DIA/ADD/STO/TRA loop retires each operation equally often. With
+     * timing on, the counted word times must add up to the cycles run.
+     */
+    printf("\n=== OPERATION PROFILE TEST ===\n");
+    printf("Testing: retirements and word times per operation\n\n");
+
+    d17b_op_count_t counts[D17B_PROFILE_OPS];
+    uint32_t n_ops;
+    bool prof_ok;
+    cpu.I = (7 << 9);
+    cpu.halted = false;
+    d17b_op_counts_clear(&cpu);
+    d17b_run_until(&cpu, 4000, 0, NULL);
+    n_ops = d17b_op_counts(&cpu, counts, D17B_PROFILE_OPS);
+#ifdef D17B_PROFILE
+    {
+        prof_ok = n_ops == 4;
+        for (uint32_t i = 0; i < n_ops; i++) {
+            prof_ok = prof_ok && counts[i].retired == 1000 &&
+                      counts[i].word_times == 1000;
+        }
+
+        cpu.timing = true;
+        d17b_op_counts_clear(&cpu);
+        uint64_t start = cpu.cycle_count, words = 0, retired = 0;
+        d17b_run_until(&cpu, 100000, 0, NULL);
+        n_ops = d17b_op_counts(&cpu, counts, D17B_PROFILE_OPS);
+        for (uint32_t i = 0; i < n_ops; i++) {
+            words += counts[i].word_times;
+            retired += counts[i].retired;
+        }
+        cpu.timing = false;
+        prof_ok = prof_ok && n_ops == 4 && retired > 0 &&
+                  words == cpu.cycle_count - start &&
+                  counts[0].word_times >= counts[n_ops - 1].word_times;
+        d17b_dump_op_counts(&cpu);
+    }
+#else
+    prof_ok = n_ops == 0;
+    printf("Not built; d17b_op_counts reports nothing\n");
+#endif
+
+    if (prof_ok) {
+        printf("*** OPERATION PROFILE TEST PASSED ***\n");
+    } else {
+        printf("*** OPERATION PROFILE TEST FAILED ***\n");
+        return 1;
+    }
+
+    /*
+     * The same loop fetches from 07:000-003, reads 07:010 in ADD and
+     * writes it back in STO, once each per pass and nowhere else.
+     */
+    printf("\n=== HEAT MAP TEST ===\n");
+    printf("Testing: fetches, operand reads and writes per sector\n\n");
+
+    static uint64_t heat[CHANNELS][SECTORS];
+    const char *heat_path = "d17b_test.heat";
+    bool heat_ok;
+    cpu.I = (7 << 9);
+    d17b_heat_clear(&cpu);
+    d17b_run_until(&cpu, 4000, 0, NULL);
+#ifdef D17B_PROFILE
+    uint64_t fetched = 0, accessed = 0;
+    d17b_heat_matrix(&cpu, D17B_HEAT_FETCH, heat);
+    for (int sec = 0; sec < 4; sec++) {
+        fetched += heat[7][sec];
+    }
+    heat_ok = fetched == 4000 && heat[7][0] == 1000;
+    d17b_heat_matrix(&cpu, D17B_HEAT_READ, heat);
+    heat_ok = heat_ok && heat[7][8] == 1000;
+    d17b_heat_matrix(&cpu, D17B_HEAT_WRITE, heat);
+    heat_ok = heat_ok && heat[7][8] == 1000;
+    d17b_heat_matrix(&cpu, D17B_HEAT_ALL, heat);
+    for (int ch = 0; ch < CHANNELS; ch++) {
+        for (int sec = 0; sec < SECTORS; sec++) {
+            accessed += heat[ch][sec];
+        }
+    }
+    heat_ok = heat_ok && accessed == 6000;
+
+    /* The file is CHANNELS rows of SECTORS counts */
+    int rows = 0, c;
+    unsigned long long first = 0;
+    FILE *hf = NULL;
+    if (d17b_heat_save(&cpu, D17B_HEAT_ALL, heat_path) &&
+        (hf = fopen(heat_path, "r")) != NULL) {
+        heat_ok = heat_ok && fscanf(hf, "%llu", &first) == 1 && first == 0;
+        while ((c = fgetc(hf)) != EOF) {
+            rows += c == '\n';
+        }
+        fclose(hf);
+    }
+    remove(heat_path);
+    heat_ok = heat_ok && rows == CHANNELS;
+    printf("%llu accesses, 07:010 read and written %llu times\n",
+           (unsigned long long)accessed, (unsigned long long)heat[7][8] / 2);
+#else
+    heat_ok = !d17b_heat_matrix(&cpu, D17B_HEAT_ALL, heat) &&
+              !d17b_heat_save(&cpu, D17B_HEAT_ALL, heat_path);
+    printf("Not built; no heat map to read\n");
+#endif
+
+    if (heat_ok) {
+        printf("*** HEAT MAP TEST PASSED ***\n");
+    } else {
+        printf("*** HEAT MAP TEST FAILED ***\n");
+        return 1;
+    }
+
+    /*
+     * CLA 05,040 then TRA 05,000, timed: every pass CLA waits 31 words
+     * for its operand and 96 for 05:001, TRA 126 for 05:000. The loop
+     * polls, so with fast-forward most passes are skipped and must be
+     * credited all the same.
+     */
+    printf("\n=== LATENCY PROFILE TEST ===\n");
+    printf("Testing: operand and next-word waits per address\n\n");
+
+    d17b_latency_rank_t worst[4];
+    uint32_t n_worst = 0;
+    for (int i = 0; i < 2; i++) {
+        d17b_cpu_t *c = i ? &other : &cpu;
+        d17b_init(c);
+        c->memory[5][0] = ENCODE_INSTR(0x9, 0, 1, 5, 32);      /* CLA 05,040 */
+        c->memory[5][1] = ENCODE_INSTR(0xA, 0, 0, 5, 0);       /* TRA 05,000 */
+        c->I = (5 << 9);
+        c->timing = true;
+        c->fast_forward = i;
+        d17b_run_until(c, 256 * 1000 + 10, 0, NULL);
+    }
+    n_worst = d17b_latency_worst(&other, worst, 4);
+#ifdef D17B_PROFILE
+    bool lat_ok = memcmp(cpu.latency, other.latency, sizeof(cpu.latency)) == 0 &&
+                  memcmp(cpu.op_retired, other.op_retired,
+                         sizeof(cpu.op_retired)) == 0 &&
+                  other.idle_cycles > 0 && n_worst == 2 &&
+                  worst[0].channel == 5 && worst[0].sector == 0 &&
+                  worst[0].wait.executed == 1001 &&
+                  worst[0].wait.operand_wait == 31 * 1001 &&
+                  worst[0].wait.next_wait == 96 * 1000 &&
+                  worst[1].sector == 1 && worst[1].wait.operand_wait == 0 &&
+                  worst[1].wait.next_wait == 126 * 1000;
+    d17b_dump_latency(&other, 4);
+#else
+    bool lat_ok = n_worst == 0;
+    printf("Not built; d17b_latency_worst reports nothing\n");
+#endif
+
+    if (lat_ok) {
+        printf("*** LATENCY PROFILE TEST PASSED ***\n");
+    } else {
+        printf("*** LATENCY PROFILE TEST FAILED ***\n");
+        return 1;
+    }
+
+    /*
+     * A 64-record ring is far too small to keep up, so the blocking
+     * trace must wait on the drain thread and still match a reference
+     * stepped alongside, record for record; the dropping one must
+     * account for every instruction as written or dropped.
+     */
+    printf("\n=== TRACE RING TEST ===\n");
+    printf("Testing: blocking and dropping traces through a small ring\n\n");
+
+    const char *trace_path = "d17b_test.trace";
+    const uint64_t trace_run = 100000;
+    uint64_t trace_dropped = 0, written = 0, gaps = 0;
+    d17b_trace_rec_t rec;
+    uint32_t trace_header[4];
+    d17b_init(&cpu);
+    load_bench_program(&cpu);
+    bool trace_ok = d17b_trace_start(&cpu, trace_path, 64, D17B_TRACE_BLOCK,
+                                     D17B_TRACE_RAW);
+    d17b_run(&cpu, trace_run);
+    trace_ok = d17b_trace_stop(&cpu, &trace_dropped) && trace_ok &&
+               trace_dropped == 0;
+
+    d17b_init(&other);
+    load_bench_program(&other);
+    FILE *tf = fopen(trace_path, "rb");
+    trace_ok = trace_ok && tf &&
+               fread(trace_header, sizeof(trace_header), 1, tf) == 1 &&
+               trace_header[3] == sizeof(rec);
+    while (trace_ok && fread(&rec, sizeof(rec), 1, tf) == 1) {
+        trace_ok = rec.cycle == other.cycle_count && rec.I == other.I &&
+                   rec.A == other.A && rec.L == other.L &&
+                   rec.flags == (other.d37c_mode ? D17B_TRACE_D37C : 0u) &&
+                   rec.instr == d17b_read(&other, (uint8_t)((rec.I >> 9) & 0x3F),
+                                          (uint8_t)((rec.I >> 2) & 0x7F));
+        d17b_step(&other);
+        written++;
+    }
+    if (tf) {
+        fclose(tf);
+    }
+    trace_ok = trace_ok && written == trace_run && same_state(&cpu, &other);
+    printf("blocking: %llu records, %s\n", (unsigned long long)written,
+           trace_ok ? "match" : "DIFFER");
+
+    d17b_init(&cpu);
+    load_bench_program(&cpu);
+    trace_ok = d17b_trace_start(&cpu, trace_path, 64, D17B_TRACE_DROP,
+                                D17B_TRACE_RAW) &&
+               trace_ok;
+    d17b_run(&cpu, 10 * trace_run);
+    trace_ok = d17b_trace_stop(&cpu, &trace_dropped) && trace_ok;
+    written = 0;
+    tf = fopen(trace_path, "rb");
+    if (tf && fread(trace_header, sizeof(trace_header), 1, tf) == 1) {
+        while (fread(&rec, sizeof(rec), 1, tf) == 1) {
+            gaps += rec.dropped;
+            written++;
+        }
+    }
+    if (tf) {
+        fclose(tf);
+    }
+    remove(trace_path);
+    trace_ok = trace_ok && written + trace_dropped == 10 * trace_run &&
+               gaps <= trace_dropped;
+    printf("dropping: %llu records, %llu dropped\n",
+           (unsigned long long)written, (unsigned long long)trace_dropped);
+
+    if (trace_ok) {
+        printf("*** TRACE RING TEST PASSED ***\n");
+    } else {
+        printf("*** TRACE RING TEST FAILED ***\n");
+        return 1;
+    }
+
+    /*
+     * The same run traced raw and packed must read back the same, from
+     * the start and from a seek; a packed trace cut off before its index
+     * must still read up to its last whole chunk.
+     */
+    printf("\n=== PACKED TRACE TEST ===\n");
+    printf("Testing: delta-encoded trace chunks, index and seeking\n\n");
+
+    const char *raw_path = "d17b_test.trace";
+    const char *pack_path = "d17b_test.trz";
+    const char *cut_path = "d17b_test_cut.trz";
+    const uint64_t pack_run = 300000, pack_seek = 123457;
+    bool pack_ok = true;
+    for (int i = 0; i < 2; i++) {
+        d17b_init(&cpu);
+        load_bench_program(&cpu);
+        pack_ok = d17b_trace_start(&cpu, i ? pack_path : raw_path, 0,
+                                   D17B_TRACE_BLOCK,
+                                   i ? D17B_TRACE_PACKED : D17B_TRACE_RAW) &&
+                  pack_ok;
+        d17b_run(&cpu, pack_run);
+        pack_ok = d17b_trace_stop(&cpu, NULL) && pack_ok;
+    }
+
+    d17b_trace_reader_t *raw = d17b_trace_open(raw_path);
+    d17b_trace_reader_t *packed = d17b_trace_open(pack_path);
+    d17b_trace_rec_t want;
+    uint64_t records = 0;
+    pack_ok = pack_ok && raw && packed;
+    while (pack_ok && d17b_trace_next(raw, &want)) {
+        pack_ok = d17b_trace_next(packed, &rec) &&
+                  memcmp(&rec, &want, sizeof(rec)) == 0;
+        records++;
+    }
+    pack_ok = pack_ok && records == pack_run && !d17b_trace_next(packed, &rec);
+    pack_ok = pack_ok && d17b_trace_seek(raw, pack_seek) &&
+              d17b_trace_seek(packed, pack_seek) &&
+              d17b_trace_next(raw, &want) && d17b_trace_next(packed, &rec) &&
+              memcmp(&rec, &want, sizeof(rec)) == 0 && want.cycle >= pack_seek &&
+              d17b_trace_next(raw, &want) && d17b_trace_next(packed, &rec) &&
+              memcmp(&rec, &want, sizeof(rec)) == 0;
+
+    uint32_t chunks = 0;
+    const d17b_trace_chunk_t *index = packed ? d17b_trace_index(packed, &chunks) : NULL;
+    long raw_bytes = 0, pack_bytes = 0;
+    FILE *rf = fopen(raw_path, "rb"), *pf = fopen(pack_path, "rb");
+    if (rf && pf && fseek(rf, 0, SEEK_END) == 0 && fseek(pf, 0, SEEK_END) == 0) {
+        raw_bytes = ftell(rf);
+        pack_bytes = ftell(pf);
+    }
+    printf("%llu records: raw %ld bytes, packed %ld in %u chunks\n",
+           (unsigned long long)records, raw_bytes, pack_bytes, chunks);
+    pack_ok = pack_ok && index && chunks > 4 && pack_bytes > 0 &&
+              pack_bytes * 4 < raw_bytes;
+
+    /* Cut into the fifth chunk, losing it and the index */
+    FILE *cf = fopen(cut_path, "wb");
+    if (pack_ok && pf && cf && fseek(pf, 0, SEEK_SET) == 0) {
+        for (uint64_t i = 0; i < index[4].offset + 100; i++) {
+            fputc(fgetc(pf), cf);
+        }
+    }
+    uint64_t cut_seek = index ? index[3].first + 7 : 0;
+    if (cf) {
+        fclose(cf);
+    }
+    if (rf) {
+        fclose(rf);
+    }
+    if (pf) {
+        fclose(pf);
+    }
+    d17b_trace_reader_t *cut = d17b_trace_open(cut_path);
+    uint32_t cut_chunks = 0;
+    pack_ok = pack_ok && cut && d17b_trace_index(cut, &cut_chunks) &&
+              cut_chunks == 4 &&
+              d17b_trace_seek(raw, cut_seek) && d17b_trace_seek(cut, cut_seek) &&
+              d17b_trace_next(raw, &want) && d17b_trace_next(cut, &rec) &&
+              memcmp(&rec, &want, sizeof(rec)) == 0 &&
+              !d17b_trace_seek(cut, index[4].first);
+    printf("cut short: %u whole chunks, seek to %llu %s\n", cut_chunks,
+           (unsigned long long)cut_seek, pack_ok ? "matches" : "DIFFERS");
+
+    /* A raw trace from another version is refused */
+    const uint32_t future[4] = { 0x42373144u, 0x43415254u, 2, sizeof(rec) };
+    const char *future_path = "d17b_test_v2.trace";
+    cf = fopen(future_path, "wb");
+    if (cf) {
+        fwrite(future, sizeof(future), 1, cf);
+        fwrite(&want, sizeof(want), 1, cf);
+        fclose(cf);
+    }
+    d17b_trace_reader_t *future_r = d17b_trace_open(future_path);
+    pack_ok = pack_ok && cf && !future_r;
+    d17b_trace_close(future_r);
+    remove(future_path);
+
+    d17b_trace_close(cut);
+    d17b_trace_close(packed);
+    d17b_trace_close(raw);
+    remove(cut_path);
+    remove(pack_path);
+    remove(raw_path);
+
+    if (pack_ok) {
+        printf("*** PACKED TRACE TEST PASSED ***\n");
+    } else {
+        printf("*** PACKED TRACE TEST FAILED ***\n");
+        return 1;
+    }
+
+#ifndef _WIN32
+    printf("\n=== FORK SERVER TEST ===\n");
+    printf("Testing: scenarios forked from a booted state\n\n");
+
+    FILE *fin = tmpfile(), *fout = tmpfile();
+    if (!fin || !fout) {
+        printf("*** FORK SERVER TEST FAILED: no temporary files ***\n");
+        return 1;
+    }
+    const uint32_t fork_n = 12;
+    for (uint32_t i = 0; i < fork_n; i++) {
+        fprintf(fin, "02:001=%o%s\n", i * 37, i == 5 ? " oops" : "");
+    }
+    rewind(fin);
+
+    d17b_init(&cpu);
+    load_bench_program(&cpu);
+    bool booted = boot_to(&cpu, "01:011");
+    run_fork_server(&cpu, fin, fout, 3000, 3);
+    rewind(fout);
+
+    uint32_t fork_seen = 0, fork_bad = 0;
+    char fline[256];
+    while (fgets(fline, sizeof(fline), fout)) {
+        unsigned int idx, A, L, I;
+        unsigned long long cyc;
+        fork_seen++;
+        if (sscanf(fline, "%u budget cycles=%llu A=%o L=%o I=%o",
+                   &idx, &cyc, &A, &L, &I) != 5) {
+            fork_bad += !(sscanf(fline, "%u", &idx) == 1 && idx == 5 &&
+                          strstr(fline, "bad-scenario"));
+            continue;
+        }
+        d17b_init(&other);
+        load_bench_program(&other);
+        boot_to(&other, "01:011");
+        d17b_clear_breakpoints(&other);
+        other.memory[2][1] = idx * 37;
+        d17b_run(&other, 3000);
+        fork_bad += idx == 5 || cyc != other.cycle_count || A != other.A ||
+                    L != other.L || I != other.I;
+    }
+    fclose(fin);
+    fclose(fout);
+
+    printf("Booted to cycle %llu, %u results, %u wrong\n",
+           (unsigned long long)cpu.cycle_count, fork_seen, fork_bad);
+
+    if (booted && fork_seen == fork_n && fork_bad == 0) {
+        printf("*** FORK SERVER TEST PASSED ***\n");
+    } else {
+        printf("*** FORK SERVER TEST FAILED ***\n");
+        return 1;
+    }
+
+    printf("\n=== SHARDED CAMPAIGN TEST ===\n");
+    printf("Testing: pinned workers, shared-memory rings, a worker crash\n\n");
+
+    fin = tmpfile();
+    fout = tmpfile();
+    if (!fin || !fout) {
+        printf("*** SHARDED CAMPAIGN TEST FAILED: no temporary files ***\n");
+        return 1;
+    }
+    const uint32_t shard_n = 40;
+    for (uint32_t i = 0; i < shard_n; i++) {
+        fprintf(fin, "02:001=%o%s\n", i * 37, i == 13 ? " oops" : "");
+    }
+    rewind(fin);
+
+    /*
+     * The boot state carries an event that kills scenario 7, second in
+     * its shard, so it only fires if every scenario gets the events.
+     */
+    const uint32_t crash_value = 7 * 37;
+    d17b_event_t crash = { .when = cpu.cycle_count + 1, .kind = D17B_EV_CALL,
+                           .fn = crash_scenario, .user = (void *)&crash_value };
+    d17b_clear_breakpoints(&cpu);
+    d17b_schedule(&cpu, &crash);
+    run_shards(&cpu, fin, fout, 3000, 4);
+    d17b_sched_clear(&cpu);
+    rewind(fout);
+
+    uint32_t shard_seen = 0, shard_bad = 0, shard_crashed = 0;
+    bool shard_total = false;
+    while (fgets(fline, sizeof(fline), fout)) {
+        unsigned int idx, A, L, I;
+        unsigned long long cyc;
+        if (fline[0] == '#') {
+            shard_total = strstr(fline, " budget=38 ") &&
+                          strstr(fline, " bad=1 crashed=1 ");
+            continue;
+        }
+        shard_seen++;
+        if (sscanf(fline, "%u budget cycles=%llu A=%o L=%o I=%o",
+                   &idx, &cyc, &A, &L, &I) != 5) {
+            bool parsed = sscanf(fline, "%u", &idx) == 1;
+            bool crash = parsed && idx == 7 && strstr(fline, "crashed");
+            shard_crashed += crash;
+            shard_bad += !crash && !(parsed && idx == 13 &&
+                                     strstr(fline, "bad-scenario"));
+            continue;
+        }
+        d17b_init(&other);
+        load_bench_program(&other);
+        boot_to(&other, "01:011");
+        d17b_clear_breakpoints(&other);
+        other.memory[2][1] = idx * 37;
+        d17b_run(&other, 3000);
+        shard_bad += idx == 7 || idx == 13 || cyc != other.cycle_count ||
+                     A != other.A || L != other.L || I != other.I;
+    }
+    fclose(fin);
+    fclose(fout);
+
+    printf("%u results, %u wrong, %u crashed\n", shard_seen, shard_bad,
+           shard_crashed);
+
+    if (shard_seen == shard_n && shard_bad == 0 && shard_crashed == 1 &&
+        shard_total) {
+        printf("*** SHARDED CAMPAIGN TEST PASSED ***\n");
+    } else {
+        printf("*** SHARDED CAMPAIGN TEST FAILED ***\n");
+        return 1;
+    }
+#endif
+
+    printf("\n=== ALL TESTS PASSED ===\n");
+    return 0;
+}
+
+int main(int argc, char *argv[]) {
+    printf("\n");
+    printf("  ╔═══════════════════════════════════════════════════════╗\n");
+    printf("  ║   D17B/D37C MINUTEMAN GUIDANCE COMPUTER EMULATOR      ║\n");
+    printf("  ║                                                       ║\n");
+    printf("  ║   D17B: Minuteman I (1962) - 39 instructions          ║\n");
+    printf("  ║   D37C: Minuteman II/III (1965) - 57 instructions     ║\n");
+    printf("  ║                                                       ║\n");
+    printf("  ║   400 nuclear missiles still fly on this code         ║\n");
+    printf("  ╚═══════════════════════════════════════════════════════╝\n");
+    printf("\n");
+
+    if (argc > 1 && strcmp(argv[1], "-i") == 0) {
+        /* Interactive mode */
+        static d17b_cpu_t cpu;
+        d17b_init(&cpu);
+        load_test_program(&cpu);
+        run_interactive(&cpu);
+        return 0;
+    } else if (argc > 1 && strcmp(argv[1], "-t") == 0) {
+        /* Test mode */
+        return run_test();
+    } else if (argc > 1 && strcmp(argv[1], "-b") == 0) {
+        /* Benchmark mode */
+        uint64_t cycles = argc > 2 ? strtoull(argv[2], NULL, 10) : 50000000ULL;
+        return run_bench(cycles);
+#ifndef _WIN32
+    } else if (argc > 2 && strcmp(argv[1], "-f") == 0) {
+        /* Fork server: boot a program, scenarios on stdin */
+        static d17b_cpu_t cpu;
+        uint64_t cycles = argc > 3 ? strtoull(argv[3], NULL, 10) : 1000000ULL;
+        long online = sysconf(_SC_NPROCESSORS_ONLN);
+        unsigned int jobs = argc > 4 ? (unsigned int)atoi(argv[4])
+                                     : online > 0 ? (unsigned int)online : 1;
+        const char *snapshot = argc > 5 ? argv[5] : NULL;
+        if (!boot_from(&cpu, snapshot)) {
+            fprintf(stderr, "Cannot load snapshot %s\n", snapshot);
+            return 1;
+        }
+        if (!boot_to(&cpu, argv[2])) {
+            fprintf(stderr, "Fork point %s not reached\n", argv[2]);
+            return 1;
+        }
+        printf("Forking at cycle %llu\n", (unsigned long long)cpu.cycle_count);
+        return run_fork_server(&cpu, stdin, stdout, cycles, jobs ? jobs : 1);
+    } else if (argc > 2 && strcmp(argv[1], "-s") == 0) {
+        /* Sharded campaign: the same, over a fixed set of pinned workers */
+        static d17b_cpu_t cpu;
+        uint64_t cycles = argc > 3 ? strtoull(argv[3], NULL, 10) : 1000000ULL;
+        long online = sysconf(_SC_NPROCESSORS_ONLN);
+        unsigned int workers = argc > 4 ? (unsigned int)atoi(argv[4])
+                                        : online > 0 ? (unsigned int)online : 1;
+        const char *snapshot = argc > 5 ? argv[5] : NULL;
+        if (!boot_from(&cpu, snapshot)) {
+            fprintf(stderr, "Cannot load snapshot %s\n", snapshot);
+            return 1;
+        }
+        if (!boot_to(&cpu, argv[2])) {
+            fprintf(stderr, "Boot point %s not reached\n", argv[2]);
+            return 1;
+        }
+        d17b_clear_breakpoints(&cpu);
+        return run_shards(&cpu, stdin, stdout, cycles, workers ? workers : 1);
+#endif
     } else {
-        printf("Usage: %s [-i|-t]\n", argv[0]);
+        printf("Usage: %s [-i|-t|-b [cycles]|"
+               "-f point [cycles [jobs [snapshot]]]|"
+               "-s point [cycles [workers [snapshot]]]]\n", argv[0]);
         printf("  -i  Interactive mode\n");
         printf("  -t  Run automated tests\n");
+        printf("  -b  Benchmark the execution cores\n");
+        printf("  -f  Fork server: boot to CC:SSS or a cycle count, then run\n"
+               "      each stdin scenario line in its own forked child; the\n"
+               "      benchmark program boots unless a snapshot file is given\n");
+        printf("  -s  Sharded campaign: the same, dealt to pinned worker\n"
+               "      processes that report through shared memory\n");
         printf("\nRunning default test...\n\n");
         return run_test();
     }
@@ -0,0 +1,283 @@
+/*
+ * D17B Minuteman I Guidance Computer Emulator
+ * Input record and replay
+ *
+ * The only things outside the program that change a run are its inputs:
+ * the discrete inputs, the detector, the V and R loops and proceed after
+ * HPR. They all reach the cpu through d17b_apply_event, from a timed
+ * event or from d17b_input, so recording is one test there. Each entry
+ * is the cycle_count the input took effect at and the event that set
+ * it; entries gather in a buffer that is written out when it fills.
+ * Going back in a history takes the cpu to before inputs it has logged,
+ * and it will take them again, so the log is cut back to that point.
+ *
+ * A log is a 16-byte header ("D17B" "RLOG", version, entry size) and
+ * 16-byte entries: the cycle as two words, the value, and the kind with
+ * the loop index above it, all little-endian 32-bit words. Replay reads
+ * a buffer of entries at a time and keeps a single event pending, due
+ * at the next entry's cycle, which applies every entry due and files
+ * itself again for the one after. At the end of the log nothing is left
+ * pending but the replay stays open, so a history going back can seek
+ * it to an earlier entry and the event it kept files it again.
+ *
+ * Copyright 2025 Zane Hambly - Apache 2.0 License
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include "d17b.h"
+#include "d17b_internal.h"
+
+#define RLOG_MAGIC_LO       0x42373144u     /* "D17B" */
+#define RLOG_MAGIC_HI       0x474F4C52u     /* "RLOG" */
+#define RLOG_VERSION        1
+#define RLOG_HEADER_BYTES   16
+#define RLOG_ENTRY_BYTES    16
+#define RLOG_BUFFER         4096            /* Entries per buffer */
+
+struct d17b_record {
+    FILE *f;
+    bool failed;                        /* A write went wrong */
+    uint64_t written;                   /* Entries in the file */
+    uint32_t used;
+    uint8_t buf[RLOG_BUFFER * RLOG_ENTRY_BYTES];
+};
+
+struct d17b_replay {
+    FILE *f;
+    uintptr_t generation;               /* Tells our event from a stale one */
+    uint32_t next;                      /* Entries consumed from buf */
+    uint32_t have;                      /* Entries in buf */
+    uint8_t buf[RLOG_BUFFER * RLOG_ENTRY_BYTES];
+};
+
+static uintptr_t replay_generation;
+
+static inline void put32(uint8_t *p, uint32_t v) {
+    p[0] = (uint8_t)v;
+    p[1] = (uint8_t)(v >> 8);
+    p[2] = (uint8_t)(v >> 16);
+    p[3] = (uint8_t)(v >> 24);
+}
+
+static inline uint32_t get32(const uint8_t *p) {
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) |
+           ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+/* ============================================================================
+ * RECORD
+ * ============================================================================ */
+
+static void record_flush(struct d17b_record *r) {
+    size_t bytes = (size_t)r->used * RLOG_ENTRY_BYTES;
+    if (bytes && fwrite(r->buf, 1, bytes, r->f) != bytes) {
+        r->failed = true;
+    }
+    r->written += r->used;
+    r->used = 0;
+}
+
+static uint64_t logged_cycle(const uint8_t *e) {
+    return get32(e) | ((uint64_t)get32(e + 4) << 32);
+}
+
+void d17b_record_rewind(d17b_cpu_t *cpu) {
+    struct d17b_record *r = cpu->record;
+    if (!r) {
+        return;
+    }
+
+    /* Still buffered: forget them */
+    while (r->used && logged_cycle(r->buf + (size_t)(r->used - 1) *
+                                   RLOG_ENTRY_BYTES) > cpu->cycle_count) {
+        r->used--;
+    }
+    if (r->used || r->written == 0) {
+        return;
+    }
+
+    /* Written out: read back from the end and cut the file */
+    uint64_t keep = r->written;
+    uint8_t e[RLOG_ENTRY_BYTES];
+    while (keep && fseek(r->f, RLOG_HEADER_BYTES + (long)(keep - 1) *
+                         RLOG_ENTRY_BYTES, SEEK_SET) == 0 &&
+           fread(e, 1, sizeof(e), r->f) == sizeof(e) &&
+           logged_cycle(e) > cpu->cycle_count) {
+        keep--;
+    }
+    long end = RLOG_HEADER_BYTES + (long)keep * RLOG_ENTRY_BYTES;
+    if (fseek(r->f, end, SEEK_SET) != 0 || ftruncate(fileno(r->f), end) != 0) {
+        r->failed = true;
+    }
+    r->written = keep;
+}
+
+void d17b_record_input(d17b_cpu_t *cpu, const d17b_event_t *ev) {
+    struct d17b_record *r = cpu->record;
+    uint8_t *e = r->buf + (size_t)r->used * RLOG_ENTRY_BYTES;
+
+    put32(e, (uint32_t)cpu->cycle_count);
+    put32(e + 4, (uint32_t)(cpu->cycle_count >> 32));
+    put32(e + 8, ev->value);
+    put32(e + 12, ev->kind | ((uint32_t)ev->index << 8));
+    if (++r->used == RLOG_BUFFER) {
+        record_flush(r);
+    }
+}
+
+void d17b_input(d17b_cpu_t *cpu, d17b_event_kind_t kind, uint8_t index,
+                uint32_t value) {
+    d17b_event_t ev = { .kind = (uint8_t)kind, .index = index, .value = value };
+    if (kind != D17B_EV_CALL) {
+        d17b_apply_event(cpu, &ev);
+    }
+}
+
+bool d17b_record_start(d17b_cpu_t *cpu, const char *path) {
+    if (cpu->record) {
+        return false;
+    }
+
+    struct d17b_record *r = calloc(1, sizeof(*r));
+    if (!r) {
+        return false;
+    }
+    r->f = fopen(path, "w+b");          /* Read back by a rewind */
+    uint8_t header[RLOG_HEADER_BYTES];
+    put32(header, RLOG_MAGIC_LO);
+    put32(header + 4, RLOG_MAGIC_HI);
+    put32(header + 8, RLOG_VERSION);
+    put32(header + 12, RLOG_ENTRY_BYTES);
+    if (!r->f || fwrite(header, 1, sizeof(header), r->f) != sizeof(header)) {
+        if (r->f) {
+            fclose(r->f);
+        }
+        free(r);
+        return false;
+    }
+
+    cpu->record = r;
+    return true;
+}
+
+bool d17b_record_stop(d17b_cpu_t *cpu) {
+    struct d17b_record *r = cpu->record;
+    if (!r) {
+        return false;
+    }
+
+    record_flush(r);
+    bool ok = !r->failed && fclose(r->f) == 0;
+    free(r);
+    cpu->record = NULL;
+    return ok;
+}
+
+/* ============================================================================
+ * REPLAY
+ * ============================================================================ */
+
+/* Make sure an entry is buffered; false at the end of the log */
+static bool replay_fill(struct d17b_replay *p) {
+    if (p->next < p->have) {
+        return true;
+    }
+    size_t got = fread(p->buf, RLOG_ENTRY_BYTES, RLOG_BUFFER, p->f);
+    p->next = 0;
+    p->have = (uint32_t)got;
+    return got > 0;
+}
+
+static uint64_t entry_cycle(const struct d17b_replay *p) {
+    return logged_cycle(p->buf + (size_t)p->next * RLOG_ENTRY_BYTES);
+}
+
+static void replay_due(d17b_cpu_t *cpu, void *user);
+
+/* Apply the entries due by now, then wait for the next, if any */
+static void replay_feed(d17b_cpu_t *cpu) {
+    struct d17b_replay *p = cpu->replay;
+
+    while (replay_fill(p) && entry_cycle(p) <= cpu->cycle_count) {
+        const uint8_t *e = p->buf + (size_t)p->next * RLOG_ENTRY_BYTES;
+        uint32_t tag = get32(e + 12);
+        d17b_event_t ev = { .value = get32(e + 8), .kind = (uint8_t)tag,
+                            .index = (uint8_t)(tag >> 8) };
+        p->next++;
+        if (ev.kind != D17B_EV_CALL) {
+            d17b_apply_event(cpu, &ev);
+        }
+    }
+
+    if (p->next < p->have) {
+        d17b_event_t due = { .when = entry_cycle(p), .kind = D17B_EV_CALL,
+                             .fn = replay_due,
+                             .user = (void *)p->generation };
+        if (!d17b_schedule(cpu, &due)) {
+            d17b_replay_stop(cpu);
+        }
+    }
+}
+
+static void replay_due(d17b_cpu_t *cpu, void *user) {
+    /* A replay stopped or restarted since this was filed is not ours */
+    if (cpu->replay && cpu->replay->generation == (uintptr_t)user) {
+        replay_feed(cpu);
+    }
+}
+
+bool d17b_replay_start(d17b_cpu_t *cpu, const char *path) {
+    d17b_replay_stop(cpu);
+
+    struct d17b_replay *p = calloc(1, sizeof(*p));
+    if (!p) {
+        return false;
+    }
+    p->f = fopen(path, "rb");
+    uint8_t header[RLOG_HEADER_BYTES];
+    if (!p->f || fread(header, 1, sizeof(header), p->f) != sizeof(header) ||
+        get32(header) != RLOG_MAGIC_LO || get32(header + 4) != RLOG_MAGIC_HI ||
+        get32(header + 8) != RLOG_VERSION ||
+        get32(header + 12) != RLOG_ENTRY_BYTES) {
+        if (p->f) {
+            fclose(p->f);
+        }
+        free(p);
+        return false;
+    }
+
+    p->generation = __atomic_add_fetch(&replay_generation, 1, __ATOMIC_RELAXED);
+    cpu->replay = p;
+    replay_feed(cpu);
+    return true;
+}
+
+d17b_replay_pos_t d17b_replay_tell(const d17b_cpu_t *cpu) {
+    d17b_replay_pos_t pos = { 0, 0 };
+    const struct d17b_replay *p = cpu->replay;
+    if (p) {
+        pos.generation = p->generation;
+        pos.offset = ftell(p->f) - (long)(p->have - p->next) * RLOG_ENTRY_BYTES;
+    }
+    return pos;
+}
+
+/* Only the same replay, ended or not: its pending event comes back too */
+void d17b_replay_seek(d17b_cpu_t *cpu, d17b_replay_pos_t pos) {
+    struct d17b_replay *p = cpu->replay;
+    if (p && pos.generation == p->generation &&
+        fseek(p->f, pos.offset, SEEK_SET) == 0) {
+        p->next = p->have = 0;
+    }
+}
+
+void d17b_replay_stop(d17b_cpu_t *cpu) {
+    struct d17b_replay *p = cpu->replay;
+    if (p) {
+        fclose(p->f);
+        free(p);
+        cpu->replay = NULL;
+    }
+}
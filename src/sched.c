@@ -0,0 +1,362 @@
+/*
+ * D17B Minuteman I Guidance Computer Emulator
+ * Word-time event scheduler
+ *
+ * A three-level hierarchical timing wheel keyed on cycle_count. Each
+ * level has 256 slots; level 0 slots are one word time wide, level 1
+ * slots 256 and level 2 slots 65536. An event goes into the lowest level
+ * whose window it shares with the wheel's current time, and moves down a
+ * level when the wheel reaches the start of its slot. Events more than
+ * 2^24 word times (about 22 minutes) out wait on an overflow list.
+ *
+ * Occupancy bitmaps make "when is the next thing due" a handful of
+ * word scans, which is all d17b_run_until needs to size its runs.
+ *
+ * Copyright 2025 Zane Hambly - Apache 2.0 License
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "d17b.h"
+#include "d17b_internal.h"
+
+#define SCHED_LEVELS    3
+#define SCHED_SLOTS     256
+#define SCHED_BITS      8
+#define SCHED_NONE      UINT32_MAX
+
+typedef struct {
+    d17b_event_t ev;
+    uint32_t next;                      /* Next node in the same list */
+} sched_node_t;
+
+typedef struct {
+    uint32_t head;
+    uint32_t tail;
+} sched_list_t;
+
+struct d17b_sched {
+    uint64_t now;                       /* Wheel time, never past cycle_count */
+
+    sched_list_t slot[SCHED_LEVELS][SCHED_SLOTS];
+    uint64_t used[SCHED_LEVELS][SCHED_SLOTS / 64];
+
+    sched_list_t overflow;
+    uint64_t overflow_min;              /* Earliest 'when' on the overflow list */
+
+    sched_node_t *nodes;
+    uint32_t capacity;
+    uint32_t free;                      /* Free node list */
+    uint32_t pending;
+};
+
+/* ============================================================================
+ * LISTS AND NODES
+ * ============================================================================ */
+
+static void list_append(struct d17b_sched *s, sched_list_t *l, uint32_t n) {
+    s->nodes[n].next = SCHED_NONE;
+    if (l->head == SCHED_NONE) {
+        l->head = n;
+    } else {
+        s->nodes[l->tail].next = n;
+    }
+    l->tail = n;
+}
+
+static uint32_t node_alloc(struct d17b_sched *s) {
+    if (s->free == SCHED_NONE) {
+        uint32_t grow = s->capacity ? s->capacity * 2 : 256;
+        sched_node_t *nodes = realloc(s->nodes, grow * sizeof(*nodes));
+        if (!nodes) {
+            return SCHED_NONE;
+        }
+        s->nodes = nodes;
+        for (uint32_t i = s->capacity; i < grow; i++) {
+            nodes[i].next = (i + 1 < grow) ? i + 1 : SCHED_NONE;
+        }
+        s->free = s->capacity;
+        s->capacity = grow;
+    }
+
+    uint32_t n = s->free;
+    s->free = s->nodes[n].next;
+    return n;
+}
+
+static void node_free(struct d17b_sched *s, uint32_t n) {
+    s->nodes[n].next = s->free;
+    s->free = n;
+}
+
+/* ============================================================================
+ * WHEEL
+ * ============================================================================ */
+
+/* File a node relative to the wheel's current time */
+static void wheel_insert(struct d17b_sched *s, uint32_t n) {
+    uint64_t when = s->nodes[n].ev.when;
+
+    if (when < s->now) {
+        when = s->nodes[n].ev.when = s->now;    /* Late: fire at once */
+    }
+
+    for (int level = 0; level < SCHED_LEVELS; level++) {
+        unsigned shift = SCHED_BITS * (level + 1);
+        if ((when >> shift) == (s->now >> shift)) {
+            unsigned idx = (when >> (SCHED_BITS * level)) & (SCHED_SLOTS - 1);
+            list_append(s, &s->slot[level][idx], n);
+            s->used[level][idx >> 6] |= 1ULL << (idx & 63);
+            return;
+        }
+    }
+
+    list_append(s, &s->overflow, n);
+    if (when < s->overflow_min) {
+        s->overflow_min = when;
+    }
+}
+
+/* Lowest set slot index >= from at one level, or -1 */
+static int next_used(const uint64_t *used, unsigned from) {
+    for (unsigned w = from >> 6; w < SCHED_SLOTS / 64; w++) {
+        uint64_t bits = used[w];
+        if (w == from >> 6) {
+            bits &= ~0ULL << (from & 63);
+        }
+        if (bits) {
+            return (int)(w * 64 + (unsigned)__builtin_ctzll(bits));
+        }
+    }
+    return -1;
+}
+
+/* Earliest time at which the wheel has work: a firing or a cascade */
+static uint64_t wheel_next(const struct d17b_sched *s) {
+    uint64_t best = UINT64_MAX;
+
+    for (int level = SCHED_LEVELS - 1; level >= 0; level--) {
+        unsigned shift = SCHED_BITS * level;
+        unsigned cur = (s->now >> shift) & (SCHED_SLOTS - 1);
+        int idx = next_used(s->used[level], level ? cur + 1 : cur);
+        if (idx >= 0) {
+            uint64_t window = s->now & ~((1ULL << (shift + SCHED_BITS)) - 1);
+            uint64_t start = window | ((uint64_t)idx << shift);
+            if (start < best) {
+                best = start;
+            }
+        }
+    }
+
+    if (s->overflow.head != SCHED_NONE) {
+        unsigned shift = SCHED_BITS * SCHED_LEVELS;
+        uint64_t start = (s->overflow_min >> shift) << shift;
+        if (start < best) {
+            best = start;
+        }
+    }
+
+    return best;
+}
+
+static sched_list_t take_slot(struct d17b_sched *s, int level, unsigned idx) {
+    sched_list_t l = s->slot[level][idx];
+    s->slot[level][idx].head = s->slot[level][idx].tail = SCHED_NONE;
+    s->used[level][idx >> 6] &= ~(1ULL << (idx & 63));
+    return l;
+}
+
+static void refile(struct d17b_sched *s, sched_list_t l) {
+    uint32_t n = l.head;
+    while (n != SCHED_NONE) {
+        uint32_t next = s->nodes[n].next;
+        wheel_insert(s, n);
+        n = next;
+    }
+}
+
+void d17b_apply_event(d17b_cpu_t *cpu, const d17b_event_t *ev) {
+    if (cpu->record && ev->kind != D17B_EV_CALL) {
+        d17b_record_input(cpu, ev);
+    }
+
+    switch (ev->kind) {
+        case D17B_EV_DETECTOR:
+            cpu->detector = ev->value != 0;
+            break;
+
+        case D17B_EV_DISCRETE_A:
+            cpu->discrete_in_a = ev->value & WORD_MASK;
+            break;
+
+        case D17B_EV_DISCRETE_B:
+            cpu->discrete_in_b = ev->value & WORD_MASK;
+            break;
+
+        case D17B_EV_V_LOOP:
+            cpu->V[ev->index & 0x03] =
+                d17b_add_24bit(cpu->V[ev->index & 0x03], ev->value & WORD_MASK);
+            break;
+
+        case D17B_EV_R_LOOP:
+            cpu->R[ev->index & 0x03] = ev->value & WORD_MASK;
+            break;
+
+        case D17B_EV_PROCEED:
+            cpu->halted = false;
+            break;
+
+        case D17B_EV_CALL:
+            if (ev->fn) {
+                ev->fn(cpu, ev->user);
+            }
+            break;
+    }
+}
+
+/* Cascade and fire everything the wheel holds for time 'at' */
+static void wheel_process(d17b_cpu_t *cpu, uint64_t at) {
+    struct d17b_sched *s = cpu->sched;
+    s->now = at;
+
+    if (s->overflow.head != SCHED_NONE &&
+        (s->overflow_min >> (SCHED_BITS * SCHED_LEVELS)) ==
+        (at >> (SCHED_BITS * SCHED_LEVELS))) {
+        sched_list_t l = s->overflow;
+        s->overflow.head = s->overflow.tail = SCHED_NONE;
+        s->overflow_min = UINT64_MAX;
+        refile(s, l);
+    }
+
+    for (int level = SCHED_LEVELS - 1; level > 0; level--) {
+        unsigned shift = SCHED_BITS * level;
+        unsigned idx = (at >> shift) & (SCHED_SLOTS - 1);
+        if ((at & ((1ULL << shift) - 1)) == 0 &&
+            ((s->used[level][idx >> 6] >> (idx & 63)) & 1)) {
+            refile(s, take_slot(s, level, idx));
+        }
+    }
+
+    unsigned idx = at & (SCHED_SLOTS - 1);
+    if (!((s->used[0][idx >> 6] >> (idx & 63)) & 1)) {
+        return;
+    }
+
+    /* Detach first: anything scheduled while firing lands in a new list */
+    sched_list_t l = take_slot(s, 0, idx);
+    uint32_t n = l.head;
+    while (n != SCHED_NONE) {
+        uint32_t next = s->nodes[n].next;
+        d17b_event_t ev = s->nodes[n].ev;
+
+        if (ev.period) {
+            s->nodes[n].ev.when = ev.when + ev.period;
+            wheel_insert(s, n);
+        } else {
+            node_free(s, n);
+            s->pending--;
+        }
+
+        d17b_apply_event(cpu, &ev); /* May schedule, so s->nodes can move */
+        if (cpu->sched != s) {
+            return;                 /* A callback cleared (and maybe renewed) it */
+        }
+        n = next;
+    }
+}
+
+/* ============================================================================
+ * INTERFACE
+ * ============================================================================ */
+
+bool d17b_schedule(d17b_cpu_t *cpu, const d17b_event_t *ev) {
+    struct d17b_sched *s = cpu->sched;
+
+    if (!s) {
+        s = calloc(1, sizeof(*s));
+        if (!s) {
+            return false;
+        }
+        memset(s->slot, 0xFF, sizeof(s->slot));
+        s->overflow.head = s->overflow.tail = SCHED_NONE;
+        s->overflow_min = UINT64_MAX;
+        s->free = SCHED_NONE;
+        s->now = cpu->cycle_count;
+        cpu->sched = s;
+    }
+
+    uint32_t n = node_alloc(s);
+    if (n == SCHED_NONE) {
+        return false;
+    }
+
+    s->nodes[n].ev = *ev;
+    wheel_insert(s, n);
+    s->pending++;
+    return true;
+}
+
+uint32_t d17b_events_pending(const d17b_cpu_t *cpu) {
+    return cpu->sched ? cpu->sched->pending : 0;
+}
+
+void d17b_sched_free(struct d17b_sched *s) {
+    if (s) {
+        free(s->nodes);
+        free(s);
+    }
+}
+
+/* A copy of the pending events, for a history checkpoint */
+struct d17b_sched *d17b_sched_clone(const struct d17b_sched *s) {
+    if (!s) {
+        return NULL;
+    }
+
+    struct d17b_sched *c = malloc(sizeof(*c));
+    if (!c) {
+        return NULL;
+    }
+    *c = *s;
+    c->nodes = malloc(s->capacity * sizeof(*c->nodes));
+    if (!c->nodes && s->capacity) {
+        free(c);
+        return NULL;
+    }
+    if (s->capacity) {
+        memcpy(c->nodes, s->nodes, s->capacity * sizeof(*c->nodes));
+    }
+    return c;
+}
+
+void d17b_sched_clear(d17b_cpu_t *cpu) {
+    d17b_sched_free(cpu->sched);
+    cpu->sched = NULL;
+}
+
+bool d17b_sched_copy(d17b_cpu_t *dst, const d17b_cpu_t *src) {
+    struct d17b_sched *copy = d17b_sched_clone(src->sched);
+    if (src->sched && !copy) {
+        return false;
+    }
+    d17b_sched_clear(dst);
+    dst->sched = copy;
+    return true;
+}
+
+uint64_t d17b_sched_next(const d17b_cpu_t *cpu) {
+    return cpu->sched ? wheel_next(cpu->sched) : UINT64_MAX;
+}
+
+void d17b_sched_advance(d17b_cpu_t *cpu) {
+    d17b_countdown_sync(cpu);
+
+    while (cpu->sched) {
+        uint64_t due = wheel_next(cpu->sched);
+        if (due > cpu->cycle_count) {
+            cpu->sched->now = cpu->cycle_count;
+            break;
+        }
+        wheel_process(cpu, due);
+    }
+}
@@ -0,0 +1,499 @@
+/*
+ * D17B Minuteman I Guidance Computer Emulator
+ * Machine state snapshots
+ *
+ * A snapshot is a 32-byte header and a fixed 24 KB payload, all 32-bit
+ * little-endian words whatever the host. The payload is 128 words of
+ * registers, loops, disc position and I/O state, then the drum as
+ * channels x sectors, so on a little-endian host restoring the drum is
+ * one memcpy out of the mapped file. The header carries a version and
+ * a 64-bit FNV-1a hash of the payload words.
+ *
+ * A delta snapshot holds the same 128 state words, then a bitmap of the
+ * sectors written since its parent and just those words. Its header
+ * adds the parent's hash and its own hash is seeded with it, so a chain
+ * only applies, in order, to a cpu holding the parent. The cpu keeps the
+ * hash of the snapshot it last saved or loaded as its base, and
+ * d17b_write marks the sectors it touches since.
+ *
+ * Snapshots hold architectural state only. Pending events (which may
+ * point at callbacks), breakpoints, the decode cache and JIT code are
+ * not saved; loading drops the cpu's events and re-decodes.
+ *
+ * Copyright 2025 Zane Hambly - Apache 2.0 License
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+#include "d17b.h"
+#include "d17b_internal.h"
+
+#define SNAP_MAGIC_LO       0x42373144u     /* "D17B" */
+#define SNAP_MAGIC_HI       0x50414E53u     /* "SNAP" */
+#define SNAP_VERSION        1
+#define SNAP_HEADER_WORDS   8
+#define DELTA_HEADER_WORDS  10
+
+/* Header words; a delta adds its parent's hash */
+enum {
+    H_MAGIC_LO, H_MAGIC_HI, H_VERSION, H_HEADER_BYTES, H_PAYLOAD_BYTES,
+    H_FLAGS, H_HASH_LO, H_HASH_HI, H_PARENT_LO, H_PARENT_HI
+};
+
+#define SNAP_FLAG_DELTA     0x01
+
+/* Payload words; the drum starts at P_MEMORY */
+enum {
+    P_A, P_L, P_N, P_I, P_P, P_U,
+    P_F = P_U + 1,
+    P_E = P_F + F_LOOP_SIZE,
+    P_H = P_E + E_LOOP_SIZE,
+    P_V = P_H + H_LOOP_SIZE,
+    P_R = P_V + V_LOOP_SIZE,
+    P_SECTOR = P_R + R_LOOP_SIZE,
+    P_CYCLES,                           /* 64-bit values take two words */
+    P_LATENCY = P_CYCLES + 2,
+    P_IDLE = P_LATENCY + 2,
+    P_STATUS = P_IDLE + 2,              /* SNAP_* bits */
+    P_CORE,
+    P_DISCRETE_IN_A,
+    P_DISCRETE_IN_B,
+    P_DISCRETE_OUT_A,
+    P_VOLTAGE,
+    P_BINARY = P_VOLTAGE + 4,
+    P_COUNTDOWN = P_BINARY + 4,
+    P_COUNTDOWN_BASE,
+    P_STATE_END = P_COUNTDOWN_BASE + 2,
+
+    P_MEMORY = 128,
+    P_WORDS = P_MEMORY + CHANNELS * SECTORS
+};
+
+#define SNAP_TIMING         0x01
+#define SNAP_FAST_FORWARD   0x02
+#define SNAP_HALTED         0x04
+#define SNAP_ERROR          0x08
+#define SNAP_D37C           0x10
+#define SNAP_DETECTOR       0x20
+#define SNAP_COUNTDOWN      0x40
+
+#define SNAP_BYTES          ((SNAP_HEADER_WORDS + P_WORDS) * 4)
+
+/* Delta payload: state words, then 128 map bits per channel, then words */
+#define D_MAP               P_MEMORY
+#define D_WORDS             (D_MAP + CHANNELS * 4)
+
+typedef char snap_state_fits[P_STATE_END <= P_MEMORY ? 1 : -1];
+
+/* ============================================================================
+ * ENCODING
+ * ============================================================================ */
+
+static inline bool host_little_endian(void) {
+    const uint16_t one = 1;
+    return *(const uint8_t *)&one == 1;
+}
+
+static inline void put32(uint8_t *p, uint32_t v) {
+    p[0] = (uint8_t)v;
+    p[1] = (uint8_t)(v >> 8);
+    p[2] = (uint8_t)(v >> 16);
+    p[3] = (uint8_t)(v >> 24);
+}
+
+static inline uint32_t get32(const uint8_t *p) {
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) |
+           ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static inline void put64(uint8_t *p, uint64_t v) {
+    put32(p, (uint32_t)v);
+    put32(p + 4, (uint32_t)(v >> 32));
+}
+
+static inline uint64_t get64(const uint8_t *p) {
+    return get32(p) | ((uint64_t)get32(p + 4) << 32);
+}
+
+static void put_loop(uint8_t *p, const uint32_t *loop, int n) {
+    for (int i = 0; i < n; i++) {
+        put32(p + 4 * i, loop[i]);
+    }
+}
+
+static void get_loop(const uint8_t *p, uint32_t *loop, int n) {
+    for (int i = 0; i < n; i++) {
+        loop[i] = get32(p + 4 * i);
+    }
+}
+
+#define HASH_BASIS          0xCBF29CE484222325ULL
+
+/* FNV-1a over little-endian words, from basis h */
+static uint64_t hash_words(uint64_t h, const uint8_t *p, size_t words) {
+    for (size_t i = 0; i < words; i++) {
+        h = (h ^ get32(p + 4 * i)) * 0x100000001B3ULL;
+    }
+    return h;
+}
+
+static void put_header(uint8_t *h, uint32_t header_words,
+                       uint32_t payload_words, uint32_t flags, uint64_t hash) {
+    put32(h + 4 * H_MAGIC_LO, SNAP_MAGIC_LO);
+    put32(h + 4 * H_MAGIC_HI, SNAP_MAGIC_HI);
+    put32(h + 4 * H_VERSION, SNAP_VERSION);
+    put32(h + 4 * H_HEADER_BYTES, header_words * 4);
+    put32(h + 4 * H_PAYLOAD_BYTES, payload_words * 4);
+    put32(h + 4 * H_FLAGS, flags);
+    put64(h + 4 * H_HASH_LO, hash);
+}
+
+/* Check a header of the given kind; returns the payload, or NULL */
+static const uint8_t *check_header(const uint8_t *h, size_t len,
+                                   uint32_t flags, uint32_t header_words,
+                                   uint32_t *payload_words) {
+    if (len < header_words * 4 ||
+        get32(h + 4 * H_MAGIC_LO) != SNAP_MAGIC_LO ||
+        get32(h + 4 * H_MAGIC_HI) != SNAP_MAGIC_HI ||
+        get32(h + 4 * H_VERSION) != SNAP_VERSION ||
+        get32(h + 4 * H_HEADER_BYTES) != header_words * 4 ||
+        get32(h + 4 * H_FLAGS) != flags) {
+        return NULL;
+    }
+    *payload_words = get32(h + 4 * H_PAYLOAD_BYTES) / 4;
+    if (len < ((size_t)header_words + *payload_words) * 4) {
+        return NULL;
+    }
+    return h + header_words * 4;
+}
+
+/* The state words that open both kinds of payload */
+static void encode_state(const d17b_cpu_t *cpu, uint8_t *p) {
+#define W(i) (p + 4 * (i))
+
+    memset(p, 0, P_MEMORY * 4);
+    put32(W(P_A), cpu->A);
+    put32(W(P_L), cpu->L);
+    put32(W(P_N), cpu->N);
+    put32(W(P_I), cpu->I);
+    put32(W(P_P), cpu->P);
+    put32(W(P_U), cpu->U);
+    put_loop(W(P_F), cpu->F, F_LOOP_SIZE);
+    put_loop(W(P_E), cpu->E, E_LOOP_SIZE);
+    put_loop(W(P_H), cpu->H, H_LOOP_SIZE);
+    put_loop(W(P_V), cpu->V, V_LOOP_SIZE);
+    put_loop(W(P_R), cpu->R, R_LOOP_SIZE);
+
+    put32(W(P_SECTOR), cpu->current_sector);
+    put64(W(P_CYCLES), cpu->cycle_count);
+    put64(W(P_LATENCY), cpu->latency_cycles);
+    put64(W(P_IDLE), cpu->idle_cycles);
+    put32(W(P_STATUS), (cpu->timing ? SNAP_TIMING : 0) |
+                       (cpu->fast_forward ? SNAP_FAST_FORWARD : 0) |
+                       (cpu->halted ? SNAP_HALTED : 0) |
+                       (cpu->error ? SNAP_ERROR : 0) |
+                       (cpu->d37c_mode ? SNAP_D37C : 0) |
+                       (cpu->detector ? SNAP_DETECTOR : 0) |
+                       (cpu->countdown_enabled ? SNAP_COUNTDOWN : 0));
+    put32(W(P_CORE), cpu->core);
+    put32(W(P_DISCRETE_IN_A), cpu->discrete_in_a);
+    put32(W(P_DISCRETE_IN_B), cpu->discrete_in_b);
+    put32(W(P_DISCRETE_OUT_A), cpu->discrete_out_a);
+    for (int i = 0; i < 4; i++) {
+        put32(W(P_VOLTAGE + i), (uint32_t)(int32_t)cpu->voltage_out[i]);
+        put32(W(P_BINARY + i), cpu->binary_out[i]);
+    }
+    put32(W(P_COUNTDOWN), cpu->fine_countdown);
+    put64(W(P_COUNTDOWN_BASE), cpu->countdown_base);
+#undef W
+}
+
+static void decode_state(d17b_cpu_t *cpu, const uint8_t *p) {
+#define W(i) (p + 4 * (i))
+
+    cpu->A = get32(W(P_A));
+    cpu->L = get32(W(P_L));
+    cpu->N = get32(W(P_N));
+    cpu->I = get32(W(P_I));
+    cpu->P = (uint8_t)get32(W(P_P));
+    cpu->U = get32(W(P_U));
+    get_loop(W(P_F), cpu->F, F_LOOP_SIZE);
+    get_loop(W(P_E), cpu->E, E_LOOP_SIZE);
+    get_loop(W(P_H), cpu->H, H_LOOP_SIZE);
+    get_loop(W(P_V), cpu->V, V_LOOP_SIZE);
+    get_loop(W(P_R), cpu->R, R_LOOP_SIZE);
+
+    cpu->current_sector = get32(W(P_SECTOR)) & 0x7F;
+    cpu->cycle_count = get64(W(P_CYCLES));
+    cpu->latency_cycles = get64(W(P_LATENCY));
+    cpu->idle_cycles = get64(W(P_IDLE));
+    uint32_t status = get32(W(P_STATUS));
+    cpu->timing = (status & SNAP_TIMING) != 0;
+    cpu->fast_forward = (status & SNAP_FAST_FORWARD) != 0;
+    cpu->halted = (status & SNAP_HALTED) != 0;
+    cpu->error = (status & SNAP_ERROR) != 0;
+    cpu->d37c_mode = (status & SNAP_D37C) != 0;
+    cpu->detector = (status & SNAP_DETECTOR) != 0;
+    cpu->countdown_enabled = (status & SNAP_COUNTDOWN) != 0;
+    cpu->core = (uint8_t)get32(W(P_CORE));
+    cpu->discrete_in_a = get32(W(P_DISCRETE_IN_A));
+    cpu->discrete_in_b = get32(W(P_DISCRETE_IN_B));
+    cpu->discrete_out_a = get32(W(P_DISCRETE_OUT_A));
+    for (int i = 0; i < 4; i++) {
+        cpu->voltage_out[i] = (int16_t)(int32_t)get32(W(P_VOLTAGE + i));
+        cpu->binary_out[i] = (uint8_t)get32(W(P_BINARY + i));
+    }
+    cpu->fine_countdown = get32(W(P_COUNTDOWN));
+    cpu->countdown_base = get64(W(P_COUNTDOWN_BASE));
+#undef W
+}
+
+size_t d17b_state_size(void) {
+    return SNAP_BYTES;
+}
+
+void d17b_state_encode(d17b_cpu_t *cpu, void *buf) {
+    uint8_t *h = buf;
+    uint8_t *p = h + SNAP_HEADER_WORDS * 4;
+#define W(i) (p + 4 * (i))
+
+    encode_state(cpu, p);
+    if (host_little_endian()) {
+        memcpy(W(P_MEMORY), cpu->memory, sizeof(cpu->memory));
+    } else {
+        const uint32_t *m = &cpu->memory[0][0];
+        for (int i = 0; i < CHANNELS * SECTORS; i++) {
+            put32(W(P_MEMORY + i), m[i]);
+        }
+    }
+#undef W
+
+    uint64_t hash = hash_words(HASH_BASIS, p, P_WORDS);
+    put_header(h, SNAP_HEADER_WORDS, P_WORDS, 0, hash);
+
+    /* The next delta is against this snapshot */
+    d17b_clear_dirty(cpu);
+    cpu->snapshot_id = hash;
+}
+
+bool d17b_state_decode(d17b_cpu_t *cpu, const void *buf, size_t len) {
+    uint32_t words;
+    const uint8_t *p = check_header(buf, len, 0, SNAP_HEADER_WORDS, &words);
+    if (!p || words != P_WORDS) {
+        return false;
+    }
+    uint64_t hash = hash_words(HASH_BASIS, p, P_WORDS);
+    if (hash != get64((const uint8_t *)buf + 4 * H_HASH_LO)) {
+        return false;
+    }
+#define W(i) (p + 4 * (i))
+
+    decode_state(cpu, p);
+    if (host_little_endian()) {
+        memcpy(cpu->memory, W(P_MEMORY), sizeof(cpu->memory));
+    } else {
+        uint32_t *m = &cpu->memory[0][0];
+        for (int i = 0; i < CHANNELS * SECTORS; i++) {
+            m[i] = get32(W(P_MEMORY + i));
+        }
+    }
+#undef W
+
+    cpu->io_event = false;
+    d17b_sched_clear(cpu);
+    d17b_flush_decode(cpu);
+    d17b_clear_dirty(cpu);
+    cpu->snapshot_id = hash;
+    return true;
+}
+
+/* ============================================================================
+ * DELTAS
+ * ============================================================================ */
+
+void d17b_clear_dirty(d17b_cpu_t *cpu) {
+    memset(cpu->dirty, 0, sizeof(cpu->dirty));
+}
+
+uint32_t d17b_dirty_sectors(const d17b_cpu_t *cpu) {
+    uint32_t n = 0;
+    for (int ch = 0; ch < CHANNELS; ch++) {
+        for (int i = 0; i < SECTORS / 64; i++) {
+            n += (uint32_t)__builtin_popcountll(cpu->dirty[ch][i]);
+        }
+    }
+    return n;
+}
+
+size_t d17b_delta_size(const d17b_cpu_t *cpu) {
+    return ((size_t)DELTA_HEADER_WORDS + D_WORDS + d17b_dirty_sectors(cpu)) * 4;
+}
+
+size_t d17b_delta_encode(d17b_cpu_t *cpu, void *buf) {
+    if (cpu->snapshot_id == 0) {
+        return 0;                       /* No parent to be a delta against */
+    }
+
+    uint8_t *h = buf;
+    uint8_t *p = h + DELTA_HEADER_WORDS * 4;
+    uint32_t words = D_WORDS;
+
+    encode_state(cpu, p);
+    for (int ch = 0; ch < CHANNELS; ch++) {
+        for (int i = 0; i < SECTORS / 64; i++) {
+            uint64_t bits = cpu->dirty[ch][i];
+            put64(p + 4 * (D_MAP + 4 * ch + 2 * i), bits);
+            while (bits) {
+                int sector = 64 * i + __builtin_ctzll(bits);
+                put32(p + 4 * words++, cpu->memory[ch][sector]);
+                bits &= bits - 1;
+            }
+        }
+    }
+
+    uint64_t hash = hash_words(HASH_BASIS ^ cpu->snapshot_id, p, words);
+    put_header(h, DELTA_HEADER_WORDS, words, SNAP_FLAG_DELTA, hash);
+    put64(h + 4 * H_PARENT_LO, cpu->snapshot_id);
+
+    d17b_clear_dirty(cpu);
+    cpu->snapshot_id = hash;
+    return ((size_t)DELTA_HEADER_WORDS + words) * 4;
+}
+
+bool d17b_delta_apply(d17b_cpu_t *cpu, const void *buf, size_t len) {
+    const uint8_t *h = buf;
+    uint32_t words;
+    const uint8_t *p = check_header(h, len, SNAP_FLAG_DELTA,
+                                    DELTA_HEADER_WORDS, &words);
+    /* The cpu must still hold the parent, untouched since */
+    if (!p || words < D_WORDS || cpu->snapshot_id == 0 ||
+        get64(h + 4 * H_PARENT_LO) != cpu->snapshot_id ||
+        d17b_dirty_sectors(cpu) != 0) {
+        return false;
+    }
+    uint64_t hash = hash_words(HASH_BASIS ^ cpu->snapshot_id, p, words);
+    if (hash != get64(h + 4 * H_HASH_LO)) {
+        return false;
+    }
+
+    /* The map must account for exactly the words after it */
+    uint32_t count = 0;
+    for (int i = 0; i < CHANNELS * 4; i++) {
+        count += (uint32_t)__builtin_popcount(get32(p + 4 * (D_MAP + i)));
+    }
+    if (D_WORDS + count != words) {
+        return false;
+    }
+
+    /* Only the changed sectors are written, through the decode cache */
+    uint32_t at = D_WORDS;
+    for (int ch = 0; ch < CHANNELS; ch++) {
+        for (int i = 0; i < SECTORS / 64; i++) {
+            uint64_t bits = get64(p + 4 * (D_MAP + 4 * ch + 2 * i));
+            while (bits) {
+                int sector = 64 * i + __builtin_ctzll(bits);
+                d17b_write(cpu, (uint8_t)ch, (uint8_t)sector,
+                           get32(p + 4 * at++));
+                bits &= bits - 1;
+            }
+        }
+    }
+
+    bool d37c = cpu->d37c_mode;
+    decode_state(cpu, p);
+    cpu->io_event = false;
+    d17b_sched_clear(cpu);
+    if (cpu->d37c_mode != d37c) {
+        d17b_flush_decode(cpu);
+    }
+    d17b_clear_dirty(cpu);
+    cpu->snapshot_id = hash;
+    return true;
+}
+
+/* ============================================================================
+ * FILES
+ * ============================================================================ */
+
+static bool write_file(const char *path, const void *buf, size_t len) {
+    FILE *f = fopen(path, "wb");
+    bool ok = f && fwrite(buf, 1, len, f) == len;
+    if (f && fclose(f) != 0) {
+        ok = false;
+    }
+    return ok;
+}
+
+/* Either kind of snapshot, by its header flags */
+static bool apply_any(d17b_cpu_t *cpu, const uint8_t *buf, size_t len) {
+    if (len >= SNAP_HEADER_WORDS * 4 &&
+        get32(buf + 4 * H_FLAGS) == SNAP_FLAG_DELTA) {
+        return d17b_delta_apply(cpu, buf, len);
+    }
+    return d17b_state_decode(cpu, buf, len);
+}
+
+bool d17b_save_state(d17b_cpu_t *cpu, const char *path) {
+    uint8_t *buf = malloc(SNAP_BYTES);
+    if (!buf) {
+        return false;
+    }
+    d17b_state_encode(cpu, buf);
+    bool ok = write_file(path, buf, SNAP_BYTES);
+    free(buf);
+    return ok;
+}
+
+bool d17b_save_delta(d17b_cpu_t *cpu, const char *path) {
+    uint8_t *buf = malloc(d17b_delta_size(cpu));
+    if (!buf) {
+        return false;
+    }
+    size_t len = d17b_delta_encode(cpu, buf);
+    bool ok = len && write_file(path, buf, len);
+    free(buf);
+    return ok;
+}
+
+bool d17b_load_state(d17b_cpu_t *cpu, const char *path) {
+#ifndef _WIN32
+    /* Map the file and decode straight out of the page cache */
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size < (off_t)(SNAP_HEADER_WORDS * 4)) {
+        close(fd);
+        return false;
+    }
+    void *map = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        return false;
+    }
+    bool ok = apply_any(cpu, map, (size_t)st.st_size);
+    munmap(map, (size_t)st.st_size);
+    return ok;
+#else
+    FILE *f = fopen(path, "rb");
+    if (!f) {
+        return false;
+    }
+    long size = fseek(f, 0, SEEK_END) == 0 ? ftell(f) : -1;
+    uint8_t *buf = size > 0 ? malloc((size_t)size) : NULL;
+    bool ok = buf && fseek(f, 0, SEEK_SET) == 0 &&
+              fread(buf, 1, (size_t)size, f) == (size_t)size &&
+              apply_any(cpu, buf, (size_t)size);
+    fclose(f);
+    free(buf);
+    return ok;
+#endif
+}
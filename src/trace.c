@@ -0,0 +1,191 @@
+/*
+ * D17B Minuteman I Guidance Computer Emulator
+ * Execution trace ring
+ *
+ * The step loop fills fixed-size records into a power-of-two ring (see
+ * d17b_trace_fetch) and a drain thread writes them out in runs of up to
+ * TRACE_CHUNK. Neither side takes a lock: each owns one position, head
+ * for the step loop and tail for the drain thread, and publishes it with
+ * a release store. The step loop reads tail only when the ring looks
+ * full, so a trace that keeps up costs it one record's stores and no
+ * shared cache line traffic beyond the head it publishes.
+ *
+ * A full ring either waits (D17B_TRACE_BLOCK), yielding until the drain
+ * thread makes room, or drops the record (D17B_TRACE_DROP). Dropped
+ * records are counted, and the next record written carries how many
+ * went just before it, so a reader sees where the holes are. The drain
+ * thread sleeps briefly when the ring is empty; after a write error it
+ * carries on emptying the ring so a blocking trace never stalls.
+ *
+ * A packed trace is encoded on the drain thread too (tracefile.c), so
+ * the step loop pays the same for either format.
+ *
+ * Copyright 2025 Zane Hambly - Apache 2.0 License
+ */
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "d17b.h"
+#include "d17b_internal.h"
+
+#define TRACE_MAGIC_LO      0x42373144u     /* "D17B" */
+#define TRACE_MAGIC_HI      0x43415254u     /* "TRAC" */
+#define TRACE_VERSION       1
+#define TRACE_RECORDS       65536           /* Default ring size */
+#define TRACE_CHUNK         4096            /* Most records per fwrite */
+#define TRACE_IDLE_NS       100000          /* Drain thread sleep when empty */
+
+struct d17b_trace_io {
+    FILE *f;
+    d17b_packer_t *pack;                /* Packed format, else NULL */
+    pthread_t thread;
+    bool stop;                          /* Set by d17b_trace_stop */
+    bool failed;                        /* A write went wrong */
+};
+
+/* ============================================================================
+ * PRODUCER
+ * ============================================================================ */
+
+/* The ring is full: wait for room, or drop. True if there is room now */
+bool d17b_trace_wait(struct d17b_trace *t) {
+    if (t->full == D17B_TRACE_DROP) {
+        t->dropped++;
+        if (t->gap != UINT32_MAX) {
+            t->gap++;
+        }
+        return false;
+    }
+
+    do {
+        sched_yield();
+        t->tail_seen = __atomic_load_n(&t->tail, __ATOMIC_ACQUIRE);
+    } while (t->head - t->tail_seen > t->mask);
+    return true;
+}
+
+/* ============================================================================
+ * CONSUMER
+ * ============================================================================ */
+
+static void *trace_drain(void *arg) {
+    struct d17b_trace *t = arg;
+    struct d17b_trace_io *io = t->io;
+    const struct timespec idle = { 0, TRACE_IDLE_NS };
+
+    for (;;) {
+        uint64_t head = __atomic_load_n(&t->head, __ATOMIC_ACQUIRE);
+        if (head == t->tail) {
+            /* Stop comes after the last record, so one more look */
+            if (__atomic_load_n(&io->stop, __ATOMIC_ACQUIRE)) {
+                if (__atomic_load_n(&t->head, __ATOMIC_ACQUIRE) == t->tail) {
+                    break;
+                }
+                continue;
+            }
+            nanosleep(&idle, NULL);
+            continue;
+        }
+
+        /* Up to the wrap, in chunks so the producer gets room back early */
+        uint64_t at = t->tail & t->mask;
+        uint64_t n = head - t->tail;
+        if (n > t->mask + 1 - at) {
+            n = t->mask + 1 - at;
+        }
+        if (n > TRACE_CHUNK) {
+            n = TRACE_CHUNK;
+        }
+        if (io->pack) {
+            for (uint64_t i = 0; i < n; i++) {
+                d17b_pack_put(io->pack, &t->ring[at + i]);
+            }
+        } else if (!io->failed &&
+                   fwrite(&t->ring[at], sizeof(*t->ring), n, io->f) != n) {
+            io->failed = true;
+        }
+        __atomic_store_n(&t->tail, t->tail + n, __ATOMIC_RELEASE);
+    }
+    return NULL;
+}
+
+/* ============================================================================
+ * INTERFACE
+ * ============================================================================ */
+
+static void trace_free(struct d17b_trace *t) {
+    if (t->io && t->io->pack) {
+        d17b_pack_close(t->io->pack);
+    }
+    if (t->io && t->io->f) {
+        fclose(t->io->f);
+    }
+    free(t->io);
+    free(t->ring);
+    free(t);
+}
+
+bool d17b_trace_start(d17b_cpu_t *cpu, const char *path, uint32_t records,
+                      d17b_trace_full_t full, d17b_trace_format_t format) {
+    if (cpu->trace) {
+        return false;
+    }
+
+    uint64_t size = 1;
+    while (size < (records ? records : TRACE_RECORDS)) {
+        size <<= 1;
+    }
+
+    struct d17b_trace *t = calloc(1, sizeof(*t));
+    if (!t) {
+        return false;
+    }
+    t->io = calloc(1, sizeof(*t->io));
+    t->ring = malloc(size * sizeof(*t->ring));
+    t->mask = size - 1;
+    t->full = (uint8_t)full;
+    if (!t->io || !t->ring || !(t->io->f = fopen(path, "wb"))) {
+        trace_free(t);
+        return false;
+    }
+
+    uint32_t header[4] = { TRACE_MAGIC_LO, TRACE_MAGIC_HI, TRACE_VERSION,
+                           sizeof(d17b_trace_rec_t) };
+    bool opened = format == D17B_TRACE_PACKED
+        ? (t->io->pack = d17b_pack_open(t->io->f)) != NULL
+        : fwrite(header, sizeof(header), 1, t->io->f) == 1;
+    if (!opened || pthread_create(&t->io->thread, NULL, trace_drain, t) != 0) {
+        trace_free(t);
+        return false;
+    }
+
+    cpu->trace = t;
+    return true;
+}
+
+bool d17b_trace_stop(d17b_cpu_t *cpu, uint64_t *dropped) {
+    struct d17b_trace *t = cpu->trace;
+    if (!t) {
+        return false;
+    }
+
+    __atomic_store_n(&t->io->stop, true, __ATOMIC_RELEASE);
+    pthread_join(t->io->thread, NULL);
+
+    bool ok = !t->io->failed;
+    if (t->io->pack) {
+        ok = d17b_pack_close(t->io->pack) && ok;
+        t->io->pack = NULL;
+    }
+    ok = fclose(t->io->f) == 0 && ok;
+    t->io->f = NULL;
+    if (dropped) {
+        *dropped = t->dropped;
+    }
+    trace_free(t);
+    cpu->trace = NULL;
+    return ok;
+}
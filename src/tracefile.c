@@ -0,0 +1,633 @@
+/*
+ * D17B Minuteman I Guidance Computer Emulator
+ * Packed trace files
+ *
+ * A packed trace stores each record as its difference from the one
+ * before. Most instructions follow their Sp chain, come one word time
+ * after the last and leave L and the flags alone, so they cost a tag
+ * byte and the bits of A that changed. Records are grouped in chunks
+ * that start from a blank state, so every chunk decodes on its own, and
+ * an index at the end gives each chunk's offset and first and last
+ * cycle: seeking to cycle N decodes only the chunk that holds it. A
+ * trace cut short has no index; the reader then walks the chunk headers
+ * instead and leaves out a chunk that was cut off.
+ *
+ * All words are little-endian:
+ *   header   "D17B" "TRCZ", version, records per chunk
+ *   chunk    "CHNK", records, payload bytes, 0, first cycle, last cycle;
+ *            then the payload
+ *   index    per chunk: offset, first cycle, last cycle, records, 0
+ *   trailer  index offset, chunks, "TEND"
+ *
+ * A record is a tag byte, then the fields it marks:
+ *   bits 0-1  I: 0 the Sp successor of the last instruction, 1 its C,S
+ *             (a transfer taken), 2 a sector byte in the last channel,
+ *             3 two bytes of I >> 2
+ *   bit 2     cycle - last cycle as a varint, if not 1
+ *   bit 3     the instruction word, 3 bytes, if not the word last seen
+ *             at that address in this chunk
+ *   bit 4     A xor the last A, varint
+ *   bit 5     L xor the last L, varint
+ *   bit 6     flags, 1 byte
+ *   bit 7     dropped, varint
+ * A cycle lower than the last (a reset, or running on after stepping
+ * back) starts a new chunk, so cycles only rise within one.
+ *
+ * The reader takes raw traces too (trace.c); seeking in one is a binary
+ * search, which assumes cycles only rise.
+ *
+ * Copyright 2025 Zane Hambly - Apache 2.0 License
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "d17b.h"
+#include "d17b_internal.h"
+
+#define TRACE_MAGIC_LO      0x42373144u     /* "D17B" */
+#define TRACE_MAGIC_RAW     0x43415254u     /* "TRAC" */
+#define TRACE_MAGIC_PACKED  0x5A435254u     /* "TRCZ" */
+#define TRACE_VERSION       1               /* Of the raw format */
+#define PACK_MAGIC_CHUNK    0x4B4E4843u     /* "CHNK" */
+#define PACK_MAGIC_END      0x444E4554u     /* "TEND" */
+#define PACK_VERSION        1
+#define PACK_HEADER_BYTES   16
+#define PACK_CHUNK_BYTES    32
+#define PACK_INDEX_BYTES    32
+#define PACK_TRAILER_BYTES  16
+#define PACK_RECORDS        16384           /* Records per chunk */
+#define PACK_RECORD_MAX     32              /* Longest encoded record */
+#define PACK_ADDRESSES      8192            /* I >> 2 */
+
+#define TAG_I_SP            0
+#define TAG_I_TARGET        1
+#define TAG_I_SECTOR        2
+#define TAG_I_FULL          3
+#define TAG_CYCLE           0x04
+#define TAG_INSTR           0x08
+#define TAG_A               0x10
+#define TAG_L               0x20
+#define TAG_FLAGS           0x40
+#define TAG_DROPPED         0x80
+
+#define CS_BITS             ((0x3Fu << 9) | (0x7Fu << 2))
+
+/* What both ends keep, reset at every chunk */
+typedef struct {
+    d17b_trace_rec_t last;
+    uint32_t word[PACK_ADDRESSES];      /* Instruction last seen at I >> 2 */
+} pack_state_t;
+
+struct d17b_packer {
+    FILE *f;
+    bool failed;
+    uint64_t offset;                    /* Where the next chunk goes */
+
+    uint32_t count;                     /* Records in the open chunk */
+    uint64_t first;
+    size_t used;
+    uint8_t *buf;
+    pack_state_t state;
+
+    d17b_trace_chunk_t *index;
+    uint32_t chunks;
+    uint32_t capacity;
+};
+
+struct d17b_trace_reader {
+    FILE *f;
+    bool packed;
+
+    /* Raw */
+    uint64_t records;
+    uint64_t next;                      /* Next record to read */
+
+    /* Packed */
+    d17b_trace_chunk_t *index;
+    uint32_t chunks;
+    uint32_t chunk;                     /* Next chunk to load */
+    uint32_t left;                      /* Records left in the loaded one */
+    uint8_t *buf;
+    size_t capacity;
+    size_t size;
+    size_t pos;
+    pack_state_t state;
+
+    bool held;                          /* seek found 'hold' */
+    d17b_trace_rec_t hold;
+};
+
+static inline void put32(uint8_t *p, uint32_t v) {
+    p[0] = (uint8_t)v;
+    p[1] = (uint8_t)(v >> 8);
+    p[2] = (uint8_t)(v >> 16);
+    p[3] = (uint8_t)(v >> 24);
+}
+
+static inline uint32_t get32(const uint8_t *p) {
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) |
+           ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static inline void put64(uint8_t *p, uint64_t v) {
+    put32(p, (uint32_t)v);
+    put32(p + 4, (uint32_t)(v >> 32));
+}
+
+static inline uint64_t get64(const uint8_t *p) {
+    return get32(p) | ((uint64_t)get32(p + 4) << 32);
+}
+
+static void state_reset(pack_state_t *s, uint64_t first) {
+    memset(&s->last, 0, sizeof(s->last));
+    s->last.cycle = first - 1;
+    memset(s->word, 0xFF, sizeof(s->word));
+}
+
+/* Where the last instruction sends I: its Sp successor, or C,S */
+static inline uint32_t sp_next(const d17b_trace_rec_t *r) {
+    return (r->I & (0x3Fu << 9)) | (((r->instr >> 15) & 0xF) << 2);
+}
+
+/* ============================================================================
+ * WRITER
+ * ============================================================================ */
+
+static size_t put_varint(uint8_t *p, uint64_t v) {
+    size_t n = 0;
+    while (v >= 0x80) {
+        p[n++] = (uint8_t)(v | 0x80);
+        v >>= 7;
+    }
+    p[n++] = (uint8_t)v;
+    return n;
+}
+
+static void pack_flush(d17b_packer_t *p) {
+    if (!p->count) {
+        return;
+    }
+
+    if (p->chunks == p->capacity) {
+        uint32_t grow = p->capacity ? p->capacity * 2 : 256;
+        d17b_trace_chunk_t *index = realloc(p->index, grow * sizeof(*index));
+        if (!index) {
+            p->failed = true;
+            p->count = 0;
+            p->used = 0;
+            return;
+        }
+        p->index = index;
+        p->capacity = grow;
+    }
+    d17b_trace_chunk_t *c = &p->index[p->chunks++];
+    c->offset = p->offset;
+    c->first = p->first;
+    c->last = p->state.last.cycle;
+    c->records = p->count;
+
+    uint8_t header[PACK_CHUNK_BYTES];
+    put32(header, PACK_MAGIC_CHUNK);
+    put32(header + 4, p->count);
+    put32(header + 8, (uint32_t)p->used);
+    put32(header + 12, 0);
+    put64(header + 16, c->first);
+    put64(header + 24, c->last);
+    if (fwrite(header, 1, sizeof(header), p->f) != sizeof(header) ||
+        fwrite(p->buf, 1, p->used, p->f) != p->used) {
+        p->failed = true;
+    }
+    p->offset += sizeof(header) + p->used;
+    p->count = 0;
+    p->used = 0;
+}
+
+d17b_packer_t *d17b_pack_open(FILE *f) {
+    d17b_packer_t *p = calloc(1, sizeof(*p));
+    if (!p) {
+        return NULL;
+    }
+    p->buf = malloc(PACK_RECORDS * PACK_RECORD_MAX);
+
+    uint8_t header[PACK_HEADER_BYTES];
+    put32(header, TRACE_MAGIC_LO);
+    put32(header + 4, TRACE_MAGIC_PACKED);
+    put32(header + 8, PACK_VERSION);
+    put32(header + 12, PACK_RECORDS);
+    if (!p->buf || fwrite(header, 1, sizeof(header), f) != sizeof(header)) {
+        free(p->buf);
+        free(p);
+        return NULL;
+    }
+    p->f = f;
+    p->offset = sizeof(header);
+    return p;
+}
+
+void d17b_pack_put(d17b_packer_t *p, const d17b_trace_rec_t *r) {
+    pack_state_t *s = &p->state;
+    if (p->count && r->cycle < s->last.cycle) {
+        pack_flush(p);
+    }
+    if (!p->count) {
+        p->first = r->cycle;
+        state_reset(s, r->cycle);
+    }
+
+    const d17b_trace_rec_t *last = &s->last;
+    uint8_t *out = p->buf + p->used;
+    uint8_t tag;
+    size_t n = 1;
+
+    if (r->I == sp_next(last)) {
+        tag = TAG_I_SP;
+    } else if (r->I == (last->instr & CS_BITS)) {
+        tag = TAG_I_TARGET;
+    } else if ((r->I >> 9) == (last->I >> 9)) {
+        tag = TAG_I_SECTOR;
+        out[n++] = (uint8_t)(r->I >> 2);
+    } else {
+        tag = TAG_I_FULL;
+        out[n++] = (uint8_t)(r->I >> 2);
+        out[n++] = (uint8_t)(r->I >> 10);
+    }
+    if (r->cycle - last->cycle != 1) {
+        tag |= TAG_CYCLE;
+        n += put_varint(out + n, r->cycle - last->cycle);
+    }
+    uint32_t *word = &s->word[(r->I >> 2) & (PACK_ADDRESSES - 1)];
+    if (*word != r->instr) {
+        tag |= TAG_INSTR;
+        out[n++] = (uint8_t)r->instr;
+        out[n++] = (uint8_t)(r->instr >> 8);
+        out[n++] = (uint8_t)(r->instr >> 16);
+        *word = r->instr;
+    }
+    if (r->A != last->A) {
+        tag |= TAG_A;
+        n += put_varint(out + n, r->A ^ last->A);
+    }
+    if (r->L != last->L) {
+        tag |= TAG_L;
+        n += put_varint(out + n, r->L ^ last->L);
+    }
+    if (r->flags != last->flags) {
+        tag |= TAG_FLAGS;
+        out[n++] = (uint8_t)r->flags;
+    }
+    if (r->dropped) {
+        tag |= TAG_DROPPED;
+        n += put_varint(out + n, r->dropped);
+    }
+    out[0] = tag;
+
+    p->used += n;
+    s->last = *r;
+    if (++p->count == PACK_RECORDS) {
+        pack_flush(p);
+    }
+}
+
+bool d17b_pack_close(d17b_packer_t *p) {
+    pack_flush(p);
+
+    /* The index, then where it starts */
+    uint64_t at = p->offset;
+    for (uint32_t i = 0; i < p->chunks && !p->failed; i++) {
+        uint8_t e[PACK_INDEX_BYTES];
+        put64(e, p->index[i].offset);
+        put64(e + 8, p->index[i].first);
+        put64(e + 16, p->index[i].last);
+        put32(e + 24, p->index[i].records);
+        put32(e + 28, 0);
+        p->failed = fwrite(e, 1, sizeof(e), p->f) != sizeof(e);
+    }
+    uint8_t trailer[PACK_TRAILER_BYTES];
+    put64(trailer, at);
+    put32(trailer + 8, p->chunks);
+    put32(trailer + 12, PACK_MAGIC_END);
+    bool ok = !p->failed &&
+              fwrite(trailer, 1, sizeof(trailer), p->f) == sizeof(trailer);
+
+    free(p->index);
+    free(p->buf);
+    free(p);
+    return ok;
+}
+
+/* ============================================================================
+ * READER
+ * ============================================================================ */
+
+static bool get_varint(const d17b_trace_reader_t *r, size_t *pos, uint64_t *v) {
+    *v = 0;
+    for (int shift = 0; shift < 64 && *pos < r->size; shift += 7) {
+        uint8_t b = r->buf[(*pos)++];
+        *v |= (uint64_t)(b & 0x7F) << shift;
+        if (!(b & 0x80)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static bool index_add(d17b_trace_reader_t *r, uint32_t *capacity,
+                      const d17b_trace_chunk_t *c) {
+    if (r->chunks == *capacity) {
+        uint32_t grow = *capacity ? *capacity * 2 : 256;
+        d17b_trace_chunk_t *index = realloc(r->index, grow * sizeof(*index));
+        if (!index) {
+            return false;
+        }
+        r->index = index;
+        *capacity = grow;
+    }
+    r->index[r->chunks++] = *c;
+    return true;
+}
+
+/* Read the index, or rebuild it from the chunk headers */
+static bool load_index(d17b_trace_reader_t *r, long size) {
+    uint8_t b[PACK_INDEX_BYTES];
+    uint32_t capacity = 0;
+
+    if (size >= PACK_HEADER_BYTES + PACK_TRAILER_BYTES &&
+        fseek(r->f, size - PACK_TRAILER_BYTES, SEEK_SET) == 0 &&
+        fread(b, 1, PACK_TRAILER_BYTES, r->f) == PACK_TRAILER_BYTES &&
+        get32(b + 12) == PACK_MAGIC_END) {
+        uint64_t at = get64(b);
+        uint32_t chunks = get32(b + 8);
+        if (at + (uint64_t)chunks * PACK_INDEX_BYTES + PACK_TRAILER_BYTES ==
+                (uint64_t)size && fseek(r->f, (long)at, SEEK_SET) == 0) {
+            for (uint32_t i = 0; i < chunks; i++) {
+                d17b_trace_chunk_t c;
+                if (fread(b, 1, PACK_INDEX_BYTES, r->f) != PACK_INDEX_BYTES) {
+                    return false;
+                }
+                c.offset = get64(b);
+                c.first = get64(b + 8);
+                c.last = get64(b + 16);
+                c.records = get32(b + 24);
+                if (!index_add(r, &capacity, &c)) {
+                    return false;
+                }
+            }
+            return true;
+        }
+    }
+
+    /* No index: walk the chunks, stopping at one that is cut off */
+    uint64_t at = PACK_HEADER_BYTES;
+    while (at + PACK_CHUNK_BYTES <= (uint64_t)size &&
+           fseek(r->f, (long)at, SEEK_SET) == 0 &&
+           fread(b, 1, PACK_CHUNK_BYTES, r->f) == PACK_CHUNK_BYTES &&
+           get32(b) == PACK_MAGIC_CHUNK) {
+        d17b_trace_chunk_t c = { .offset = at, .records = get32(b + 4),
+                                 .first = get64(b + 16), .last = get64(b + 24) };
+        at += PACK_CHUNK_BYTES + (uint64_t)get32(b + 8);
+        if (at > (uint64_t)size || !index_add(r, &capacity, &c)) {
+            break;
+        }
+    }
+    return true;
+}
+
+d17b_trace_reader_t *d17b_trace_open(const char *path) {
+    d17b_trace_reader_t *r = calloc(1, sizeof(*r));
+    if (!r) {
+        return NULL;
+    }
+    r->f = fopen(path, "rb");
+
+    uint8_t h[PACK_HEADER_BYTES];
+    uint32_t raw[4];
+    long size = -1;
+    if (r->f && fread(h, 1, sizeof(h), r->f) == sizeof(h) &&
+        fseek(r->f, 0, SEEK_END) == 0) {
+        size = ftell(r->f);
+    }
+    memcpy(raw, h, sizeof(raw));
+
+    bool ok = false;
+    if (size < 0) {
+        ok = false;
+    } else if (get32(h) == TRACE_MAGIC_LO && get32(h + 4) == TRACE_MAGIC_PACKED &&
+               get32(h + 8) == PACK_VERSION) {
+        r->packed = true;
+        ok = load_index(r, size);
+    } else if (raw[0] == TRACE_MAGIC_LO && raw[1] == TRACE_MAGIC_RAW &&
+               raw[2] == TRACE_VERSION && raw[3] == sizeof(d17b_trace_rec_t)) {
+        r->records = (uint64_t)(size - PACK_HEADER_BYTES) / sizeof(d17b_trace_rec_t);
+        ok = fseek(r->f, PACK_HEADER_BYTES, SEEK_SET) == 0;
+    }
+
+    if (!ok) {
+        d17b_trace_close(r);
+        return NULL;
+    }
+    return r;
+}
+
+void d17b_trace_close(d17b_trace_reader_t *r) {
+    if (!r) {
+        return;
+    }
+    if (r->f) {
+        fclose(r->f);
+    }
+    free(r->index);
+    free(r->buf);
+    free(r);
+}
+
+const d17b_trace_chunk_t *d17b_trace_index(const d17b_trace_reader_t *r,
+                                           uint32_t *chunks) {
+    *chunks = r->chunks;
+    return r->packed ? r->index : NULL;
+}
+
+static bool load_chunk(d17b_trace_reader_t *r, uint32_t i) {
+    uint8_t h[PACK_CHUNK_BYTES];
+    if (fseek(r->f, (long)r->index[i].offset, SEEK_SET) != 0 ||
+        fread(h, 1, sizeof(h), r->f) != sizeof(h) ||
+        get32(h) != PACK_MAGIC_CHUNK) {
+        return false;
+    }
+
+    size_t bytes = get32(h + 8);
+    if (bytes > r->capacity || !r->buf) {
+        uint8_t *buf = realloc(r->buf, bytes ? bytes : 1);
+        if (!buf) {
+            return false;
+        }
+        r->buf = buf;
+        r->capacity = bytes;
+    }
+    if (fread(r->buf, 1, bytes, r->f) != bytes) {
+        return false;
+    }
+    r->size = bytes;
+    r->pos = 0;
+    r->left = get32(h + 4);
+    r->chunk = i + 1;
+    state_reset(&r->state, get64(h + 16));
+    return true;
+}
+
+static bool unpack(d17b_trace_reader_t *r, d17b_trace_rec_t *out) {
+    while (r->left == 0) {
+        if (r->chunk >= r->chunks || !load_chunk(r, r->chunk)) {
+            return false;
+        }
+    }
+
+    pack_state_t *s = &r->state;
+    const d17b_trace_rec_t *last = &s->last;
+    d17b_trace_rec_t rec;
+    uint64_t v;
+    size_t pos = r->pos;
+    if (pos >= r->size) {
+        return false;
+    }
+    uint8_t tag = r->buf[pos++];
+
+    switch (tag & 3) {
+        case TAG_I_SP:
+            rec.I = sp_next(last);
+            break;
+        case TAG_I_TARGET:
+            rec.I = last->instr & CS_BITS;
+            break;
+        case TAG_I_SECTOR:
+            if (pos + 1 > r->size) {
+                return false;
+            }
+            rec.I = (last->I & (0x3Fu << 9)) | ((uint32_t)(r->buf[pos++] & 0x7F) << 2);
+            break;
+        default:
+            if (pos + 2 > r->size) {
+                return false;
+            }
+            rec.I = (((uint32_t)r->buf[pos] | ((uint32_t)r->buf[pos + 1] << 8)) << 2) &
+                    CS_BITS;
+            pos += 2;
+            break;
+    }
+
+    rec.cycle = last->cycle + 1;
+    if (tag & TAG_CYCLE) {
+        if (!get_varint(r, &pos, &v)) {
+            return false;
+        }
+        rec.cycle = last->cycle + v;
+    }
+    uint32_t *word = &s->word[(rec.I >> 2) & (PACK_ADDRESSES - 1)];
+    if (tag & TAG_INSTR) {
+        if (pos + 3 > r->size) {
+            return false;
+        }
+        *word = (uint32_t)r->buf[pos] | ((uint32_t)r->buf[pos + 1] << 8) |
+                ((uint32_t)r->buf[pos + 2] << 16);
+        pos += 3;
+    }
+    rec.instr = *word;
+    rec.A = last->A;
+    if (tag & TAG_A) {
+        if (!get_varint(r, &pos, &v)) {
+            return false;
+        }
+        rec.A ^= (uint32_t)v;
+    }
+    rec.L = last->L;
+    if (tag & TAG_L) {
+        if (!get_varint(r, &pos, &v)) {
+            return false;
+        }
+        rec.L ^= (uint32_t)v;
+    }
+    rec.flags = last->flags;
+    if (tag & TAG_FLAGS) {
+        if (pos + 1 > r->size) {
+            return false;
+        }
+        rec.flags = r->buf[pos++];
+    }
+    rec.dropped = 0;
+    if (tag & TAG_DROPPED) {
+        if (!get_varint(r, &pos, &v)) {
+            return false;
+        }
+        rec.dropped = (uint32_t)v;
+    }
+
+    r->pos = pos;
+    r->left--;
+    s->last = rec;
+    *out = rec;
+    return true;
+}
+
+bool d17b_trace_next(d17b_trace_reader_t *r, d17b_trace_rec_t *rec) {
+    if (r->held) {
+        r->held = false;
+        *rec = r->hold;
+        return true;
+    }
+    if (r->packed) {
+        return unpack(r, rec);
+    }
+    if (r->next >= r->records || fread(rec, sizeof(*rec), 1, r->f) != 1) {
+        return false;
+    }
+    r->next++;
+    return true;
+}
+
+static bool read_raw(d17b_trace_reader_t *r, uint64_t i, d17b_trace_rec_t *rec) {
+    return fseek(r->f, (long)(PACK_HEADER_BYTES + i * sizeof(*rec)), SEEK_SET) == 0 &&
+           fread(rec, sizeof(*rec), 1, r->f) == 1;
+}
+
+bool d17b_trace_seek(d17b_trace_reader_t *r, uint64_t cycle) {
+    d17b_trace_rec_t rec;
+    r->held = false;
+
+    if (!r->packed) {
+        /* First record at or after 'cycle' */
+        uint64_t lo = 0, hi = r->records;
+        while (lo < hi) {
+            uint64_t mid = lo + (hi - lo) / 2;
+            if (!read_raw(r, mid, &rec)) {
+                return false;
+            }
+            if (rec.cycle < cycle) {
+                lo = mid + 1;
+            } else {
+                hi = mid;
+            }
+        }
+        r->next = lo;
+        return lo < r->records &&
+               fseek(r->f, (long)(PACK_HEADER_BYTES + lo * sizeof(rec)), SEEK_SET) == 0;
+    }
+
+    /* The first chunk, in file order, that gets as far as 'cycle' */
+    for (uint32_t i = 0; i < r->chunks; i++) {
+        if (r->index[i].last < cycle) {
+            continue;
+        }
+        if (!load_chunk(r, i)) {
+            return false;
+        }
+        while (unpack(r, &rec)) {
+            if (rec.cycle >= cycle) {
+                r->hold = rec;
+                r->held = true;
+                return true;
+            }
+        }
+        return false;
+    }
+    return false;
+}
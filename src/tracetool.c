@@ -0,0 +1,84 @@
+/*
+ * D17B Minuteman I Guidance Computer Emulator
+ * Trace file reader
+ *
+ * Prints a raw or packed execution trace, from its start or from a
+ * cycle, or lists the chunk index of a packed one. It needs only
+ * tracefile.c, not the emulator.
+ *
+ * Copyright 2025 Zane Hambly - Apache 2.0 License
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "d17b.h"
+
+static int list_index(const d17b_trace_reader_t *r) {
+    uint32_t chunks;
+    const d17b_trace_chunk_t *index = d17b_trace_index(r, &chunks);
+    if (!index) {
+        printf("Raw trace: no index\n");
+        return 0;
+    }
+
+    printf("chunk      offset         first          last  records\n");
+    for (uint32_t i = 0; i < chunks; i++) {
+        printf("%5u  %10llu  %12llu  %12llu  %7u\n", i,
+               (unsigned long long)index[i].offset,
+               (unsigned long long)index[i].first,
+               (unsigned long long)index[i].last, index[i].records);
+    }
+    return 0;
+}
+
+static int print_records(d17b_trace_reader_t *r, uint64_t from, uint64_t count) {
+    d17b_trace_rec_t rec;
+    if (from && !d17b_trace_seek(r, from)) {
+        fprintf(stderr, "Nothing at or after cycle %llu\n", (unsigned long long)from);
+        return 1;
+    }
+
+    printf("       cycle  C:S     instr      A         L         flags\n");
+    for (uint64_t n = 0; n < count && d17b_trace_next(r, &rec); n++) {
+        if (rec.dropped) {
+            printf("             (%u dropped)\n", rec.dropped);
+        }
+        printf("%12llu  %02o:%03o  %08o  %08o  %08o  %c%c%c%c\n",
+               (unsigned long long)rec.cycle, (rec.I >> 9) & 0x3F,
+               (rec.I >> 2) & 0x7F, rec.instr, rec.A, rec.L,
+               (rec.flags & D17B_TRACE_DETECTOR) ? 'D' : '-',
+               (rec.flags & D17B_TRACE_ERROR) ? 'E' : '-',
+               (rec.flags & D17B_TRACE_D37C) ? 'C' : '-',
+               (rec.flags & D17B_TRACE_TIMING) ? 'T' : '-');
+    }
+    return 0;
+}
+
+int main(int argc, char *argv[]) {
+    bool index = argc > 1 && strcmp(argv[1], "-i") == 0;
+    int file = index ? 2 : 1;
+
+    if (argc <= file) {
+        printf("Usage: %s [-i] file [from_cycle [count]]\n", argv[0]);
+        return 1;
+    }
+
+    d17b_trace_reader_t *r = d17b_trace_open(argv[file]);
+    if (!r) {
+        fprintf(stderr, "Cannot read trace %s\n", argv[file]);
+        return 1;
+    }
+
+    int status;
+    if (index) {
+        status = list_index(r);
+    } else {
+        uint64_t from = argc > file + 1 ? strtoull(argv[file + 1], NULL, 10) : 0;
+        uint64_t count = argc > file + 2 ? strtoull(argv[file + 2], NULL, 10)
+                                         : UINT64_MAX;
+        status = print_records(r, from, count);
+    }
+    d17b_trace_close(r);
+    return status;
+}